@@ -0,0 +1,75 @@
+/*
+ * Loader for fcsim-headless.wasm, the simulation without drawing. It
+ * needs nothing from the host but WebAssembly, so it runs the same
+ * bit-exact code as the site under node, deno or a worker.
+ *
+ *	let fcsim = await load_fcsim(wasm_bytes);
+ *	let sim = fcsim.load(xml_string);
+ *	sim.step(1000);
+ *	console.log(sim.solved, sim.tick, sim.hash);
+ *	sim.free();
+ */
+
+class Sim {
+	constructor(exports, ptr)
+	{
+		this.exports = exports;
+		this.ptr = ptr;
+	}
+
+	/* Runs up to ticks ticks, stopping once solved. Returns how many ran. */
+	step(ticks)
+	{
+		return this.exports.sim_step(this.ptr, ticks);
+	}
+
+	get solved()
+	{
+		return this.exports.sim_solved(this.ptr) != 0;
+	}
+
+	get tick()
+	{
+		return Number(this.exports.sim_tick(this.ptr));
+	}
+
+	/* State hash as 16 hex digits, as printed by fcsim-sim. */
+	get hash()
+	{
+		return BigInt.asUintN(64, this.exports.sim_hash(this.ptr)).toString(16).padStart(16, "0");
+	}
+
+	free()
+	{
+		this.exports.sim_free(this.ptr);
+		this.ptr = 0;
+	}
+}
+
+export async function load_fcsim(bytes)
+{
+	let env = {
+		performance_now() {
+			return performance.now();
+		},
+	};
+
+	let { instance } = await WebAssembly.instantiate(bytes, { env: env });
+	let exports = instance.exports;
+
+	return {
+		/* Returns null if the level does not parse. */
+		load(xml)
+		{
+			let data = new TextEncoder().encode(xml);
+			let mem = exports.malloc(data.length);
+
+			new Uint8Array(exports.memory.buffer, mem, data.length).set(data);
+
+			let ptr = exports.sim_load(mem, data.length);
+			exports.free(mem);
+
+			return ptr ? new Sim(exports, ptr) : null;
+		},
+	};
+}
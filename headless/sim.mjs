@@ -0,0 +1,45 @@
+/*
+ * node headless/sim.mjs <level.xml> [max_ticks]
+ *
+ * Same output as fcsim-sim, from fcsim-headless.wasm.
+ */
+
+import { readFileSync } from "node:fs";
+import { load_fcsim } from "./fcsim.mjs";
+
+const DEFAULT_MAX_TICKS = 100000;
+const CHUNK_TICKS = 1000;
+
+let args = process.argv.slice(2);
+
+if (args.length < 1 || args.length > 2) {
+	console.error("usage: node sim.mjs <level.xml> [max_ticks]");
+	process.exit(2);
+}
+
+let max_ticks = args.length == 2 ? Number(args[1]) : DEFAULT_MAX_TICKS;
+let wasm = readFileSync(new URL("fcsim-headless.wasm", import.meta.url));
+let fcsim = await load_fcsim(wasm);
+
+let sim = fcsim.load(readFileSync(args[0], "utf8"));
+if (!sim) {
+	console.error("sim.mjs: cannot parse " + args[0]);
+	process.exit(2);
+}
+
+let start = performance.now();
+while (!sim.solved && sim.tick < max_ticks)
+	sim.step(Math.min(CHUNK_TICKS, max_ticks - sim.tick));
+let secs = (performance.now() - start) / 1000;
+
+if (sim.solved)
+	console.log("solved at tick " + sim.tick);
+else
+	console.log("not solved after " + sim.tick + " ticks");
+console.log((secs > 0 ? sim.tick / secs : 0).toFixed(0) + " ticks/s");
+console.log("state hash " + sim.hash);
+
+let solved = sim.solved;
+sim.free();
+
+process.exit(solved ? 0 : 1);
@@ -20,7 +20,7 @@ let opened = false;
 
 function play(event)
 {
-	inst.exports.key_down(65);
+	locked(() => inst.exports.key_down(65));
 	play_button.blur();
 }
 
@@ -43,14 +43,39 @@ close_button.addEventListener("click", close);
 
 let canvas = document.getElementById("canvas");
 let gl = canvas.getContext("webgl");
+let instanced_arrays = gl.getExtension("ANGLE_instanced_arrays");
 
 let heap_counter = 0;
 let heap = {};
 let inst;
+let memory;
 
 let param_string = window.location.search;
 let params = new URLSearchParams(param_string);
 
+/*
+ * With cross-origin isolation the page loads fcsim-mt.wasm, whose
+ * memory is shared with a worker that runs the simulation timers, see
+ * worker.js. ?nothreads keeps everything on this thread.
+ */
+let threaded = window.crossOriginIsolated && !params.has("nothreads");
+let worker = null;
+
+/* Must match the wasm-mt-ld memory limits in build.ninja. */
+const SHARED_MEMORY_PAGES     = 64;
+const SHARED_MEMORY_MAX_PAGES = 16384;
+const WORKER_STACK_SIZE       = 1 << 20;
+const TIMER_SLOTS             = 64;
+
+/*
+ * set_interval() marks its id live in slot id % TIMER_SLOTS and
+ * clear_interval() clears it, both under the arena lock. The worker
+ * checks the slot under the same lock, so a callback that was already
+ * queued when its timer was cleared does nothing.
+ */
+let timer_live = null;
+let timer_cnt = 0;
+
 function add_object(obj)
 {
 	let id = heap_counter++;
@@ -63,15 +88,20 @@ function get_object(id)
 	return heap[id];
 }
 
-function make_view(data, size)
+/* Calls func under the arena lock, see arch/wasm/lock.c. */
+function locked(func)
 {
-	return new DataView(inst.exports.memory.buffer, data, size);
+	inst.exports.lock_arena();
+	let res = func();
+	inst.exports.unlock_arena();
+	return res;
 }
 
 function make_string(data, size)
 {
 	let decoder = new TextDecoder();
-	return decoder.decode(make_view(data, size));
+	/* TextDecoder does not take views of shared memory. */
+	return decoder.decode(new Uint8Array(memory.buffer, data, size).slice());
 }
 
 function make_cstring(data)
@@ -80,37 +110,183 @@ function make_cstring(data)
 	return make_string(data, size);
 }
 
-let gl_env = {
-	glActiveTexture(texture) {
-		gl.activeTexture(texture);
-	},
-
-	glAttachShader(program, shader) {
-		gl.attachShader(get_object(program), get_object(shader));
-	},
-
-	glBindBuffer(target, buffer) {
-		return gl.bindBuffer(target, get_object(buffer));
-	},
-
-	glBindTexture(target, texture) {
-		return gl.bindTexture(target, get_object(texture));
-	},
+/*
+ * Replays the command buffer recorded by arch/wasm/gl.c. The opcodes
+ * and argument layouts must match the CMD_* enum there.
+ */
+const CMD_ACTIVE_TEXTURE              = 1;
+const CMD_BIND_BUFFER                 = 2;
+const CMD_BIND_TEXTURE                = 3;
+const CMD_BUFFER_DATA                 = 4;
+const CMD_BUFFER_SUB_DATA             = 5;
+const CMD_CLEAR                       = 6;
+const CMD_CLEAR_COLOR                 = 7;
+const CMD_DISABLE_VERTEX_ATTRIB_ARRAY = 8;
+const CMD_DRAW_ARRAYS                 = 9;
+const CMD_DRAW_ELEMENTS               = 10;
+const CMD_DRAW_ELEMENTS_INSTANCED     = 11;
+const CMD_ENABLE_VERTEX_ATTRIB_ARRAY  = 12;
+const CMD_TEX_IMAGE_2D                = 13;
+const CMD_TEX_PARAMETER_I             = 14;
+const CMD_UNIFORM_1I                  = 15;
+const CMD_UNIFORM_2F                  = 16;
+const CMD_UNIFORM_3F                  = 17;
+const CMD_UNIFORM_3FV                 = 18;
+const CMD_USE_PROGRAM                 = 19;
+const CMD_VERTEX_ATTRIB_DIVISOR       = 20;
+const CMD_VERTEX_ATTRIB_POINTER       = 21;
+const CMD_VIEWPORT                    = 22;
+
+/* Views over wasm memory, recreated only when memory grows. */
+let cmd_memory = null;
+let cmd_u8;
+let cmd_u32;
+let cmd_i32;
+let cmd_f32;
+
+function cmd_views()
+{
+	let buffer = memory.buffer;
 
-	glBufferData(target, size, data, usage) {
-		gl.bufferData(target, make_view(data, size), usage);
-	},
+	if (buffer === cmd_memory)
+		return;
 
-	glBufferSubData(target, offset, size, data) {
-		gl.bufferSubData(target, offset, make_view(data, size));
-	},
+	cmd_memory = buffer;
+	cmd_u8  = new Uint8Array(buffer);
+	cmd_u32 = new Uint32Array(buffer);
+	cmd_i32 = new Int32Array(buffer);
+	cmd_f32 = new Float32Array(buffer);
+}
 
-	glClear(mask) {
-		gl.clear(mask);
-	},
+function gl_execute(cmds, len)
+{
+	cmd_views();
+
+	let u32 = cmd_u32;
+	let i32 = cmd_i32;
+	let f32 = cmd_f32;
+	let i = cmds >> 2;
+	let end = i + len;
+
+	while (i < end) {
+		switch (u32[i]) {
+		case CMD_ACTIVE_TEXTURE:
+			gl.activeTexture(u32[i + 1]);
+			i += 2;
+			break;
+		case CMD_BIND_BUFFER:
+			gl.bindBuffer(u32[i + 1], get_object(u32[i + 2]));
+			i += 3;
+			break;
+		case CMD_BIND_TEXTURE:
+			gl.bindTexture(u32[i + 1], get_object(u32[i + 2]));
+			i += 3;
+			break;
+		case CMD_BUFFER_DATA: {
+			let size = u32[i + 2];
+			if (u32[i + 4]) {
+				let data = (i + 5) * 4;
+				gl.bufferData(u32[i + 1], cmd_u8.subarray(data, data + size), u32[i + 3]);
+				i += 5 + ((size + 3) >> 2);
+			} else {
+				gl.bufferData(u32[i + 1], size, u32[i + 3]);
+				i += 5;
+			}
+			break;
+		}
+		case CMD_BUFFER_SUB_DATA: {
+			let size = u32[i + 3];
+			let data = (i + 4) * 4;
+			gl.bufferSubData(u32[i + 1], u32[i + 2], cmd_u8.subarray(data, data + size));
+			i += 4 + ((size + 3) >> 2);
+			break;
+		}
+		case CMD_CLEAR:
+			gl.clear(u32[i + 1]);
+			i += 2;
+			break;
+		case CMD_CLEAR_COLOR:
+			gl.clearColor(f32[i + 1], f32[i + 2], f32[i + 3], f32[i + 4]);
+			i += 5;
+			break;
+		case CMD_DISABLE_VERTEX_ATTRIB_ARRAY:
+			gl.disableVertexAttribArray(u32[i + 1]);
+			i += 2;
+			break;
+		case CMD_DRAW_ARRAYS:
+			gl.drawArrays(u32[i + 1], i32[i + 2], i32[i + 3]);
+			i += 4;
+			break;
+		case CMD_DRAW_ELEMENTS:
+			gl.drawElements(u32[i + 1], i32[i + 2], u32[i + 3], u32[i + 4]);
+			i += 5;
+			break;
+		case CMD_DRAW_ELEMENTS_INSTANCED:
+			instanced_arrays.drawElementsInstancedANGLE(u32[i + 1], i32[i + 2], u32[i + 3], u32[i + 4], i32[i + 5]);
+			i += 6;
+			break;
+		case CMD_ENABLE_VERTEX_ATTRIB_ARRAY:
+			gl.enableVertexAttribArray(u32[i + 1]);
+			i += 2;
+			break;
+		case CMD_TEX_IMAGE_2D: {
+			let size = u32[i + 8];
+			let data = (i + 9) * 4;
+			let pixels = size ? cmd_u8.subarray(data, data + size) : null;
+			gl.texImage2D(u32[i + 1], i32[i + 2], i32[i + 3], i32[i + 4], i32[i + 5], 0,
+				      u32[i + 6], u32[i + 7], pixels);
+			i += 9 + ((size + 3) >> 2);
+			break;
+		}
+		case CMD_TEX_PARAMETER_I:
+			gl.texParameteri(u32[i + 1], u32[i + 2], i32[i + 3]);
+			i += 4;
+			break;
+		case CMD_UNIFORM_1I:
+			gl.uniform1i(get_object(i32[i + 1]), i32[i + 2]);
+			i += 3;
+			break;
+		case CMD_UNIFORM_2F:
+			gl.uniform2f(get_object(i32[i + 1]), f32[i + 2], f32[i + 3]);
+			i += 4;
+			break;
+		case CMD_UNIFORM_3F:
+			gl.uniform3f(get_object(i32[i + 1]), f32[i + 2], f32[i + 3], f32[i + 4]);
+			i += 5;
+			break;
+		case CMD_UNIFORM_3FV: {
+			let count = u32[i + 2] * 3;
+			gl.uniform3fv(get_object(i32[i + 1]), f32.subarray(i + 3, i + 3 + count));
+			i += 3 + count;
+			break;
+		}
+		case CMD_USE_PROGRAM:
+			gl.useProgram(get_object(u32[i + 1]));
+			i += 2;
+			break;
+		case CMD_VERTEX_ATTRIB_DIVISOR:
+			instanced_arrays.vertexAttribDivisorANGLE(u32[i + 1], u32[i + 2]);
+			i += 3;
+			break;
+		case CMD_VERTEX_ATTRIB_POINTER:
+			gl.vertexAttribPointer(u32[i + 1], i32[i + 2], u32[i + 3], u32[i + 4] != 0,
+					       i32[i + 5], u32[i + 6]);
+			i += 7;
+			break;
+		case CMD_VIEWPORT:
+			gl.viewport(i32[i + 1], i32[i + 2], i32[i + 3], i32[i + 4]);
+			i += 5;
+			break;
+		default:
+			console.log("gl_execute: bad opcode " + u32[i] + " at word " + (i - (cmds >> 2)));
+			return;
+		}
+	}
+}
 
-	glClearColor(red, green, blue, alpha) {
-		gl.clearColor(red, green, blue, alpha);
+let gl_env = {
+	glAttachShader(program, shader) {
+		gl.attachShader(get_object(program), get_object(shader));
 	},
 
 	glCompileShader(shader) {
@@ -137,22 +313,6 @@ let gl_env = {
 		gl.deleteShader(get_object(shader));
 	},
 
-	glDisableVertexAttribArray(index) {
-		gl.disableVertexAttribArray(index);
-	},
-
-	glDrawArrays(mode, first, count) {
-		gl.drawArrays(mode, first, count);
-	},
-
-	glDrawElements(mode, count, type, offset) {
-		gl.drawElements(mode, count, type, offset);
-	},
-
-	glEnableVertexAttribArray(index) {
-		gl.enableVertexAttribArray(index);
-	},
-
 	glGetAttribLocation(program, name) {
 		return gl.getAttribLocation(get_object(program), make_cstring(name));
 	},
@@ -176,7 +336,7 @@ let gl_env = {
 	glShaderSource(shader, count, string, length) {
 		let strings = [];
 		let lengths = [];
-		let string_view = new DataView(inst.exports.memory.buffer, string);
+		let string_view = new DataView(memory.buffer, string);
 
 		if (length == 0) {
 			for (let i = 0; i < count; i++) {
@@ -197,45 +357,47 @@ let gl_env = {
 		gl.shaderSource(get_object(shader), source);
 	},
 
-	glTexImage2D(target, level, internalformat, width, height, border, format, type, pixels) {
-		/* TODO: how many bytes per pixel? */
-		let pixel_data = new Uint8Array(inst.exports.memory.buffer, pixels, width * height);
-		gl.texImage2D(target, level, internalformat, width, height, border, format, type, pixel_data);
+	gl_instanced_arrays() {
+		return instanced_arrays != null;
 	},
 
-	glTexParameteri(target, pname, param) {
-		gl.texParameteri(target, pname, param);
-	},
+	gl_execute,
 
-	glUniform1i(location, v0) {
-		gl.uniform1i(get_object(location), v0);
-	},
+	set_interval(func, delay, arg) {
+		if (!worker)
+			return setInterval(inst.exports.call, delay, func, arg);
 
-	glUniform2f(location, v0, v1) {
-		gl.uniform2f(get_object(location), v0, v1);
+		let id = ++timer_cnt;
+		Atomics.store(timer_live, id % TIMER_SLOTS, id);
+		worker.postMessage({ type: "set_interval", id: id, func: func, delay: delay, arg: arg });
+		return id;
 	},
 
-	glUniform3f(location, v0, v1, v2) {
-		gl.uniform3f(get_object(location), v0, v1, v2);
-	},
+	clear_interval(id) {
+		if (!worker) {
+			clearInterval(id);
+			return;
+		}
 
-	glUseProgram(program) {
-		gl.useProgram(get_object(program));
+		Atomics.store(timer_live, id % TIMER_SLOTS, 0);
+		worker.postMessage({ type: "clear_interval", id: id });
 	},
 
-	glVertexAttribPointer(index, size, type, normalized, stride, pointer) {
-		gl.vertexAttribPointer(index, size, type, normalized, stride, pointer);
+	/* Nothing else runs on this thread meanwhile, see worker.js. */
+	yield_interval() {
+		return true;
 	},
 
-	glViewport(x, y, width, height) {
+	performance_now() {
+		return performance.now();
 	},
 
-	set_interval(func, delay, arg) {
-		return setInterval(inst.exports.call, delay, func, arg);
+	trace_tid() {
+		return cur_tid;
 	},
 
-	clear_interval(id) {
-		clearInterval(id);
+	trace_set_tid(tid) {
+		cur_tid = tid;
 	},
 
 	print_slice(str, len) {
@@ -243,8 +405,8 @@ let gl_env = {
 	},
 
 	printf(fmt, args) {
-		let fmt_view = new DataView(inst.exports.memory.buffer, fmt);
-		let arg_view = new DataView(inst.exports.memory.buffer, args);
+		let fmt_view = new DataView(memory.buffer, fmt);
+		let arg_view = new DataView(memory.buffer, args);
 		let res = [];
 		let i = 0;
 		let a = 0;
@@ -292,12 +454,75 @@ function canvas_draw(timestamp)
 		canvas.width = width;
 		canvas.height = height;
 		gl.viewport(0, 0, width, height);
-		inst.exports.resize(width, height);
+		locked(() => inst.exports.resize(width, height));
 	}
 	inst.exports.draw();
+	if (trace_chunks)
+		collect_trace();
 	window.requestAnimationFrame(canvas_draw);
 }
 
+/*
+ * With ?trace in the URL the module records a Chrome trace. Call
+ * save_trace() from the console to download it.
+ */
+let trace_chunks = null;
+
+/* Trace thread id of the page, the worker keeps its own. */
+let cur_tid = 0;
+
+function collect_trace()
+{
+	let json = inst.exports.trace_take_json();
+
+	if (json) {
+		trace_chunks.push(make_cstring(json));
+		inst.exports.free(json);
+	}
+}
+
+function save_trace()
+{
+	collect_trace();
+
+	let blob = new Blob(trace_chunks, { type: "application/json" });
+	let link = document.createElement("a");
+	link.href = URL.createObjectURL(blob);
+	link.download = "fcsim-trace.json";
+	link.click();
+	URL.revokeObjectURL(link.href);
+}
+
+window.save_trace = save_trace;
+
+/* Field order of struct heap_stats in malloc.c. */
+const heap_stat_names = [
+	"memory_size",
+	"heap_size",
+	"used_bytes",
+	"free_bytes",
+	"peak_used_bytes",
+	"used_blocks",
+	"free_blocks",
+	"alloc_cnt",
+	"free_cnt",
+	"grow_cnt",
+];
+
+function heap_stats()
+{
+	let ptr = inst.exports.get_heap_stats();
+	let view = new DataView(memory.buffer, ptr, heap_stat_names.length * 4);
+	let stats = {};
+
+	for (let i = 0; i < heap_stat_names.length; i++)
+		stats[heap_stat_names[i]] = view.getUint32(i * 4, true);
+
+	return stats;
+}
+
+window.heap_stats = heap_stats;
+
 function to_key(code)
 {
 	if (code == "Space") return 65;
@@ -312,6 +537,8 @@ function to_key(code)
 	if (code == "Digit2") return 11;
 	if (code == "Digit3") return 12;
 	if (code == "Digit4") return 13;
+	if (code == "Digit5") return 14;
+	if (code == "Digit6") return 15;
 	if (code == "ShiftLeft") return 50;
 	if (code == "ControlLeft") return 37;
 	return 0;
@@ -327,34 +554,34 @@ function canvas_keydown(event)
 {
 	if (opened)
 		return;
-	inst.exports.key_down(to_key(event.code));
+	locked(() => inst.exports.key_down(to_key(event.code)));
 }
 
 function canvas_keyup(event)
 {
 	if (opened)
 		return;
-	inst.exports.key_up(to_key(event.code));
+	locked(() => inst.exports.key_up(to_key(event.code)));
 }
 
 function canvas_mousedown(event)
 {
-	inst.exports.button_down(to_button(event.button));
+	locked(() => inst.exports.button_down(to_button(event.button)));
 }
 
 function canvas_mouseup(event)
 {
-	inst.exports.button_up(to_button(event.button));
+	locked(() => inst.exports.button_up(to_button(event.button)));
 }
 
 function canvas_mousemove(event)
 {
-	inst.exports.move(event.offsetX, event.offsetY);
+	locked(() => inst.exports.move(event.offsetX, event.offsetY));
 }
 
 function canvas_wheel(event)
 {
-	inst.exports.scroll(-0.02 * event.deltaY);
+	locked(() => inst.exports.scroll(-0.02 * event.deltaY));
 }
 
 function alloc_str(str)
@@ -364,7 +591,7 @@ function alloc_str(str)
 	let str_uint8 = encoder.encode(str);
 	let len = str_uint8.length;
 	let mem = inst.exports.malloc(len + 1);
-	let mem_uint8 = new Uint8Array(inst.exports.memory.buffer, mem, len + 1);
+	let mem_uint8 = new Uint8Array(memory.buffer, mem, len + 1);
 	mem_uint8.set(str_uint8);
 	mem_uint8[len] = 0;
 
@@ -395,7 +622,7 @@ function save_design(event)
 	let name = alloc_str(data.get("name"));
 	let desc = alloc_str(data.get("description"));
 
-	let xml = inst.exports.export(user, name, desc);
+	let xml = locked(() => inst.exports.export(user, name, desc));
 	let len = inst.exports.strlen(xml);
 
 	let xml_str = make_cstring(xml);
@@ -411,21 +638,50 @@ function save_design(event)
 	request_promise.then(on_result);
 }
 
+function start_worker(module)
+{
+	let stack = inst.exports.malloc(WORKER_STACK_SIZE);
+
+	timer_live = new Int32Array(new SharedArrayBuffer(TIMER_SLOTS * 4));
+
+	worker = new Worker("worker.js");
+	worker.postMessage({
+		type:      "init",
+		module:    module,
+		memory:    memory,
+		stack_top: (stack + WORKER_STACK_SIZE) & ~15,
+		live:      timer_live,
+		trace:     trace_chunks != null,
+	});
+}
+
 function init_module(results)
 {
 	let module = results[0];
 	let buffer = results[1];
 
 	inst = module.instance;
+	if (!memory)
+		memory = inst.exports.memory;
+
+	if (params.has("trace")) {
+		trace_chunks = [];
+		inst.exports.trace_start();
+		inst.exports.trace_thread(alloc_str("main"));
+	}
 
 	let buffer_uint8 = new Uint8Array(buffer);
 	let len = buffer_uint8.length;
 	let mem = inst.exports.malloc(len);
-	let mem_uint8 = new Uint8Array(inst.exports.memory.buffer, mem, len);
+	let mem_uint8 = new Uint8Array(memory.buffer, mem, len);
 	mem_uint8.set(buffer_uint8);
 
 	inst.exports.init(mem, buffer_uint8.length);
 	inst.exports.resize(canvas.width, canvas.height);
+
+	/* The worker needs its own stack, which takes an exported stack pointer. */
+	if (threaded && inst.exports.__stack_pointer)
+		start_worker(module.module);
 	window.requestAnimationFrame(canvas_draw);
 	addEventListener("keydown", canvas_keydown);
 	addEventListener("keyup", canvas_keyup);
@@ -436,8 +692,17 @@ function init_module(results)
 	save_form.addEventListener("submit", save_design);
 }
 
+if (threaded) {
+	memory = new WebAssembly.Memory({
+		initial: SHARED_MEMORY_PAGES,
+		maximum: SHARED_MEMORY_MAX_PAGES,
+		shared:  true,
+	});
+	gl_env.memory = memory;
+}
+
 let module_promise = WebAssembly.instantiateStreaming(
-	fetch("fcsim.wasm"), import_object
+	fetch(threaded ? "fcsim-mt.wasm" : "fcsim.wasm"), import_object
 );
 
 let design_id = params.get('designId');
@@ -0,0 +1,123 @@
+"use strict";
+
+/*
+ * Runs the simulation timers of fcsim-mt.wasm off the page's thread.
+ * The instance here shares memory with the one in main.js. tick_func()
+ * publishes block transforms through the triple buffer in arena.c and
+ * draw() on the page picks up the newest one, so slow frames never
+ * hold up the simulation and fast-forward never holds up the page.
+ *
+ * Only the timer callbacks run here. Anything that touches GL or the
+ * page stays in main.js, those imports throw if called from here.
+ */
+
+let inst;
+let memory;
+let timer_live;
+let timers = new Map();
+let cur_timer = 0;
+let cur_tid = 0;
+let ready;
+
+function make_string(data, size)
+{
+	let decoder = new TextDecoder();
+	return decoder.decode(new Uint8Array(memory.buffer, data, size).slice());
+}
+
+function alloc_str(str)
+{
+	let bytes = new TextEncoder().encode(str);
+	let mem = inst.exports.malloc(bytes.length + 1);
+	let mem_uint8 = new Uint8Array(memory.buffer, mem, bytes.length + 1);
+
+	mem_uint8.set(bytes);
+	mem_uint8[bytes.length] = 0;
+
+	return mem;
+}
+
+function unavailable(name)
+{
+	return () => {
+		throw new Error(name + " called on the simulation worker");
+	};
+}
+
+function make_env(module)
+{
+	let env = { memory: memory };
+
+	for (let imp of WebAssembly.Module.imports(module)) {
+		if (imp.kind == "function")
+			env[imp.name] = unavailable(imp.name);
+	}
+
+	env.performance_now = () => performance.now();
+	env.print_slice = (str, len) => console.log(make_string(str, len));
+	env.trace_tid = () => cur_tid;
+	env.trace_set_tid = (tid) => { cur_tid = tid; };
+	env.yield_interval = yield_interval;
+
+	return env;
+}
+
+async function init(msg)
+{
+	memory = msg.memory;
+	timer_live = msg.live;
+
+	inst = await WebAssembly.instantiate(msg.module, { env: make_env(msg.module) });
+	inst.exports.__stack_pointer.value = msg.stack_top;
+	if (msg.trace)
+		inst.exports.trace_thread(alloc_str("sim"));
+}
+
+function is_live(id)
+{
+	return Atomics.load(timer_live, id % timer_live.length) == id;
+}
+
+/* See timer_live in main.js. */
+function fire(id, func, arg)
+{
+	inst.exports.lock_arena();
+	if (is_live(id)) {
+		cur_timer = id;
+		inst.exports.call(func, arg);
+	}
+	inst.exports.unlock_arena();
+}
+
+/*
+ * A callback running for a while lets a handler waiting in locked() on
+ * the page go first, which may clear its timer.
+ */
+function yield_interval()
+{
+	inst.exports.yield_arena();
+	return is_live(cur_timer);
+}
+
+function handle(msg)
+{
+	switch (msg.type) {
+	case "set_interval":
+		timers.set(msg.id, setInterval(fire, msg.delay, msg.id, msg.func, msg.arg));
+		break;
+	case "clear_interval":
+		clearInterval(timers.get(msg.id));
+		timers.delete(msg.id);
+		break;
+	}
+}
+
+onmessage = (event) => {
+	let msg = event.data;
+
+	/* Instantiating is async, keep later messages in order behind it. */
+	if (msg.type == "init")
+		ready = init(msg);
+	else
+		ready = ready.then(() => handle(msg));
+};
@@ -56,9 +56,8 @@ void* b2BlockAllocator_Allocate(b2BlockAllocator *allocator, int32 size);
 
 void b2BlockAllocator_Free(b2BlockAllocator *allocator, void* p, int32 size);
 
-extern int32 b2BlockAllocator_s_blockSizes[b2_blockSizes];
-extern uint8 b2BlockAllocator_s_blockSizeLookup[b2_maxBlockSize + 1];
-extern bool b2BlockAllocator_s_blockSizeLookupInitialized;
+extern const int32 b2BlockAllocator_s_blockSizes[b2_blockSizes];
+extern const uint8 b2BlockAllocator_s_blockSizeLookup[b2_maxBlockSize + 1];
 
 #ifdef __cplusplus
 }
@@ -57,32 +57,57 @@ enum
 {
 	b2Body_e_staticFlag		= 0x0001,
 	b2Body_e_frozenFlag		= 0x0002,
-	b2Body_e_islandFlag		= 0x0004,
 	b2Body_e_sleepFlag			= 0x0008,
 	b2Body_e_allowSleepFlag	= 0x0010,
 	b2Body_e_destroyFlag		= 0x0020,
+
+	// Bookkeeping of the contact manager, see b2ContactManager_SyncSleep.
+	b2Body_e_sleepChangedFlag	= 0x0040,
+	b2Body_e_contactSleepFlag	= 0x0080,
 };
 
 
+typedef struct b2Body b2Body;
+struct b2Body;
+
+// The part of a body that every step reads. The world keeps these in one
+// array so that the island search and the solver walk dense cache lines;
+// the rest of the body is touched much less often. The first line holds
+// what the island search and integration need.
+typedef struct b2BodyState b2BodyState;
+struct b2BodyState
+{
+	uint32 flags;
+
+	// The world's island stamp if the body joined an island this step.
+	uint32 islandStamp;
+
+	float64 invMass;
+	float64 invI;
+
+	b2Vec2 linearVelocity;
+	float64 angularVelocity;
+
+	b2Vec2 position;	// center of mass position
+	float64 rotation;
+	b2Mat22 R;
+
+	// Owner, for when the world moves the state.
+	b2Body* body;
+} __attribute__((aligned(b2_cacheLineSize)));
+
 // A rigid body. Internal computation are done in terms
 // of the center of mass position. The center of mass may
 // be offset from the body's origin.
-typedef struct b2Body b2Body;
 struct b2Body
 {
-	uint32 m_flags;
-
-	b2Vec2 m_position;	// center of mass position
-	float64 m_rotation;
-	b2Mat22 m_R;
+	// Owned by the world, see b2World_CreateBody.
+	b2BodyState* m_state;
 
 	// Conservative advancement data.
 	b2Vec2 m_position0;
 	float64 m_rotation0;
 
-	b2Vec2 m_linearVelocity;
-	float64 m_angularVelocity;
-
 	b2Vec2 m_force;
 	float64 m_torque;
 
@@ -98,14 +123,20 @@ struct b2Body
 	b2JointNode* m_jointList;
 	b2ContactNode* m_contactList;
 
-	float64 m_mass, m_invMass;
-	float64 m_I, m_invI;
+	float64 m_mass;
+	float64 m_I;
 
 	float64 m_linearDamping;
 	float64 m_angularDamping;
 
 	float64 m_sleepTime;
 
+	// Slot in the island last built, see b2Island_AddBody.
+	int32 m_islandIndex;
+
+	// Next body whose sleep flag changed, see b2Body_SleepChanged.
+	b2Body* m_sleepChangedNext;
+
 	void* m_userData;
 };
 
@@ -143,27 +174,43 @@ b2Vec2 b2Body_GetOriginPosition(const b2Body *body);
 
 static inline float64 b2Body_GetRotation(const b2Body *body)
 {
-	return body->m_rotation;
+	return body->m_state->rotation;
 }
 
 static inline bool b2Body_IsStatic(const b2Body *body)
 {
-	return (body->m_flags & b2Body_e_staticFlag) == b2Body_e_staticFlag;
+	return (body->m_state->flags & b2Body_e_staticFlag) == b2Body_e_staticFlag;
 }
 
 static inline bool b2Body_IsFrozen(const b2Body *body)
 {
-	return (body->m_flags & b2Body_e_frozenFlag) == b2Body_e_frozenFlag;
+	return (body->m_state->flags & b2Body_e_frozenFlag) == b2Body_e_frozenFlag;
 }
 
 static inline bool b2Body_IsSleeping(const b2Body *body)
 {
-	return (body->m_flags & b2Body_e_sleepFlag) == b2Body_e_sleepFlag;
+	return (body->m_state->flags & b2Body_e_sleepFlag) == b2Body_e_sleepFlag;
+}
+
+// Queues the body for the contact manager, which parks the contacts
+// between sleeping bodies. Called whenever the sleep flag changes.
+void b2Body_SleepChanged(b2Body *body);
+
+// Sets or clears the sleep flag, leaving the sleep time alone.
+static inline void b2Body_SetSleepFlag(b2Body *body, bool flag)
+{
+	uint32 flags = body->m_state->flags;
+	uint32 newFlags = flag ? flags | b2Body_e_sleepFlag : flags & ~b2Body_e_sleepFlag;
+	if (newFlags != flags)
+	{
+		body->m_state->flags = newFlags;
+		b2Body_SleepChanged(body);
+	}
 }
 
 static inline void b2Body_WakeUp(b2Body *body)
 {
-	body->m_flags &= ~b2Body_e_sleepFlag;
+	b2Body_SetSleepFlag(body, false);
 	body->m_sleepTime = 0.0;
 }
 
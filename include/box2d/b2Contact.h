@@ -53,8 +53,8 @@ struct b2ContactRegister
 
 enum
 {
-	b2Contact_e_islandFlag		= 0x0001,
 	b2Contact_e_destroyFlag		= 0x0002,
+	b2Contact_e_sleepFlag		= 0x0004,
 };
 
 typedef struct b2Contact b2Contact;
@@ -65,10 +65,22 @@ struct b2Contact
 
 	uint32 m_flags;
 
+	// See b2BodyState::islandStamp.
+	uint32 m_islandStamp;
+
 	// World pool and list pointers.
 	b2Contact* m_prev;
 	b2Contact* m_next;
 
+	// Links in the awake or the sleeping list of the contact manager,
+	// depending on b2Contact_e_sleepFlag.
+	b2Contact* m_listPrev;
+	b2Contact* m_listNext;
+
+	// Creation order, the awake list is sorted on it like the world
+	// list is.
+	uint64 m_serial;
+
 	// Nodes for connecting bodies.
 	b2ContactNode m_node1;
 	b2ContactNode m_node2;
@@ -76,6 +88,10 @@ struct b2Contact
 	b2Shape* m_shape1;
 	b2Shape* m_shape2;
 
+	// Island slots of the two bodies, see b2Island_IndexConstraints.
+	int32 m_islandIndex1;
+	int32 m_islandIndex2;
+
 	int32 m_manifoldCount;
 
 	// Combined friction
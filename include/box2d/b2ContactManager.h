@@ -28,6 +28,9 @@ struct b2World;
 typedef struct b2Contact b2Contact;
 struct b2Contact;
 
+typedef struct b2Body b2Body;
+struct b2Body;
+
 typedef struct b2ContactManager b2ContactManager;
 struct b2ContactManager
 {
@@ -39,6 +42,17 @@ struct b2ContactManager
 	// contacts that shouldn't exist.
 	b2NullContact m_nullContact;
 
+	// The contacts Collide walks, in world list order, and the touching
+	// contacts between two sleeping bodies, which it can skip. Contacts
+	// that do not touch stay in the awake list, sleeping or not.
+	b2Contact* m_awakeList;
+	b2Contact* m_sleepingList;
+
+	// Bodies whose sleep flag changed since the lists were last synced.
+	b2Body* m_sleepChangedList;
+
+	uint64 m_contactSerial;
+
 	bool m_destroyImmediate;
 };
 
@@ -61,15 +75,32 @@ static void b2ContactManager_ctor(b2ContactManager *manager)
 {
 	b2NullContact_ctor(&manager->m_nullContact);
 	manager->m_world = NULL;
+	manager->m_awakeList = NULL;
+	manager->m_sleepingList = NULL;
+	manager->m_sleepChangedList = NULL;
+	manager->m_contactSerial = 0;
 	manager->m_destroyImmediate = false;
 	manager->m_pairCallback.PairAdded = b2ContactManager_PairAdded;
 	manager->m_pairCallback.PairRemoved = b2ContactManager_PairRemoved;
 }
 
-void b2ContactManager_Collide(b2ContactManager *manager);
+// Returns the number of contacts evaluated.
+int32 b2ContactManager_Collide(b2ContactManager *manager);
+
+// Returns the number of contacts evaluated.
+int32 b2ContactManager_CollideFiltered(b2ContactManager *manager,
+				       bool (*filter)(b2Shape* shape, void* data),
+				       void* data);
 
 void b2ContactManager_CleanContactList(b2ContactManager *manager);
 
+// Moves the contacts of the bodies whose sleep flag changed between the
+// awake and the sleeping list. Collide starts with this.
+void b2ContactManager_SyncSleep(b2ContactManager *manager);
+
+// Builds the lists from scratch, for a world that was loaded.
+void b2ContactManager_ResetSleep(b2ContactManager *manager);
+
 #ifdef __cplusplus
 }
 #endif
@@ -26,6 +26,8 @@ class b2Contact;
 struct b2Body;
 class b2Island;
 class b2StackAllocator;
+struct b2TimeStep;
+struct b2SolverData;
 
 struct b2ContactConstraintPoint
 {
@@ -45,8 +47,8 @@ struct b2ContactConstraint
 	b2ContactConstraintPoint points[b2_maxManifoldPoints];
 	b2Vec2 normal;
 	b2Manifold* manifold;
-	b2Body* body1;
-	b2Body* body2;
+	int32 index1;
+	int32 index2;
 	float64 friction;
 	float64 restitution;
 	int32 pointCount;
@@ -55,14 +57,15 @@ struct b2ContactConstraint
 struct b2ContactSolver
 {
 	b2StackAllocator* m_allocator;
+	b2SolverData* m_data;
 	b2ContactConstraint* m_constraints;
 	int m_constraintCount;
 };
 
-void b2ContactSolver_ctor(b2ContactSolver *solver, b2Contact** contacts, int32 contactCount, b2StackAllocator* allocator);
+void b2ContactSolver_ctor(b2ContactSolver *solver, b2Contact** contacts, int32 contactCount, b2SolverData* data, b2StackAllocator* allocator);
 void b2ContactSolver_dtor(b2ContactSolver *solver);
 
-void b2ContactSolver_PreSolve(b2ContactSolver *solver);
+void b2ContactSolver_PreSolve(b2ContactSolver *solver, const b2TimeStep* step);
 
 void b2ContactSolver_SolveVelocityConstraints(b2ContactSolver *solver);
 
@@ -20,12 +20,28 @@
 #define B2_ISLAND_H
 
 #include <box2d/b2Math.h>
+#include <box2d/b2Body.h>
 
 class b2StackAllocator;
 class b2Contact;
 struct b2Body;
 struct b2Joint;
 struct b2TimeStep;
+struct b2Profile;
+
+// The island's body state while it is solved, in arrays indexed by island
+// slot. b2Island_Solve gathers it from the bodies, the contact and joint
+// solvers run all their iterations on it, and only then is it written back.
+struct b2SolverData
+{
+	b2Vec2* positions;
+	float64* rotations;
+	b2Mat22* Rs;
+	b2Vec2* linearVelocities;
+	float64* angularVelocities;
+	float64* invMasses;
+	float64* invIs;
+};
 
 struct b2Island
 {
@@ -44,6 +60,12 @@ struct b2Island
 	int32 m_jointCapacity;
 
 	float64 m_positionError;
+
+	// Position iterations used by the last solve.
+	int32 m_positionIterations;
+
+	// Phase timings are accumulated here when not NULL.
+	b2Profile* m_profile;
 };
 
 void b2Island_ctor(b2Island *island, int32 bodyCapacity, int32 contactCapacity, int32 jointCapacity, b2StackAllocator* allocator);
@@ -51,14 +73,19 @@ void b2Island_dtor(b2Island *island);
 
 void b2Island_Clear(b2Island *island);
 
+void b2Island_IndexConstraints(b2Island *island);
+
 void b2Island_Solve(b2Island *island, const b2TimeStep* step, const b2Vec2& gravity);
 
+void b2Island_Synchronize(b2Island *island);
+
 
 void b2Island_UpdateSleep(b2Island *island, float64 dt);
 
 static inline void b2Island_AddBody(b2Island *island, b2Body* body)
 {
 	b2Assert(island->m_bodyCount < island->m_bodyCapacity);
+	body->m_islandIndex = island->m_bodyCount;
 	island->m_bodies[island->m_bodyCount++] = body;
 }
 
@@ -34,6 +34,9 @@ struct b2TimeStep;
 typedef struct b2BlockAllocator b2BlockAllocator;
 struct b2BlockAllocator;
 
+typedef struct b2SolverData b2SolverData;
+struct b2SolverData;
+
 enum b2JointType
 {
 	e_unknownJoint,
@@ -92,10 +95,10 @@ struct b2Joint
 	b2Vec2 (*GetReactionForce)(b2Joint *joint, float64 invTimeStep);
 	float64 (*GetReactionTorque)(b2Joint *joint, float64 invTimeStep);
 
-	void (*PrepareVelocitySolver)(b2Joint *joint);
-	void (*SolveVelocityConstraints)(b2Joint *joint, const b2TimeStep* step);
+	void (*PrepareVelocitySolver)(b2Joint *joint, const b2TimeStep* step, b2SolverData* data);
+	void (*SolveVelocityConstraints)(b2Joint *joint, const b2TimeStep* step, b2SolverData* data);
 
-	bool (*SolvePositionConstraints)(b2Joint *joint);
+	bool (*SolvePositionConstraints)(b2Joint *joint, b2SolverData* data);
 
 	b2JointType m_type;
 	b2Joint* m_prev;
@@ -105,7 +108,13 @@ struct b2Joint
 	b2Body* m_body1;
 	b2Body* m_body2;
 
-	bool m_islandFlag;
+	// Island slots of the two bodies, see b2Island_IndexConstraints.
+	int32 m_islandIndex1;
+	int32 m_islandIndex2;
+
+	// See b2BodyState::islandStamp.
+	uint32 m_islandStamp;
+
 	bool m_collideConnected;
 
 	void* m_userData;
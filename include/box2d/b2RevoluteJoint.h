@@ -72,10 +72,10 @@ b2Vec2 b2RevoluteJoint_GetAnchor2(b2Joint *joint);
 b2Vec2 b2RevoluteJoint_GetReactionForce(b2Joint *joint, float64 invTimeStep);
 float64 b2RevoluteJoint_GetReactionTorque(b2Joint *joint, float64 invTimeStep);
 
-void b2RevoluteJoint_PrepareVelocitySolver(b2Joint *joint);
-void b2RevoluteJoint_SolveVelocityConstraints(b2Joint *joint, const b2TimeStep* step);
+void b2RevoluteJoint_PrepareVelocitySolver(b2Joint *joint, const b2TimeStep* step, b2SolverData* data);
+void b2RevoluteJoint_SolveVelocityConstraints(b2Joint *joint, const b2TimeStep* step, b2SolverData* data);
 
-bool b2RevoluteJoint_SolvePositionConstraints(b2Joint *joint);
+bool b2RevoluteJoint_SolvePositionConstraints(b2Joint *joint, b2SolverData* data);
 
 void b2RevoluteJoint_ctor(b2RevoluteJoint *joint, const b2RevoluteJointDef* def);
 
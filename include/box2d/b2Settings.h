@@ -30,6 +30,7 @@ typedef signed int int32;
 typedef unsigned char uint8;
 typedef unsigned short uint16;
 typedef unsigned int uint32;
+typedef unsigned long long uint64;
 typedef double float64;
 
 static const float64 b2_pi = 3.141592653589793;
@@ -72,6 +73,9 @@ static const float64 b2_angularSleepTolerance = 0.011111111111111112;
 
 // Memory Allocation
 
+// Body states are aligned to cache lines, see b2BodyState.
+#define b2_cacheLineSize 64
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -0,0 +1,72 @@
+/*
+* Copyright (c) 2006-2007 Erin Catto http://www.gphysics.com
+*
+* This software is provided 'as-is', without any express or implied
+* warranty.  In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+#ifndef B2_SNAPSHOT_H
+#define B2_SNAPSHOT_H
+
+#include <box2d/b2Settings.h>
+
+typedef struct b2World b2World;
+struct b2World;
+
+// A growable byte buffer holding the complete dynamic state of a world:
+// bodies, shapes, joints, contacts (including warm starting impulses),
+// the broad-phase proxies and the pair manager. Object pointers are
+// stored as indices, so a snapshot can be written to disk and restored
+// in another process. The layout is tied to the build that wrote it.
+typedef struct b2Snapshot b2Snapshot;
+struct b2Snapshot
+{
+	char* data;
+	int32 size;
+	int32 capacity;
+};
+
+// Translates shape, body and joint user data. When saving it maps the
+// user data to a token that is stored in the snapshot, when restoring it
+// maps the token back, returning NULL for a token it does not know,
+// which fails the restore. Pass NULL to store the user data pointers as
+// is, which is enough when restoring in the same process.
+typedef void* (*b2SnapshotUserDataFcn)(void* userData, void* context);
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void b2Snapshot_ctor(b2Snapshot *snapshot);
+
+void b2Snapshot_dtor(b2Snapshot *snapshot);
+
+// Serialise the world into the snapshot, replacing its previous contents.
+// The collision filter is not saved.
+void b2World_Save(b2World *world, b2Snapshot *snapshot,
+		  b2SnapshotUserDataFcn fcn, void* context);
+
+// Construct a world from a snapshot. Stepping the restored world gives
+// bit-identical results to stepping the world that was saved. The
+// collision filter has to be set again by the caller. Returns false if
+// the snapshot is malformed or was written by an incompatible build, in
+// which case the world is left unconstructed.
+bool b2World_Restore(b2World *world, const char* data, int32 size,
+		     b2SnapshotUserDataFcn fcn, void* context);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -28,6 +28,7 @@ typedef struct b2AABB b2AABB;
 typedef struct b2BodyDef b2BodyDef;
 typedef struct b2JointDef b2JointDef;
 typedef struct b2Body b2Body;
+typedef struct b2BodyState b2BodyState;
 typedef struct b2Joint b2Joint;
 typedef struct b2Shape b2Shape;
 typedef struct b2Contact b2Contact;
@@ -36,6 +37,7 @@ struct b2AABB;
 struct b2BodyDef;
 struct b2JointDef;
 struct b2Body;
+struct b2BodyState;
 struct b2Joint;
 struct b2Shape;
 struct b2Contact;
@@ -43,12 +45,50 @@ struct b2BroadPhase;
 
 typedef bool (*b2CollisionFilter)(b2Shape* shape1, b2Shape* shape2);
 
+// A task of a parallel for. worker is in [0, workerCount) and tells
+// apart the threads that may run tasks at the same time.
+typedef void (*b2ParallelTask)(void* data, int32 index, int32 worker);
+
+// Runs task(data, i, worker) for every i in [0, count) and returns once
+// all have finished.
+typedef void (*b2ParallelFor)(void* context, b2ParallelTask task, void* data, int32 count);
+
 typedef struct b2TimeStep b2TimeStep;
 struct b2TimeStep
 {
 	float64 dt;			// time step
 	float64 inv_dt;		// inverse time step (0 if dt == 0).
 	int32 iterations;
+	bool warmStarting;
+	bool positionCorrection;
+};
+
+// Phase timings in milliseconds and solver counters. Only filled in
+// when profiling is enabled on the world.
+typedef struct b2Profile b2Profile;
+struct b2Profile
+{
+	float64 step;
+	float64 cleanContactList;
+	float64 cleanBodyList;
+	float64 collide;
+	float64 islandSearch;
+	float64 preSolve;
+	float64 solveVelocity;
+	float64 integratePositions;
+	float64 solvePosition;
+	float64 synchronize;
+	float64 broadPhaseCommit;
+
+	// Islands solved in parallel, with no per-phase breakdown.
+	float64 parallelSolve;
+
+	uint32 stepCount;
+	uint32 contactsEvaluated;
+	uint32 islandCount;
+	uint32 islandBodyCount;
+	uint32 maxIslandBodyCount;
+	uint32 positionIterations;
 };
 
 typedef struct b2World b2World;
@@ -71,12 +111,36 @@ struct b2World
 	// These bodies will be destroyed at the next time step.
 	b2Body* m_bodyDestroyList;
 
+	// Per-step body state, dense and aligned, see b2BodyState.
+	b2BodyState* m_bodyStates;
+	void* m_bodyStateBuffer;
+	int32 m_bodyStateCount;
+	int32 m_bodyStateCapacity;
+
+	// Bumped every step, so that nothing carries an island mark over
+	// from the step before and the marks need no clearing.
+	uint32 m_islandStamp;
+
 	b2Vec2 m_gravity;
 	bool m_allowSleep;
 
+	bool m_warmStarting;
+	bool m_positionCorrection;
+
 	b2Body* m_groundBody;
 
 	b2CollisionFilter m_filter;
+
+	// Profile of the last step and the sum over all profiled steps.
+	bool m_profiling;
+	b2Profile m_profile;
+	b2Profile m_profileTotal;
+
+	// Set by b2World_SetParallel, one stack allocator per worker.
+	b2ParallelFor m_parallelFor;
+	void* m_parallelContext;
+	b2StackAllocator* m_workerAllocators;
+	int32 m_workerCount;
 };
 
 #ifdef __cplusplus
@@ -91,6 +155,11 @@ void b2World_dtor(b2World *world);
 // Otherwise the default filter is used (b2CollisionFilter).
 void b2World_SetFilter(b2World *world, b2CollisionFilter filter);
 
+// Solve the islands of each step through parallelFor, on up to
+// workerCount threads. The result is bit for bit the same as solving
+// them one after another, which is what a NULL parallelFor goes back to.
+void b2World_SetParallel(b2World *world, b2ParallelFor parallelFor, void* context, int32 workerCount);
+
 // Create and destroy rigid bodies. Destruction is deferred until the
 // the next call to Step. This is done so that bodies may be destroyed
 // while you iterate through the contact list.
@@ -108,8 +177,40 @@ static inline b2Joint* b2World_GetJointList(b2World *world)
 	return world->m_jointList;
 }
 
-extern int32 b2World_s_enablePositionCorrection;
-extern int32 b2World_s_enableWarmStarting;
+// Enable/disable warm starting and position correction. These are
+// per world so that independent worlds can be stepped concurrently.
+static inline void b2World_SetWarmStarting(b2World *world, bool flag)
+{
+	world->m_warmStarting = flag;
+}
+
+static inline void b2World_SetPositionCorrection(b2World *world, bool flag)
+{
+	world->m_positionCorrection = flag;
+}
+
+void b2Profile_ctor(b2Profile *profile);
+
+void b2Profile_Add(b2Profile *total, const b2Profile *profile);
+
+// Profiling reads the clock a few times per island, so it is off by
+// default. Enabling it resets the totals.
+static inline void b2World_SetProfiling(b2World *world, bool flag)
+{
+	world->m_profiling = flag;
+	b2Profile_ctor(&world->m_profile);
+	b2Profile_ctor(&world->m_profileTotal);
+}
+
+static inline const b2Profile* b2World_GetProfile(const b2World *world)
+{
+	return &world->m_profile;
+}
+
+static inline const b2Profile* b2World_GetProfileTotal(const b2World *world)
+{
+	return &world->m_profileTotal;
+}
 
 #ifdef __cplusplus
 }
@@ -1,7 +1,313 @@
-typedef unsigned int GLenum;
-typedef unsigned int GLuint;
-typedef int GLint;
-typedef int GLsizei;
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../../gl.h"
+
+/*
+ * Calls that change GL state or draw are not sent to JS one by one.
+ * They are appended to a command buffer of 32-bit words, [opcode]
+ * followed by the arguments, with floats stored as their bits and
+ * buffer, texture and uniform data copied inline, padded to a word.
+ * gl_flush() hands the whole buffer to gl_execute() in main.js, which
+ * replays it. Keep the opcodes and layouts in sync with it.
+ *
+ * Creating objects, compiling shaders and querying locations still
+ * call into JS directly. Those never depend on the bound state, so
+ * they do not need to flush first.
+ */
+
+enum {
+	CMD_ACTIVE_TEXTURE = 1,
+	CMD_BIND_BUFFER,
+	CMD_BIND_TEXTURE,
+	CMD_BUFFER_DATA,
+	CMD_BUFFER_SUB_DATA,
+	CMD_CLEAR,
+	CMD_CLEAR_COLOR,
+	CMD_DISABLE_VERTEX_ATTRIB_ARRAY,
+	CMD_DRAW_ARRAYS,
+	CMD_DRAW_ELEMENTS,
+	CMD_DRAW_ELEMENTS_INSTANCED,
+	CMD_ENABLE_VERTEX_ATTRIB_ARRAY,
+	CMD_TEX_IMAGE_2D,
+	CMD_TEX_PARAMETER_I,
+	CMD_UNIFORM_1I,
+	CMD_UNIFORM_2F,
+	CMD_UNIFORM_3F,
+	CMD_UNIFORM_3FV,
+	CMD_USE_PROGRAM,
+	CMD_VERTEX_ATTRIB_DIVISOR,
+	CMD_VERTEX_ATTRIB_POINTER,
+	CMD_VIEWPORT,
+};
+
+#define CMD_BUF_MIN_WORDS 16384
+
+static uint32_t *cmd_buf;
+static size_t cmd_len;
+static size_t cmd_cap;
+
+void gl_execute(uint32_t *cmds, size_t len);
+
+void gl_flush(void)
+{
+	if (!cmd_len)
+		return;
+
+	gl_execute(cmd_buf, cmd_len);
+	cmd_len = 0;
+}
+
+/* Make room for n more words and return where they go. */
+static uint32_t *cmd_reserve(size_t n)
+{
+	uint32_t *res;
+
+	if (cmd_len + n > cmd_cap) {
+		gl_flush();
+		if (n > cmd_cap) {
+			free(cmd_buf);
+			cmd_cap = n > CMD_BUF_MIN_WORDS ? n : CMD_BUF_MIN_WORDS;
+			cmd_buf = malloc(cmd_cap * sizeof(uint32_t));
+		}
+	}
+
+	res = cmd_buf + cmd_len;
+	cmd_len += n;
+
+	return res;
+}
+
+static size_t words(size_t bytes)
+{
+	return (bytes + 3) / 4;
+}
+
+static uint32_t float_bits(float f)
+{
+	uint32_t u;
+
+	memcpy(&u, &f, sizeof(u));
+
+	return u;
+}
+
+static void cmd1(uint32_t op, uint32_t a)
+{
+	uint32_t *c = cmd_reserve(2);
+
+	c[0] = op;
+	c[1] = a;
+}
+
+static void cmd2(uint32_t op, uint32_t a, uint32_t b)
+{
+	uint32_t *c = cmd_reserve(3);
+
+	c[0] = op;
+	c[1] = a;
+	c[2] = b;
+}
+
+static void cmd3(uint32_t op, uint32_t a, uint32_t b, uint32_t d)
+{
+	uint32_t *c = cmd_reserve(4);
+
+	c[0] = op;
+	c[1] = a;
+	c[2] = b;
+	c[3] = d;
+}
+
+static void cmd4(uint32_t op, uint32_t a, uint32_t b, uint32_t d, uint32_t e)
+{
+	uint32_t *c = cmd_reserve(5);
+
+	c[0] = op;
+	c[1] = a;
+	c[2] = b;
+	c[3] = d;
+	c[4] = e;
+}
+
+void glActiveTexture(GLenum texture)
+{
+	cmd1(CMD_ACTIVE_TEXTURE, texture);
+}
+
+void glBindBuffer(GLenum target, GLuint buffer)
+{
+	cmd2(CMD_BIND_BUFFER, target, buffer);
+}
+
+void glBindTexture(GLenum target, GLuint texture)
+{
+	cmd2(CMD_BIND_TEXTURE, target, texture);
+}
+
+/* [target][size][usage][has data][data...] */
+void glBufferData(GLenum target, GLsizeiptr size, const void *data, GLenum usage)
+{
+	size_t n = data ? words(size) : 0;
+	uint32_t *c = cmd_reserve(5 + n);
+
+	c[0] = CMD_BUFFER_DATA;
+	c[1] = target;
+	c[2] = size;
+	c[3] = usage;
+	c[4] = data != NULL;
+	if (data)
+		memcpy(c + 5, data, size);
+}
+
+/* [target][offset][size][data...] */
+void glBufferSubData(GLenum target, GLintptr offset, GLsizeiptr size, const void *data)
+{
+	uint32_t *c = cmd_reserve(4 + words(size));
+
+	c[0] = CMD_BUFFER_SUB_DATA;
+	c[1] = target;
+	c[2] = offset;
+	c[3] = size;
+	memcpy(c + 4, data, size);
+}
+
+void glClear(GLbitfield mask)
+{
+	cmd1(CMD_CLEAR, mask);
+}
+
+void glClearColor(GLfloat red, GLfloat green, GLfloat blue, GLfloat alpha)
+{
+	cmd4(CMD_CLEAR_COLOR, float_bits(red), float_bits(green),
+	     float_bits(blue), float_bits(alpha));
+}
+
+void glDisableVertexAttribArray(GLuint index)
+{
+	cmd1(CMD_DISABLE_VERTEX_ATTRIB_ARRAY, index);
+}
+
+void glDrawArrays(GLenum mode, GLint first, GLsizei count)
+{
+	cmd3(CMD_DRAW_ARRAYS, mode, first, count);
+}
+
+void glDrawElements(GLenum mode, GLsizei count, GLenum type, const void *indices)
+{
+	cmd4(CMD_DRAW_ELEMENTS, mode, count, type, (uintptr_t)indices);
+}
+
+void glDrawElementsInstancedANGLE(GLenum mode, GLsizei count, GLenum type, const void *indices, GLsizei primcount)
+{
+	uint32_t *c = cmd_reserve(6);
+
+	c[0] = CMD_DRAW_ELEMENTS_INSTANCED;
+	c[1] = mode;
+	c[2] = count;
+	c[3] = type;
+	c[4] = (uintptr_t)indices;
+	c[5] = primcount;
+}
+
+void glEnableVertexAttribArray(GLuint index)
+{
+	cmd1(CMD_ENABLE_VERTEX_ATTRIB_ARRAY, index);
+}
+
+static size_t pixel_size(GLenum format)
+{
+	switch (format) {
+	case GL_LUMINANCE_ALPHA:
+		return 2;
+	case GL_RGB:
+		return 3;
+	case GL_RGBA:
+		return 4;
+	default:
+		return 1;
+	}
+}
+
+/* [target][level][internalformat][width][height][format][type][size][data...] */
+void glTexImage2D(GLenum target, GLint level, GLint internalformat, GLsizei width, GLsizei height, GLint border, GLenum format, GLenum type, const void *pixels)
+{
+	/* Only unsigned byte pixels with the default unpack alignment are used. */
+	size_t size = pixels ? (size_t)width * height * pixel_size(format) : 0;
+	uint32_t *c = cmd_reserve(9 + words(size));
+
+	c[0] = CMD_TEX_IMAGE_2D;
+	c[1] = target;
+	c[2] = level;
+	c[3] = internalformat;
+	c[4] = width;
+	c[5] = height;
+	c[6] = format;
+	c[7] = type;
+	c[8] = size;
+	if (pixels)
+		memcpy(c + 9, pixels, size);
+}
+
+void glTexParameteri(GLenum target, GLenum pname, GLint param)
+{
+	cmd3(CMD_TEX_PARAMETER_I, target, pname, param);
+}
+
+void glUniform1i(GLint location, GLint v0)
+{
+	cmd2(CMD_UNIFORM_1I, location, v0);
+}
+
+void glUniform2f(GLint location, GLfloat v0, GLfloat v1)
+{
+	cmd3(CMD_UNIFORM_2F, location, float_bits(v0), float_bits(v1));
+}
+
+void glUniform3f(GLint location, GLfloat v0, GLfloat v1, GLfloat v2)
+{
+	cmd4(CMD_UNIFORM_3F, location, float_bits(v0), float_bits(v1), float_bits(v2));
+}
+
+/* [location][count][values...] */
+void glUniform3fv(GLint location, GLsizei count, const GLfloat *value)
+{
+	uint32_t *c = cmd_reserve(3 + count * 3);
+
+	c[0] = CMD_UNIFORM_3FV;
+	c[1] = location;
+	c[2] = count;
+	memcpy(c + 3, value, count * 3 * sizeof(GLfloat));
+}
+
+void glUseProgram(GLuint program)
+{
+	cmd1(CMD_USE_PROGRAM, program);
+}
+
+void glVertexAttribDivisorANGLE(GLuint index, GLuint divisor)
+{
+	cmd2(CMD_VERTEX_ATTRIB_DIVISOR, index, divisor);
+}
+
+void glVertexAttribPointer(GLuint index, GLint size, GLenum type, GLboolean normalized, GLsizei stride, const void *pointer)
+{
+	uint32_t *c = cmd_reserve(7);
+
+	c[0] = CMD_VERTEX_ATTRIB_POINTER;
+	c[1] = index;
+	c[2] = size;
+	c[3] = type;
+	c[4] = normalized;
+	c[5] = stride;
+	c[6] = (uintptr_t)pointer;
+}
+
+void glViewport(GLint x, GLint y, GLsizei width, GLsizei height)
+{
+	cmd4(CMD_VIEWPORT, x, y, width, height);
+}
 
 GLuint glCreateBuffer(void);
 
@@ -0,0 +1,43 @@
+/*
+ * In fcsim-mt.wasm the timer callbacks run on a worker sharing this
+ * memory (see worker.js). Like the mutex in the native main.c, this lock
+ * is held around every call into the arena except draw(). main.js takes
+ * it around the event handlers, worker.js around the timer callbacks.
+ *
+ * The main thread of a page may not block, so this spins. Without the
+ * atomics feature the compiler lowers these to plain loads and stores.
+ */
+
+static int arena_lock;
+
+/* Threads spinning in lock_arena(), see yield_arena(). */
+static int arena_waiters;
+
+void lock_arena(void)
+{
+	__atomic_add_fetch(&arena_waiters, 1, __ATOMIC_RELAXED);
+	while (__atomic_exchange_n(&arena_lock, 1, __ATOMIC_ACQUIRE))
+		;
+	__atomic_sub_fetch(&arena_waiters, 1, __ATOMIC_RELAXED);
+}
+
+void unlock_arena(void)
+{
+	__atomic_store_n(&arena_lock, 0, __ATOMIC_RELEASE);
+}
+
+/*
+ * Hands the lock to a waiting thread and takes it back once that one is
+ * done, so that a long timer callback does not keep the page spinning.
+ * A plain unlock and lock would almost always win the lock right back.
+ */
+void yield_arena(void)
+{
+	if (!__atomic_load_n(&arena_waiters, __ATOMIC_RELAXED))
+		return;
+
+	unlock_arena();
+	while (__atomic_load_n(&arena_waiters, __ATOMIC_RELAXED))
+		;
+	lock_arena();
+}
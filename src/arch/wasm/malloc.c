@@ -1,104 +1,305 @@
 #include <stddef.h>
+#include <stdint.h>
 #include <string.h>
 
-#define _mem_alignment 4
-#define _size_t_bytes sizeof(size_t)
-#define _mem_flag_used 0xbf82583a
-#define _mem_flag_free 0xab34d705
+/*
+ * Boundary-tag allocator with segregated free lists.
+ *
+ * A block is [size][magic][payload...][size]. size is the whole block
+ * including both tags, a multiple of 8, so payloads are 8-byte aligned.
+ * The trailing size lets free() find and merge the previous block. Free
+ * blocks keep next/prev list pointers in their payload.
+ *
+ * Small blocks have one exact-size list per 8 bytes, larger ones one
+ * list per power of two. Freed blocks merge with free neighbours, and
+ * free space at the end of the heap is kept as untracked wilderness
+ * that new blocks are carved from before memory is grown.
+ *
+ * fcsim-mt.wasm calls in here from the main thread and the simulation
+ * worker at once, so every entry point holds heap_lock.
+ */
+
+#define ALIGN 8
+
+#define MAGIC_USED 0xbf82583a
+#define MAGIC_FREE 0xab34d705
+
+#define SMALL_LIMIT 512
+#define SMALL_CLASSES (SMALL_LIMIT / ALIGN)
+#define LARGE_CLASSES 24
+#define CLASS_CNT (SMALL_CLASSES + LARGE_CLASSES)
+
+#define PAGE_SIZE 65536
+
+struct free_block {
+	size_t size;
+	size_t magic;
+	struct free_block *next;
+	struct free_block *prev;
+};
+
+#define HEADER_SIZE (2 * sizeof(size_t))
+#define FOOTER_SIZE sizeof(size_t)
+#define MIN_BLOCK ((sizeof(struct free_block) + FOOTER_SIZE + ALIGN - 1) & ~(size_t)(ALIGN - 1))
+
+/* Read from JS through heap_stats(), keep the field order. */
+struct heap_stats {
+	size_t memory_size;
+	size_t heap_size;
+	size_t used_bytes;
+	size_t free_bytes;
+	size_t peak_used_bytes;
+	size_t used_blocks;
+	size_t free_blocks;
+	size_t alloc_cnt;
+	size_t free_cnt;
+	size_t grow_cnt;
+};
 
 extern unsigned char __heap_base;
-size_t __heap_tail = (size_t)&__heap_base;
-size_t __heap_mark = (size_t)&__heap_base;
 
-size_t memory_size(void) {
-  return __builtin_wasm_memory_size(0);
+static size_t heap_start;
+static size_t heap_end;
+static struct free_block *lists[CLASS_CNT];
+static struct heap_stats stats;
+static int heap_lock;
+
+static void lock_heap(void)
+{
+	while (__atomic_exchange_n(&heap_lock, 1, __ATOMIC_ACQUIRE))
+		;
 }
 
-size_t memory_grow(int delta) {
-    return __builtin_wasm_memory_grow(0, delta);
+static void unlock_heap(void)
+{
+	__atomic_store_n(&heap_lock, 0, __ATOMIC_RELEASE);
 }
 
-void free_all() {
-  __heap_tail = __heap_mark;
+static size_t memory_size(void)
+{
+	return __builtin_wasm_memory_size(0) * PAGE_SIZE;
 }
 
-void free_all_mark() {
-  __heap_mark = __heap_tail;
+static int size_class(size_t size)
+{
+	int c;
+
+	if (size < SMALL_LIMIT)
+		return size / ALIGN;
+
+	c = SMALL_CLASSES;
+	size /= SMALL_LIMIT;
+	while (size > 1 && c < CLASS_CNT - 1) {
+		size >>= 1;
+		c++;
+	}
+
+	return c;
 }
 
-void* free_get_mark() {
-  return (void *)__heap_tail;
+static void set_tags(size_t block, size_t size, size_t magic)
+{
+	struct free_block *b = (struct free_block *)block;
+
+	b->size = size;
+	b->magic = magic;
+	*(size_t *)(block + size - FOOTER_SIZE) = size;
 }
 
-void free_to_mark(void *mark) {
-  __heap_tail = (size_t)mark;
+static void list_insert(struct free_block *b)
+{
+	int c = size_class(b->size);
+
+	b->prev = NULL;
+	b->next = lists[c];
+	if (lists[c])
+		lists[c]->prev = b;
+	lists[c] = b;
+
+	stats.free_blocks++;
+	stats.free_bytes += b->size;
+}
+
+static void list_remove(struct free_block *b)
+{
+	if (b->prev)
+		b->prev->next = b->next;
+	else
+		lists[size_class(b->size)] = b->next;
+	if (b->next)
+		b->next->prev = b->prev;
+
+	stats.free_blocks--;
+	stats.free_bytes -= b->size;
 }
 
+static struct free_block *find_free(size_t size)
+{
+	struct free_block *b;
+	int c;
+
+	for (c = size_class(size); c < CLASS_CNT; c++) {
+		for (b = lists[c]; b; b = b->next) {
+			if (b->size >= size)
+				return b;
+		}
+	}
+
+	return NULL;
+}
 
-void* malloc(size_t n) {
-  // size is marked at both ends to construct a pointer of previous block
-  // [4b:size][4b:flag][n:allocated][4b:size]
-
-  n += (8 - (n % _mem_alignment)) % _mem_alignment;
-  // check if size is enough
-  size_t total = __heap_tail + n + 3*_size_t_bytes;
-  size_t size = memory_size()<<16;
-  if (total > size) {
-    memory_grow( (total>>16)-(size>>16)+1 );
-  }
-  unsigned int r = __heap_tail;
-  *((size_t *)r)=n;
-  r+= _size_t_bytes;
-  *((size_t *)r)=_mem_flag_used;
-  r+= _size_t_bytes;
-  __heap_tail = r + n;
-  *((size_t *)__heap_tail) = n;
-  __heap_tail += _size_t_bytes;
-  
-  return (void *)r;
+static void init_heap(void)
+{
+	heap_start = ((size_t)&__heap_base + ALIGN - 1) & ~(size_t)(ALIGN - 1);
+	heap_end = heap_start;
+}
+
+static int grow_heap(size_t size)
+{
+	size_t need = heap_end + size;
+	size_t have = memory_size();
+
+	if (need > have) {
+		if (__builtin_wasm_memory_grow(0, (need - have + PAGE_SIZE - 1) / PAGE_SIZE) == (size_t)-1)
+			return -1;
+		stats.grow_cnt++;
+	}
+
+	heap_end += size;
+
+	return 0;
+}
+
+/* Give the tail of a block back if it is big enough to be a block. */
+static void split(size_t block, size_t size)
+{
+	size_t rest = ((struct free_block *)block)->size - size;
+
+	if (rest < MIN_BLOCK)
+		return;
+
+	set_tags(block, size, MAGIC_USED);
+	set_tags(block + size, rest, MAGIC_FREE);
+	list_insert((struct free_block *)(block + size));
+}
+
+void *malloc(size_t n)
+{
+	struct free_block *b;
+	size_t size;
+	size_t block;
+
+	lock_heap();
+
+	if (!heap_start)
+		init_heap();
+
+	size = (n + HEADER_SIZE + FOOTER_SIZE + ALIGN - 1) & ~(size_t)(ALIGN - 1);
+	if (size < MIN_BLOCK)
+		size = MIN_BLOCK;
+
+	b = find_free(size);
+	if (b) {
+		list_remove(b);
+		block = (size_t)b;
+		set_tags(block, b->size, MAGIC_USED);
+		split(block, size);
+	} else {
+		/* free() never leaves a free block at the end of the heap. */
+		block = heap_end;
+		if (grow_heap(size)) {
+			unlock_heap();
+			return NULL;
+		}
+		set_tags(block, size, MAGIC_USED);
+	}
+
+	size = ((struct free_block *)block)->size;
+	stats.alloc_cnt++;
+	stats.used_blocks++;
+	stats.used_bytes += size;
+	if (stats.used_bytes > stats.peak_used_bytes)
+		stats.peak_used_bytes = stats.used_bytes;
+
+	unlock_heap();
+
+	return (void *)(block + HEADER_SIZE);
 }
 
 void *calloc(size_t nmemb, size_t size)
 {
 	void *mem = malloc(nmemb * size);
-	memset(mem, 0, nmemb * size);
+
+	if (mem)
+		memset(mem, 0, nmemb * size);
 
 	return mem;
 }
 
-void free(void* p) {
-  
-  size_t n;
-  // null case
-  if (!p) return;
-  size_t r=(size_t)p;
-  r-=_size_t_bytes;
-  // already free
-  if (*((size_t *)r) != _mem_flag_used) {
-    return;
-  }
-  // mark it as free
-  size_t flag = _mem_flag_free;
-  *((size_t *)r) = flag;
-  // calc ptr_tail
-  r-=_size_t_bytes;
-  n = *(size_t *)r; // size of current block
-  size_t ptr_tail = ((size_t)p)+n+_size_t_bytes;
-  // if not at tail return without moving __heap_tail
-  if (__heap_tail != ptr_tail) {
-    return;
-  }
-  __heap_tail = r;
-  while(r > (size_t)&__heap_base) {
-    r-=_size_t_bytes;
-    n = *(size_t *)r; // size of previous block
-    r-=n;
-    r-=_size_t_bytes;
-    flag = *((size_t *)r);
-    if (flag != _mem_flag_free) break;
-    r-=_size_t_bytes;
-    n = *(size_t *)r; // size of current block
-    __heap_tail = r;
-  }
+void free(void *p)
+{
+	struct free_block *b;
+	struct free_block *next;
+	struct free_block *prev;
+	size_t block;
+	size_t size;
+
+	if (!p)
+		return;
+
+	lock_heap();
+
+	block = (size_t)p - HEADER_SIZE;
+	b = (struct free_block *)block;
+	/* Double frees and foreign pointers are ignored. */
+	if (b->magic != MAGIC_USED) {
+		unlock_heap();
+		return;
+	}
+
+	size = b->size;
+	stats.free_cnt++;
+	stats.used_blocks--;
+	stats.used_bytes -= size;
+
+	if (block + size < heap_end) {
+		next = (struct free_block *)(block + size);
+		if (next->magic == MAGIC_FREE) {
+			list_remove(next);
+			size += next->size;
+		}
+	}
+
+	if (block > heap_start) {
+		prev = (struct free_block *)(block - *(size_t *)(block - FOOTER_SIZE));
+		if (prev->magic == MAGIC_FREE) {
+			list_remove(prev);
+			block = (size_t)prev;
+			size += prev->size;
+		}
+	}
+
+	b->magic = 0;
+
+	if (block + size == heap_end) {
+		heap_end = block;
+		unlock_heap();
+		return;
+	}
+
+	set_tags(block, size, MAGIC_FREE);
+	list_insert((struct free_block *)block);
+
+	unlock_heap();
+}
+
+/* Called from JS, see heap_stats() in main.js. */
+struct heap_stats *get_heap_stats(void)
+{
+	lock_heap();
+	stats.memory_size = memory_size();
+	stats.heap_size = heap_end - heap_start;
+	unlock_heap();
 
+	return &stats;
 }
@@ -5,16 +5,23 @@
 #include <box2d/b2Body.h>
 #include <box2d/b2World.h>
 #include <box2d/b2CMath.h>
+#include <box2d/b2Timer.h>
 
 #include "gl.h"
 #include "xml.h"
 #include "interval.h"
 #include "graph.h"
 #include "text.h"
+#include "grid.h"
 #include "arena.h"
+#include "trace.h"
 
 #define TAU 6.28318530718
 
+#define FRAME_MS 17
+#define FAST_FORWARD_TICKS 10
+#define MAX_SPEED_BUDGET_MS 12.0
+
 const char *block_vertex_shader_src =
 	"attribute vec2 a_coords;"
 	"attribute vec3 a_color;"
@@ -41,6 +48,34 @@ GLuint block_program_color_attrib;
 GLuint block_program_scale_uniform;
 GLuint block_program_shift_uniform;
 
+/* u_palette has BLOCK_PALETTE_SIZE entries. */
+const char *instanced_vertex_shader_src =
+	"attribute vec2 a_coords;"
+	"attribute vec3 a_transform;"
+	"attribute vec2 a_size;"
+	"attribute float a_color;"
+	"varying vec3 v_color;"
+	"uniform vec2 u_scale;"
+	"uniform vec2 u_shift;"
+	"uniform vec3 u_palette[32];"
+	"void main() {"
+		"vec2 p = a_coords * a_size;"
+		"float c = cos(a_transform.z);"
+		"float s = sin(a_transform.z);"
+		"vec2 world = vec2(p.x * c - p.y * s, p.x * s + p.y * c) + a_transform.xy;"
+		"gl_Position = vec4(world * u_scale + u_shift, 0.0, 1.0);"
+		"v_color = u_palette[int(a_color)];"
+	"}";
+
+GLuint instanced_program;
+GLuint instanced_program_coord_attrib;
+GLuint instanced_program_transform_attrib;
+GLuint instanced_program_size_attrib;
+GLuint instanced_program_color_attrib;
+GLuint instanced_program_scale_uniform;
+GLuint instanced_program_shift_uniform;
+GLuint instanced_program_palette_uniform;
+
 const char *joint_vertex_shader_src =
 	"attribute vec2 a_coords;"
 	"void main() {"
@@ -80,23 +115,37 @@ void world_to_view(struct view *view, float x, float y, float *x_view, float *y_
 	*y_view = (view->y - y) / (view->height * view->scale);
 }
 
-static void block_graphics_add_area(struct block_graphics *graphics,
-				    struct area *area, struct color *color)
+/* Indices and colors of a convex polygon starting at the next vertex. */
+static void block_graphics_add_fan(struct block_graphics *graphics,
+				   int vertex_cnt, struct color *color)
 {
-	float w_half = area->w / 2;
-	float h_half = area->h / 2;
-	int i;
-
 	unsigned short *indices = graphics->indices + (graphics->triangle_cnt * 3);
-	float *coords = graphics->coords + (graphics->vertex_cnt * 2);
 	float *colors = graphics->colors + (graphics->vertex_cnt * 3);
+	int i;
 
-	for (i = 0; i < 2; i++) {
+	for (i = 0; i < vertex_cnt - 2; i++) {
 		*indices++ = graphics->vertex_cnt;
 		*indices++ = graphics->vertex_cnt + i + 1;
 		*indices++ = graphics->vertex_cnt + i + 2;
 	}
 
+	for (i = 0; i < vertex_cnt; i++) {
+		*colors++ = color->r;
+		*colors++ = color->g;
+		*colors++ = color->b;
+	}
+}
+
+static void block_graphics_add_area(struct block_graphics *graphics,
+				    struct area *area, struct color *color)
+{
+	float w_half = area->w / 2;
+	float h_half = area->h / 2;
+	float *coords = graphics->coords + (graphics->vertex_cnt * 2);
+
+	if (graphics->dirty)
+		block_graphics_add_fan(graphics, 4, color);
+
 	*coords++ = area->x + w_half;
 	*coords++ = area->y + h_half;
 	*coords++ = area->x + w_half;
@@ -106,12 +155,6 @@ static void block_graphics_add_area(struct block_graphics *graphics,
 	*coords++ = area->x - w_half;
 	*coords++ = area->y + h_half;
 
-	for (i = 0; i < 4; i++) {
-		*colors++ = color->r;
-		*colors++ = color->g;
-		*colors++ = color->b;
-	}
-
 	graphics->triangle_cnt += 2;
 	graphics->vertex_cnt += 4;
 }
@@ -127,17 +170,10 @@ static void block_graphics_add_rect(struct block_graphics *graphics,
 	float ws = w * sina_half;
 	float hc = h * cosa_half;
 	float hs = h * sina_half;
-	int i;
-
-	unsigned short *indices = graphics->indices + (graphics->triangle_cnt * 3);
 	float *coords = graphics->coords + (graphics->vertex_cnt * 2);
-	float *colors = graphics->colors + (graphics->vertex_cnt * 3);
 
-	for (i = 0; i < 2; i++) {
-		*indices++ = graphics->vertex_cnt;
-		*indices++ = graphics->vertex_cnt + i + 1;
-		*indices++ = graphics->vertex_cnt + i + 2;
-	}
+	if (graphics->dirty)
+		block_graphics_add_fan(graphics, 4, color);
 
 	*coords++ = shell->x + wc - hs;
 	*coords++ = shell->y + ws + hc;
@@ -148,12 +184,6 @@ static void block_graphics_add_rect(struct block_graphics *graphics,
 	*coords++ = shell->x + wc + hs;
 	*coords++ = shell->y + ws - hc;
 
-	for (i = 0; i < 4; i++) {
-		*colors++ = color->r;
-		*colors++ = color->g;
-		*colors++ = color->b;
-	}
-
 	graphics->triangle_cnt += 2;
 	graphics->vertex_cnt += 4;
 }
@@ -163,60 +193,58 @@ static void block_graphics_add_rect(struct block_graphics *graphics,
 static void block_graphics_add_circ(struct block_graphics *graphics,
 				    struct shell *shell, struct color *color)
 {
-	unsigned short *indices = graphics->indices + (graphics->triangle_cnt * 3);
 	float *coords = graphics->coords + (graphics->vertex_cnt * 2);
-	float *colors = graphics->colors + (graphics->vertex_cnt * 3);
 	float a;
 	int i;
 
-	for (i = 0; i < CIRCLE_SEGMENTS - 2; i++) {
-		*indices++ = graphics->vertex_cnt;
-		*indices++ = graphics->vertex_cnt + i + 1;
-		*indices++ = graphics->vertex_cnt + i + 2;
-	}
+	if (graphics->dirty)
+		block_graphics_add_fan(graphics, CIRCLE_SEGMENTS, color);
 
-	for (int i = 0; i < CIRCLE_SEGMENTS; i++) {
+	for (i = 0; i < CIRCLE_SEGMENTS; i++) {
 		a = shell->angle + TAU * i / CIRCLE_SEGMENTS;
 		*coords++ = shell->x + cosf(a) * shell->circ.radius;
 		*coords++ = shell->y + sinf(a) * shell->circ.radius;
 	}
 
-	for (i = 0; i < CIRCLE_SEGMENTS; i++) {
-		*colors++ = color->r;
-		*colors++ = color->g;
-		*colors++ = color->b;
-	}
-
 	graphics->triangle_cnt += CIRCLE_SEGMENTS - 2;
 	graphics->vertex_cnt += CIRCLE_SEGMENTS;
 }
 
-static void block_graphics_add_block(struct block_graphics *graphics,
-				     struct block *block)
+/* The position of a block comes from the transform snapshot. */
+static void get_block_shell(struct shell *shell, struct block *block,
+			    const float *xform)
 {
-	struct shell shell;
-	struct color color;
-
-	get_shell(&shell, &block->shape);
-	if (block->body) {
-		shell.x = block->body->m_position.x;
-		shell.y = block->body->m_position.y;
-		shell.angle = block->body->m_rotation;
-	}
+	get_shell(shell, &block->shape);
+	shell->x = xform[0];
+	shell->y = xform[1];
+	shell->angle = xform[2];
+}
 
+static void get_block_color(struct color *color, struct block *block)
+{
 	if (block->overlap) {
-		color.r = 1.0f;
-		color.g = 0.0f;
-		color.b = 0.0f;
+		color->r = 1.0f;
+		color->g = 0.0f;
+		color->b = 0.0f;
 	} else if (block->visited) {
-		color.r = block->r + (1.0f - block->r) * 0.25f;
-		color.g = block->g + (1.0f - block->g) * 0.25f;
-		color.b = block->b + (1.0f - block->b) * 0.25f;
+		color->r = block->r + (1.0f - block->r) * 0.25f;
+		color->g = block->g + (1.0f - block->g) * 0.25f;
+		color->b = block->b + (1.0f - block->b) * 0.25f;
 	} else {
-		color.r = block->r;
-		color.g = block->g;
-		color.b = block->b;
+		color->r = block->r;
+		color->g = block->g;
+		color->b = block->b;
 	}
+}
+
+static void block_graphics_add_block(struct block_graphics *graphics,
+				     struct block *block, const float *xform)
+{
+	struct shell shell;
+	struct color color;
+
+	get_block_shell(&shell, block, xform);
+	get_block_color(&color, block);
 
 	if (shell.type == SHELL_CIRC)
 		block_graphics_add_circ(graphics, &shell, &color);
@@ -252,28 +280,331 @@ void get_mesh_cnts(struct design *design, int *vertex_cnt, int *triangle_cnt)
 		add_block_mesh_cnts(block, vertex_cnt, triangle_cnt);
 }
 
-void block_graphics_reset(struct block_graphics *graphics, struct design *design)
+enum {
+	MESH_RECT,
+	MESH_CIRC,
+};
+
+#define INSTANCE_FLOATS 6
+
+/* Index into the palette, or -1 if it is full. */
+static int block_graphics_palette_index(struct block_graphics *graphics,
+					struct color *color)
+{
+	float *entry;
+	int i;
+
+	for (i = 0; i < graphics->palette_cnt; i++) {
+		entry = &graphics->palette[i * 3];
+		if (entry[0] == color->r && entry[1] == color->g && entry[2] == color->b)
+			return i;
+	}
+
+	if (graphics->palette_cnt == BLOCK_PALETTE_SIZE)
+		return -1;
+
+	entry = &graphics->palette[graphics->palette_cnt * 3];
+	entry[0] = color->r;
+	entry[1] = color->g;
+	entry[2] = color->b;
+
+	return graphics->palette_cnt++;
+}
+
+static bool block_graphics_add_instance(struct block_graphics *graphics,
+					int mesh, float x, float y, float angle,
+					float w, float h, struct color *color)
+{
+	float *inst = graphics->instances + graphics->instance_cnt * INSTANCE_FLOATS;
+	struct block_run *run;
+	int index;
+
+	inst[0] = x;
+	inst[1] = y;
+	inst[2] = angle;
+	inst[3] = w;
+	inst[4] = h;
+
+	if (graphics->dirty) {
+		index = block_graphics_palette_index(graphics, color);
+		if (index < 0)
+			return false;
+		inst[5] = index;
+
+		run = graphics->run_cnt ? &graphics->runs[graphics->run_cnt - 1] : NULL;
+		if (!run || run->mesh != mesh) {
+			run = &graphics->runs[graphics->run_cnt++];
+			run->mesh = mesh;
+			run->first = graphics->instance_cnt;
+			run->cnt = 0;
+		}
+		run->cnt++;
+	}
+
+	graphics->instance_cnt++;
+
+	return true;
+}
+
+static bool block_graphics_add_block_instance(struct block_graphics *graphics,
+					      struct block *block, const float *xform)
+{
+	struct shell shell;
+	struct color color;
+
+	get_block_shell(&shell, block, xform);
+	get_block_color(&color, block);
+
+	if (shell.type == SHELL_CIRC) {
+		return block_graphics_add_instance(graphics, MESH_CIRC,
+						   shell.x, shell.y, shell.angle,
+						   shell.circ.radius, shell.circ.radius,
+						   &color);
+	}
+
+	return block_graphics_add_instance(graphics, MESH_RECT,
+					   shell.x, shell.y, shell.angle,
+					   fmaxf(fabsf(shell.rect.w), 4.0),
+					   fmaxf(fabsf(shell.rect.h), 4.0),
+					   &color);
+}
+
+static bool block_graphics_add_area_instance(struct block_graphics *graphics,
+					     struct area *area, struct color *color)
+{
+	return block_graphics_add_instance(graphics, MESH_RECT,
+					   area->x, area->y, 0.0f,
+					   area->w, area->h, color);
+}
+
+static bool block_graphics_fill_instances(struct block_graphics *graphics,
+					  struct design *design, const float *xform)
+{
+	struct block *block;
+
+	graphics->instance_cnt = 0;
+	if (graphics->dirty) {
+		graphics->run_cnt = 0;
+		graphics->palette_cnt = 0;
+	}
+
+	if (!block_graphics_add_area_instance(graphics, &design->build_area, &build_color))
+		return false;
+	if (!block_graphics_add_area_instance(graphics, &design->goal_area, &goal_color))
+		return false;
+
+	for (block = design->level_blocks.head; block; block = block->next) {
+		if (!block_graphics_add_block_instance(graphics, block, xform))
+			return false;
+		xform += 3;
+	}
+
+	for (block = design->player_blocks.head; block; block = block->next) {
+		if (!block_graphics_add_block_instance(graphics, block, xform))
+			return false;
+		xform += 3;
+	}
+
+	return true;
+}
+
+static void block_graphics_update_instanced(struct block_graphics *graphics,
+					    struct design *design, const float *xforms)
+{
+	struct block *block;
+	int cnt;
+
+	if (graphics->dirty) {
+		cnt = 2;
+		for (block = design->level_blocks.head; block; block = block->next)
+			cnt++;
+		for (block = design->player_blocks.head; block; block = block->next)
+			cnt++;
+
+		if (cnt > graphics->instance_cap) {
+			graphics->instance_cap = cnt * 2;
+			free(graphics->instances);
+			free(graphics->runs);
+			graphics->instances = malloc(graphics->instance_cap *
+						     INSTANCE_FLOATS * sizeof(float));
+			graphics->runs = malloc(graphics->instance_cap *
+						sizeof(struct block_run));
+		}
+	}
+
+	if (!block_graphics_fill_instances(graphics, design, xforms)) {
+		/* More colors than the shader can index, draw the old way. */
+		graphics->instanced = false;
+		graphics->dirty = true;
+		return;
+	}
+
+	glBindBuffer(GL_ARRAY_BUFFER, graphics->instance_buffer);
+	if (graphics->dirty) {
+		glBufferData(GL_ARRAY_BUFFER,
+			     graphics->instance_cnt * INSTANCE_FLOATS * sizeof(float),
+			     graphics->instances, GL_DYNAMIC_DRAW);
+	} else {
+		glBufferSubData(GL_ARRAY_BUFFER, 0,
+				graphics->instance_cnt * INSTANCE_FLOATS * sizeof(float),
+				graphics->instances);
+	}
+}
+
+static void block_graphics_init_meshes(struct block_graphics *graphics)
+{
+	float coords[(4 + CIRCLE_SEGMENTS) * 2];
+	unsigned short indices[(2 + CIRCLE_SEGMENTS - 2) * 3];
+	float *coord = coords;
+	unsigned short *index = indices;
+	float a;
+	int i;
+
+	*coord++ =  0.5f; *coord++ =  0.5f;
+	*coord++ = -0.5f; *coord++ =  0.5f;
+	*coord++ = -0.5f; *coord++ = -0.5f;
+	*coord++ =  0.5f; *coord++ = -0.5f;
+
+	for (i = 0; i < CIRCLE_SEGMENTS; i++) {
+		a = TAU * i / CIRCLE_SEGMENTS;
+		*coord++ = cosf(a);
+		*coord++ = sinf(a);
+	}
+
+	for (i = 0; i < 2; i++) {
+		*index++ = 0;
+		*index++ = i + 1;
+		*index++ = i + 2;
+	}
+
+	for (i = 0; i < CIRCLE_SEGMENTS - 2; i++) {
+		*index++ = 4;
+		*index++ = 4 + i + 1;
+		*index++ = 4 + i + 2;
+	}
+
+	glGenBuffers(1, &graphics->mesh_coord_buffer);
+	glBindBuffer(GL_ARRAY_BUFFER, graphics->mesh_coord_buffer);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(coords), coords, GL_STATIC_DRAW);
+
+	glGenBuffers(1, &graphics->mesh_index_buffer);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, graphics->mesh_index_buffer);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
+
+	glGenBuffers(1, &graphics->instance_buffer);
+}
+
+static void block_graphics_draw_instanced(struct block_graphics *graphics,
+					  struct view *view)
+{
+	GLsizei stride = INSTANCE_FLOATS * sizeof(float);
+	struct block_run *run;
+	char *base;
+	int i;
+
+	glUseProgram(instanced_program);
+
+	glUniform2f(instanced_program_scale_uniform,
+		     1.0f / (view->width * view->scale),
+		    -1.0f / (view->height * view->scale));
+	glUniform2f(instanced_program_shift_uniform,
+		    -view->x / (view->width * view->scale),
+		     view->y / (view->height * view->scale));
+	glUniform3fv(instanced_program_palette_uniform,
+		     graphics->palette_cnt, graphics->palette);
+
+	glEnableVertexAttribArray(instanced_program_coord_attrib);
+	glEnableVertexAttribArray(instanced_program_transform_attrib);
+	glEnableVertexAttribArray(instanced_program_size_attrib);
+	glEnableVertexAttribArray(instanced_program_color_attrib);
+
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, graphics->mesh_index_buffer);
+	glBindBuffer(GL_ARRAY_BUFFER, graphics->mesh_coord_buffer);
+	glVertexAttribPointer(instanced_program_coord_attrib, 2, GL_FLOAT, GL_FALSE, 0, 0);
+
+	glVertexAttribDivisorANGLE(instanced_program_transform_attrib, 1);
+	glVertexAttribDivisorANGLE(instanced_program_size_attrib, 1);
+	glVertexAttribDivisorANGLE(instanced_program_color_attrib, 1);
+
+	glBindBuffer(GL_ARRAY_BUFFER, graphics->instance_buffer);
+	for (i = 0; i < graphics->run_cnt; i++) {
+		run = &graphics->runs[i];
+		base = (char *)0 + run->first * stride;
+
+		glVertexAttribPointer(instanced_program_transform_attrib, 3,
+				      GL_FLOAT, GL_FALSE, stride, base);
+		glVertexAttribPointer(instanced_program_size_attrib, 2,
+				      GL_FLOAT, GL_FALSE, stride, base + 3 * sizeof(float));
+		glVertexAttribPointer(instanced_program_color_attrib, 1,
+				      GL_FLOAT, GL_FALSE, stride, base + 5 * sizeof(float));
+
+		if (run->mesh == MESH_RECT) {
+			glDrawElementsInstancedANGLE(GL_TRIANGLES, 6, GL_UNSIGNED_SHORT,
+						     0, run->cnt);
+		} else {
+			glDrawElementsInstancedANGLE(GL_TRIANGLES, (CIRCLE_SEGMENTS - 2) * 3,
+						     GL_UNSIGNED_SHORT,
+						     (void *)(6 * sizeof(unsigned short)),
+						     run->cnt);
+		}
+	}
+
+	glVertexAttribDivisorANGLE(instanced_program_transform_attrib, 0);
+	glVertexAttribDivisorANGLE(instanced_program_size_attrib, 0);
+	glVertexAttribDivisorANGLE(instanced_program_color_attrib, 0);
+
+	glDisableVertexAttribArray(instanced_program_coord_attrib);
+	glDisableVertexAttribArray(instanced_program_transform_attrib);
+	glDisableVertexAttribArray(instanced_program_size_attrib);
+	glDisableVertexAttribArray(instanced_program_color_attrib);
+}
+
+static void block_graphics_reserve(struct block_graphics *graphics,
+				   int vertex_cnt, int triangle_cnt)
+{
+	if (vertex_cnt > graphics->vertex_cap) {
+		graphics->vertex_cap = vertex_cnt * 2;
+		free(graphics->coords);
+		free(graphics->colors);
+		graphics->coords = malloc(graphics->vertex_cap * 2 * sizeof(float));
+		graphics->colors = malloc(graphics->vertex_cap * 3 * sizeof(float));
+	}
+
+	if (triangle_cnt > graphics->triangle_cap) {
+		graphics->triangle_cap = triangle_cnt * 2;
+		free(graphics->indices);
+		graphics->indices = malloc(graphics->triangle_cap * 3 * sizeof(unsigned short));
+	}
+}
+
+void block_graphics_update(struct block_graphics *graphics, struct design *design,
+			   const float *xforms)
 {
+	struct trace_scope scope;
 	struct block *block;
+	const float *xform = xforms;
 	int vertex_cnt;
 	int triangle_cnt;
-	int indices_size;
-	int coords_size;
-	int colors_size;
 
-	get_mesh_cnts(design, &vertex_cnt, &triangle_cnt);
+	if (!graphics->dirty && !graphics->moved)
+		return;
 
-	indices_size = triangle_cnt * 3 * sizeof(unsigned short);
-	coords_size = vertex_cnt * 2 * sizeof(float);
-	colors_size = vertex_cnt * 3 * sizeof(float);
+	trace_begin(&scope, "block_graphics_update");
 
-	free(graphics->indices);
-	free(graphics->coords);
-	free(graphics->colors);
+	if (graphics->instanced) {
+		block_graphics_update_instanced(graphics, design, xforms);
+		if (graphics->instanced) {
+			graphics->dirty = false;
+			graphics->moved = false;
+			trace_end(&scope);
+			return;
+		}
+	}
 
-	graphics->indices = malloc(indices_size);
-	graphics->coords = malloc(coords_size);
-	graphics->colors = malloc(colors_size);
+	if (graphics->dirty) {
+		get_mesh_cnts(design, &vertex_cnt, &triangle_cnt);
+		block_graphics_reserve(graphics, vertex_cnt, triangle_cnt);
+	}
 
 	graphics->vertex_cnt = 0;
 	graphics->triangle_cnt = 0;
@@ -281,21 +612,82 @@ void block_graphics_reset(struct block_graphics *graphics, struct design *design
 	block_graphics_add_area(graphics, &design->build_area, &build_color);
 	block_graphics_add_area(graphics, &design->goal_area, &goal_color);
 
-	for (block = design->level_blocks.head; block; block = block->next)
-		block_graphics_add_block(graphics, block);
-
-	for (block = design->player_blocks.head; block; block = block->next)
-		block_graphics_add_block(graphics, block);
+	for (block = design->level_blocks.head; block; block = block->next) {
+		block_graphics_add_block(graphics, block, xform);
+		xform += 3;
+	}
 
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, graphics->index_buffer);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices_size, graphics->indices,
-		     GL_STATIC_DRAW);
+	for (block = design->player_blocks.head; block; block = block->next) {
+		block_graphics_add_block(graphics, block, xform);
+		xform += 3;
+	}
 
 	glBindBuffer(GL_ARRAY_BUFFER, graphics->coord_buffer);
-	glBufferData(GL_ARRAY_BUFFER, coords_size, graphics->coords, GL_DYNAMIC_DRAW);
+	if (graphics->dirty) {
+		glBufferData(GL_ARRAY_BUFFER, graphics->vertex_cnt * 2 * sizeof(float),
+			     graphics->coords, GL_DYNAMIC_DRAW);
+
+		glBindBuffer(GL_ARRAY_BUFFER, graphics->color_buffer);
+		glBufferData(GL_ARRAY_BUFFER, graphics->vertex_cnt * 3 * sizeof(float),
+			     graphics->colors, GL_STATIC_DRAW);
+
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, graphics->index_buffer);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER,
+			     graphics->triangle_cnt * 3 * sizeof(unsigned short),
+			     graphics->indices, GL_STATIC_DRAW);
+	} else {
+		glBufferSubData(GL_ARRAY_BUFFER, 0, graphics->vertex_cnt * 2 * sizeof(float),
+				graphics->coords);
+	}
 
-	glBindBuffer(GL_ARRAY_BUFFER, graphics->color_buffer);
-	glBufferData(GL_ARRAY_BUFFER, colors_size, graphics->colors, GL_STATIC_DRAW);
+	graphics->dirty = false;
+	graphics->moved = false;
+
+	trace_end(&scope);
+}
+
+/* Returns 0 if the program cannot be built, blocks are then drawn without instancing. */
+static GLuint compile_instanced_program(void)
+{
+	GLuint vertex_shader;
+	GLuint fragment_shader;
+	GLuint program;
+	GLint value;
+
+	vertex_shader = glCreateShader(GL_VERTEX_SHADER);
+	glShaderSource(vertex_shader, 1, &instanced_vertex_shader_src, NULL);
+	glCompileShader(vertex_shader);
+	glGetShaderiv(vertex_shader, GL_COMPILE_STATUS, &value);
+	if (!value)
+		return 0;
+
+	fragment_shader = glCreateShader(GL_FRAGMENT_SHADER);
+	glShaderSource(fragment_shader, 1, &block_fragment_shader_src, NULL);
+	glCompileShader(fragment_shader);
+	glGetShaderiv(fragment_shader, GL_COMPILE_STATUS, &value);
+	if (!value)
+		return 0;
+
+	program = glCreateProgram();
+	glAttachShader(program, vertex_shader);
+	glAttachShader(program, fragment_shader);
+	glLinkProgram(program);
+	glGetProgramiv(program, GL_LINK_STATUS, &value);
+	if (!value)
+		return 0;
+
+	glDeleteShader(vertex_shader);
+	glDeleteShader(fragment_shader);
+
+	instanced_program_coord_attrib = glGetAttribLocation(program, "a_coords");
+	instanced_program_transform_attrib = glGetAttribLocation(program, "a_transform");
+	instanced_program_size_attrib = glGetAttribLocation(program, "a_size");
+	instanced_program_color_attrib = glGetAttribLocation(program, "a_color");
+	instanced_program_scale_uniform = glGetUniformLocation(program, "u_scale");
+	instanced_program_shift_uniform = glGetUniformLocation(program, "u_shift");
+	instanced_program_palette_uniform = glGetUniformLocation(program, "u_palette");
+
+	return program;
 }
 
 bool arena_compile_shaders(void)
@@ -334,6 +726,8 @@ bool arena_compile_shaders(void)
 	block_program_scale_uniform = glGetUniformLocation(block_program, "u_scale");
 	block_program_shift_uniform = glGetUniformLocation(block_program, "u_shift");
 
+	instanced_program = compile_instanced_program();
+
 	vertex_shader = glCreateShader(GL_VERTEX_SHADER);
 	glShaderSource(vertex_shader, 1, &joint_vertex_shader_src, NULL);
 	glCompileShader(vertex_shader);
@@ -376,6 +770,118 @@ void block_graphics_init(struct block_graphics *graphics)
 
 	graphics->triangle_cnt = 0;
 	graphics->vertex_cnt = 0;
+	graphics->triangle_cap = 0;
+	graphics->vertex_cap = 0;
+
+	graphics->dirty = true;
+	graphics->moved = true;
+
+	graphics->instanced = instanced_program && gl_instanced_arrays();
+	graphics->instances = NULL;
+	graphics->instance_cnt = 0;
+	graphics->instance_cap = 0;
+	graphics->runs = NULL;
+	graphics->run_cnt = 0;
+	graphics->palette_cnt = 0;
+	if (graphics->instanced)
+		block_graphics_init_meshes(graphics);
+}
+
+static int count_blocks(struct design *design)
+{
+	struct block *block;
+	int cnt = 0;
+
+	for (block = design->level_blocks.head; block; block = block->next)
+		cnt++;
+	for (block = design->player_blocks.head; block; block = block->next)
+		cnt++;
+
+	return cnt;
+}
+
+static float *read_block_transform(struct block *block, float *xform)
+{
+	struct shell shell;
+
+	if (block->body) {
+		*xform++ = block->body->m_state->position.x;
+		*xform++ = block->body->m_state->position.y;
+		*xform++ = block->body->m_state->rotation;
+	} else {
+		get_shell(&shell, &block->shape);
+		*xform++ = shell.x;
+		*xform++ = shell.y;
+		*xform++ = shell.angle;
+	}
+
+	return xform;
+}
+
+/* Must be called with the arena lock held. */
+static void publish_transforms(struct arena *arena)
+{
+	struct transform_buffer *buf = &arena->transforms;
+	struct transform_snapshot *snap = &buf->slots[buf->back];
+	struct block *block;
+	float *xform;
+	int cnt;
+
+	cnt = count_blocks(&arena->design);
+	if (cnt > snap->cap) {
+		snap->cap = cnt * 2;
+		free(snap->xforms);
+		snap->xforms = malloc(snap->cap * 3 * sizeof(float));
+	}
+
+	xform = snap->xforms;
+	for (block = arena->design.level_blocks.head; block; block = block->next)
+		xform = read_block_transform(block, xform);
+	for (block = arena->design.player_blocks.head; block; block = block->next)
+		xform = read_block_transform(block, xform);
+	snap->tick = arena->tick;
+
+	buf->back = __atomic_exchange_n(&buf->middle, buf->back | TRANSFORMS_FRESH,
+					__ATOMIC_ACQ_REL) & ~TRANSFORMS_FRESH;
+}
+
+/* Returns true if a newer snapshot became the front one. */
+static bool acquire_transforms(struct transform_buffer *buf)
+{
+	if (!(__atomic_load_n(&buf->middle, __ATOMIC_ACQUIRE) & TRANSFORMS_FRESH))
+		return false;
+
+	buf->front = __atomic_exchange_n(&buf->middle, buf->front,
+					 __ATOMIC_ACQ_REL) & ~TRANSFORMS_FRESH;
+
+	return true;
+}
+
+/*
+ * Editing moves bodies on the drawing side of the lock. The event
+ * handlers mark the transforms stale and publish once when done.
+ */
+void arena_publish(struct arena *arena)
+{
+	if (arena->transforms_stale) {
+		publish_transforms(arena);
+		arena->transforms_stale = false;
+	}
+}
+
+static void transform_buffer_init(struct transform_buffer *buf)
+{
+	int i;
+
+	for (i = 0; i < 3; i++) {
+		buf->slots[i].xforms = NULL;
+		buf->slots[i].cap = 0;
+		buf->slots[i].tick = 0;
+	}
+
+	buf->back = 0;
+	buf->middle = 1;
+	buf->front = 2;
 }
 
 void arena_init(struct arena *arena, float w, float h, char *xml, int len)
@@ -406,6 +912,9 @@ void arena_init(struct arena *arena, float w, float h, char *xml, int len)
 	xml_parse(xml, len, &level);
 	convert_xml(&level, &arena->design);
 
+	grid_init(&arena->grid);
+	grid_build(&arena->grid, &arena->design);
+
 	arena->world = gen_world(&arena->design);
 
 	block_graphics_init(&arena->block_graphics);
@@ -416,9 +925,14 @@ void arena_init(struct arena *arena, float w, float h, char *xml, int len)
 		     arena->joint_coords, GL_STREAM_DRAW);
 
 	arena->tick_ms = 17;
+	arena->ticks_per_call = 1;
 	arena->tick = 0;
 	text_stream_create(&arena->tick_counter, 20);
 	arena->has_won = false;
+
+	transform_buffer_init(&arena->transforms);
+	publish_transforms(arena);
+	arena->transforms_stale = false;
 }
 
 void fill_joint_coords(struct arena *arena, struct joint *joint)
@@ -447,6 +961,11 @@ void fill_joint_coords(struct arena *arena, struct joint *joint)
 
 void block_graphics_draw(struct block_graphics *graphics, struct view *view)
 {
+	if (graphics->instanced) {
+		block_graphics_draw_instanced(graphics, view);
+		return;
+	}
+
 	glUseProgram(block_program);
 
 	glUniform2f(block_program_scale_uniform,
@@ -491,23 +1010,37 @@ static void u64tostr(char *buf, uint64_t val)
 	buf[l] = 0;
 }
 
-static void draw_tick_counter(struct arena *arena)
+static void draw_tick_counter(struct arena *arena, uint64_t tick)
 {
 	char buf[20];
 
-	u64tostr(buf, arena->tick);
+	u64tostr(buf, tick);
 
 	text_stream_update(&arena->tick_counter, buf);
 	text_stream_render(&arena->tick_counter,
 			arena->view.width, arena->view.height, 10, 10);
 }
 
+/*
+ * Runs without the arena lock. It may read the design, which only the
+ * event handlers on this thread change, but the world only through the
+ * transform snapshot.
+ */
 void arena_draw(struct arena *arena)
 {
+	struct transform_snapshot *snap;
+	struct trace_scope scope;
+
+	trace_begin(&scope, "arena_draw");
+
+	if (acquire_transforms(&arena->transforms))
+		arena->block_graphics.moved = true;
+	snap = &arena->transforms.slots[arena->transforms.front];
+
 	glClearColor(sky_color.r, sky_color.g, sky_color.b, 1.0f);
 	glClear(GL_COLOR_BUFFER_BIT);
 
-	block_graphics_reset(&arena->block_graphics, &arena->design);
+	block_graphics_update(&arena->block_graphics, &arena->design, snap->xforms);
 	block_graphics_draw(&arena->block_graphics, &arena->view);
 
 	if (arena->hover_joint) {
@@ -523,7 +1056,9 @@ void arena_draw(struct arena *arena)
 		glDisableVertexAttribArray(0);
 	}
 
-	draw_tick_counter(arena);
+	draw_tick_counter(arena, snap->tick);
+
+	trace_end(&scope);
 }
 
 void update_tool(struct arena *arena)
@@ -550,44 +1085,69 @@ void arena_key_up_event(struct arena *arena, int key)
 	update_tool(arena);
 }
 
-static int block_inside_area(struct block *block, struct area *area);
-
-static bool goal_blocks_inside_goal_area(struct design *design)
+static void run_tick(struct arena *arena)
 {
-	struct block *block;
-	bool any = false;
+	uint64_t step_start;
 
-	for (block = design->player_blocks.head; block; block = block->next) {
-		if (block->goal) {
-			any = true;
-			if (!block_inside_area(block, &design->goal_area))
-				return false;
-		}
+	step_start = trace_on ? trace_now() : 0;
+	step(arena->world, NULL);
+	trace_step(b2World_GetProfile(arena->world), step_start);
+	if (!arena->has_won) {
+		arena->tick++;
+		if (goal_blocks_inside_goal_area(&arena->design))
+			arena->has_won = true;
 	}
+}
 
-	return any;
+static bool ticks_done(struct arena *arena, int ticks, b2Timer *timer)
+{
+	if (arena->ticks_per_call)
+		return ticks >= arena->ticks_per_call;
+
+	return b2Timer_GetMilliseconds(timer) >= MAX_SPEED_BUDGET_MS;
 }
 
+/*
+ * Runs ticks_per_call ticks, or with ticks_per_call == 0 as many as fit
+ * in MAX_SPEED_BUDGET_MS. Only the last state is published for drawing.
+ * Between ticks the event handlers may take the arena lock. If one of
+ * them stopped the simulation or changed its speed, the interval is
+ * gone and so is the world that was being stepped.
+ */
 void tick_func(void *arg)
 {
 	struct arena *arena = arg;
+	struct trace_scope scope;
+	b2Timer timer;
+	int ticks = 0;
 
-	step(arena->world);
-	if (!arena->has_won) {
-		arena->tick++;
-		if (goal_blocks_inside_goal_area(&arena->design))
-			arena->has_won = true;
+	trace_begin(&scope, "tick_func");
+
+	b2Timer_ctor(&timer);
+	while (1) {
+		run_tick(arena);
+		if (ticks_done(arena, ++ticks, &timer))
+			break;
+		if (!yield_interval()) {
+			trace_end(&scope);
+			return;
+		}
 	}
+	publish_transforms(arena);
+
+	trace_end(&scope);
 }
 
 void start(struct arena *arena)
 {
 	free_world(arena->world, &arena->design);
 	arena->world = gen_world(&arena->design);
+	b2World_SetProfiling(arena->world, trace_on);
 	arena->ival = set_interval(tick_func, arena->tick_ms, arena);
 	arena->hover_joint = NULL;
 	arena->tick = 0;
 	arena->has_won = false;
+	arena->transforms_stale = true;
 }
 
 void stop(struct arena *arena)
@@ -595,11 +1155,17 @@ void stop(struct arena *arena)
 	free_world(arena->world, &arena->design);
 	arena->world = gen_world(&arena->design);
 	clear_interval(arena->ival);
+	arena->transforms_stale = true;
 }
 
-void change_speed(struct arena *arena, int ms)
+/*
+ * ticks ticks every ms milliseconds, ticks == 0 runs at maximum speed.
+ * The fast modes tick once per frame so that drawing keeps up.
+ */
+void change_speed(struct arena *arena, int ms, int ticks)
 {
 	arena->tick_ms = ms;
+	arena->ticks_per_call = ticks;
 	if (arena->state == STATE_RUNNING ||
 	    arena->state == STATE_RUNNING_PAN) {
 		clear_interval(arena->ival);
@@ -671,16 +1237,22 @@ void arena_key_down_event(struct arena *arena, int key)
 		arena->tool_hidden = TOOL_CCW_WHEEL;
 		break;
 	case 10: /* 1 */
-		change_speed(arena, 33);
+		change_speed(arena, 33, 1);
 		break;
 	case 11: /* 2 */
-		change_speed(arena, 17);
+		change_speed(arena, 17, 1);
 		break;
 	case 12: /* 3 */
-		change_speed(arena, 8);
+		change_speed(arena, 8, 1);
 		break;
 	case 13: /* 4 */
-		change_speed(arena, 4);
+		change_speed(arena, 4, 1);
+		break;
+	case 14: /* 5 */
+		change_speed(arena, FRAME_MS, FAST_FORWARD_TICKS);
+		break;
+	case 15: /* 6 */
+		change_speed(arena, FRAME_MS, 0);
 		break;
 	case 50: /* shift */
 		arena->shift = true;
@@ -703,13 +1275,17 @@ static float distance(float x0, float y0, float x1, float y1)
 
 struct joint *joint_hit_test(struct arena *arena, float x, float y)
 {
-	struct design *design = &arena->design;
 	struct joint *best_joint = NULL;
 	struct joint *joint;
 	double best_dist = 8.0f;
 	double dist;
+	void **found;
+	int cnt;
+	int i;
 
-	for (joint = design->joints.head; joint; joint = joint->next) {
+	cnt = grid_joints_near(&arena->grid, x, y, best_dist, &found);
+	for (i = 0; i < cnt; i++) {
+		joint = found[i];
 		dist = distance(x, y, joint->x, joint->y);
 		if (dist < best_dist) {
 			best_dist = dist;
@@ -755,8 +1331,13 @@ struct joint *joint_hit_test_exclude_rod(struct arena *arena, float x, float y,
 	struct joint *joint;
 	double best_dist = 8.0f;
 	double dist;
+	void **found;
+	int cnt;
+	int i;
 
-	for (joint = design->joints.head; joint; joint = joint->next) {
+	cnt = grid_joints_near(&arena->grid, x, y, best_dist, &found);
+	for (i = 0; i < cnt; i++) {
+		joint = found[i];
 		if (joint == rod->from)
 			continue;
 		if (!attached && joint == rod->to)
@@ -791,13 +1372,17 @@ bool has_wheel(struct joint *joint, struct wheel *not_this_one)
 
 struct joint *joint_hit_test_exclude_wheel(struct arena *arena, float x, float y, struct wheel *wheel, bool attached)
 {
-	struct design *design = &arena->design;
 	struct joint *best_joint = NULL;
 	struct joint *joint;
 	double best_dist = 8.0f;
 	double dist;
+	void **found;
+	int cnt;
+	int i;
 
-	for (joint = design->joints.head; joint; joint = joint->next) {
+	cnt = grid_joints_near(&arena->grid, x, y, best_dist, &found);
+	for (i = 0; i < cnt; i++) {
+		joint = found[i];
 		if (!attached && joint == wheel->center)
 			continue;
 		if (joint == wheel->spokes[0])
@@ -857,10 +1442,12 @@ bool block_is_hit(struct block *block, float x, float y)
 
 struct block *block_hit_test(struct arena *arena, float x, float y)
 {
-	struct design *design = &arena->design;
 	struct block *block;
+	void **found;
+	int i;
 
-	for (block = design->player_blocks.tail; block; block = block->prev) {
+	for (i = grid_blocks_at(&arena->grid, x, y, &found) - 1; i >= 0; i--) {
+		block = found[i];
 		if (block_is_hit(block, x, y))
 			return block;
 	}
@@ -868,61 +1455,24 @@ struct block *block_hit_test(struct arena *arena, float x, float y)
 	return NULL;
 }
 
-static void get_rect_bb(struct shell *shell, struct area *area)
-{
-	float sina = fp_sin(shell->angle);
-	float cosa = fp_cos(shell->angle);
-	float wc = shell->rect.w * cosa;
-	float ws = shell->rect.w * sina;
-	float hc = shell->rect.h * cosa;
-	float hs = shell->rect.h * sina;
-
-	area->x = shell->x;
-	area->y = shell->y;
-	area->w = fabs(wc) + fabs(hs);
-	area->h = fabs(ws) + fabs(hc);
-}
-
-static void get_circ_bb(struct shell *shell, struct area *area)
-{
-	area->x = shell->x;
-	area->y = shell->y;
-	area->w = shell->circ.radius * 2;
-	area->h = shell->circ.radius * 2;
-}
+void gen_block(b2World *world, struct block *block);
+void b2World_CleanBodyList(b2World *world);
 
-static void get_block_bb(struct block *block, struct area *area)
+static bool is_edited(struct arena *arena, struct block *block)
 {
-	struct shell shell;
-
-	get_shell(&shell, &block->shape);
-	if (block->body) {
-		shell.x = block->body->m_position.x;
-		shell.y = block->body->m_position.y;
-		shell.angle = block->body->m_rotation;
-	}
-
-	if (shell.type == SHELL_CIRC)
-		get_circ_bb(&shell, area);
-	else
-		get_rect_bb(&shell, area);
+	return block->visited || block == arena->new_block;
 }
 
-static int block_inside_area(struct block *block, struct area *area)
+static bool shape_is_edited(b2Shape *shape, void *data)
 {
-	struct area bb;
-
-	get_block_bb(block, &bb);
-
-	return bb.x - bb.w / 2 >= area->x - area->w / 2
-	    && bb.x + bb.w / 2 <= area->x + area->w / 2
-	    && bb.y - bb.h / 2 >= area->y - area->h / 2
-	    && bb.y + bb.h / 2 <= area->y + area->h / 2;
+	return is_edited(data, shape->m_userData);
 }
 
-void gen_block(b2World *world, struct block *block);
-void b2World_CleanBodyList(b2World *world);
-
+/*
+ * Only the blocks being moved or created can be marked, so only their
+ * contacts need the narrow phase. The rest keep stale manifolds, which
+ * nothing in the editor looks at and start() throws away.
+ */
 void mark_overlaps(struct arena *arena)
 {
 	b2Contact *contact;
@@ -930,67 +1480,80 @@ void mark_overlaps(struct arena *arena)
 
 	b2ContactManager_CleanContactList(&arena->world->m_contactManager);
 	b2World_CleanBodyList(arena->world);
-	b2ContactManager_Collide(&arena->world->m_contactManager);
+	b2ContactManager_CollideFiltered(&arena->world->m_contactManager,
+					 shape_is_edited, arena);
 
 	for (block = arena->design.player_blocks.head; block; block = block->next) {
 		block->overlap = false;
-		if (!block_inside_area(block, &arena->design.build_area))
+		if (is_edited(arena, block) &&
+		    !block_inside_area(block, &arena->design.build_area))
 			block->overlap = true;
 	}
 
 	for (contact = arena->world->m_contactList; contact; contact = contact->m_next) {
 		if (contact->m_manifoldCount > 0) {
 			block = (struct block *)contact->m_shape1->m_userData;
-			block->overlap = true;
+			if (is_edited(arena, block))
+				block->overlap = true;
 			block = (struct block *)contact->m_shape2->m_userData;
-			block->overlap = true;
+			if (is_edited(arena, block))
+				block->overlap = true;
 		}
 	}
 
-	for (block = arena->design.player_blocks.head; block; block = block->next) {
-		if (!block->visited && block != arena->new_block)
-			block->overlap = false;
-	}
-
 	for (block = arena->design.level_blocks.head; block; block = block->next)
 		block->overlap = false;
+
+	arena->block_graphics.dirty = true;
+	arena->transforms_stale = true;
+}
+
+/* Joints are only added and deleted through these, to keep the grid current. */
+static struct joint *add_joint(struct arena *arena, struct block *gen, double x, double y)
+{
+	struct joint *joint;
+
+	joint = new_joint(gen, x, y);
+	append_joint(&arena->design.joints, joint);
+	grid_insert_joint(&arena->grid, joint);
+
+	return joint;
+}
+
+static void delete_joint(struct arena *arena, struct joint *joint)
+{
+	grid_remove_joint(&arena->grid, joint);
+	remove_joint(&arena->design.joints, joint);
+	free(joint);
 }
 
-void delete_rod_joints(struct design *design, struct rod *rod)
+void delete_rod_joints(struct arena *arena, struct rod *rod)
 {
 	remove_attach_node(&rod->from->att, rod->from_att);
 	free(rod->from_att);
-	if (!rod->from->att.head && !rod->from->gen) {
-		remove_joint(&design->joints, rod->from);
-		free(rod->from);
-	}
+	if (!rod->from->att.head && !rod->from->gen)
+		delete_joint(arena, rod->from);
 
 	remove_attach_node(&rod->to->att, rod->to_att);
 	free(rod->to_att);
-	if (!rod->to->att.head && !rod->to->gen) {
-		remove_joint(&design->joints, rod->to);
-		free(rod->to);
-	}
+	if (!rod->to->att.head && !rod->to->gen)
+		delete_joint(arena, rod->to);
 }
 
-void delete_wheel_joints(struct design *design, struct wheel *wheel)
+void delete_wheel_joints(struct arena *arena, struct wheel *wheel)
 {
 	int i;
 
 	remove_attach_node(&wheel->center->att, wheel->center_att);
 	free(wheel->center_att);
-	if (!wheel->center->att.head && !wheel->center->gen) {
-		remove_joint(&design->joints, wheel->center);
-		free(wheel->center);
-	}
+	if (!wheel->center->att.head && !wheel->center->gen)
+		delete_joint(arena, wheel->center);
 
 	for (i = 0; i < 4; i++) {
-		if (wheel->spokes[i]->att.head) {
+		if (wheel->spokes[i]->att.head)
 			wheel->spokes[i]->gen = NULL;
-		} else {
-			remove_joint(&design->joints, wheel->spokes[i]);
-			free(wheel->spokes[i]);
-		}
+		else
+			delete_joint(arena, wheel->spokes[i]);
 	}
 }
 
@@ -1001,12 +1564,13 @@ void delete_block(struct arena *arena, struct block *block)
 
 	switch (shape->type) {
 	case SHAPE_ROD:
-		delete_rod_joints(design, &shape->rod);
+		delete_rod_joints(arena, &shape->rod);
 		break;
 	case SHAPE_WHEEL:
-		delete_wheel_joints(design, &shape->wheel);
+		delete_wheel_joints(arena, &shape->wheel);
 	}
 
+	grid_remove_block(&arena->grid, block);
 	b2World_DestroyBody(arena->world, block->body);
 	remove_block(&design->player_blocks, block);
 	free(block);
@@ -1156,8 +1720,12 @@ void update_joints(struct arena *arena, struct block *block)
 
 void update_body(struct arena *arena, struct block *block)
 {
+	/* Its joints may have changed since gen_world() listed them. */
+	block->neighbours = NULL;
 	b2World_DestroyBody(arena->world, block->body);
 	gen_block(arena->world, block);
+	grid_update_block(&arena->grid, block);
+	arena->transforms_stale = true;
 }
 
 void move_joint(struct arena *arena, struct joint *joint, double x, double y)
@@ -1232,12 +1800,11 @@ bool new_rod_attached(struct rod *rod)
 	return rod->to->gen || rod->to_att->prev;
 }
 
-void attach_new_rod(struct design *design, struct block *block, struct joint *joint)
+void attach_new_rod(struct arena *arena, struct block *block, struct joint *joint)
 {
 	struct rod *rod = &block->shape.rod;
 
-	remove_joint(&design->joints, rod->to);
-	free(rod->to);
+	delete_joint(arena, rod->to);
 	free(rod->to_att);
 
 	rod->to = joint;
@@ -1247,11 +1814,9 @@ void attach_new_rod(struct design *design, struct block *block, struct joint *jo
 
 void attach_new_wheel(struct arena *arena, struct block *block, struct joint *joint)
 {
-	struct design *design = &arena->design;
 	struct wheel *wheel = &block->shape.wheel;
 
-	remove_joint(&design->joints, wheel->center);
-	free(wheel->center);
+	delete_joint(arena, wheel->center);
 	free(wheel->center_att);
 
 	wheel->center = joint;
@@ -1261,29 +1826,26 @@ void attach_new_wheel(struct arena *arena, struct block *block, struct joint *jo
 	update_joints(arena, block);
 }
 
-void detach_new_rod(struct design *design, struct block *block, double x, double y)
+void detach_new_rod(struct arena *arena, struct block *block, double x, double y)
 {
 	struct rod *rod = &block->shape.rod;
 
 	remove_attach_node(&rod->to->att, rod->to_att);
 	free(rod->to_att);
 
-	rod->to = new_joint(NULL, x, y);
-	append_joint(&design->joints, rod->to);
+	rod->to = add_joint(arena, NULL, x, y);
 	rod->to_att = new_attach_node(block);
 	append_attach_node(&rod->to->att, rod->to_att);
 }
 
 void detach_new_wheel(struct arena *arena, struct block *block, double x, double y)
 {
-	struct design *design = &arena->design;
 	struct wheel *wheel = &block->shape.wheel;
 
 	remove_attach_node(&wheel->center->att, wheel->center_att);
 	free(wheel->center_att);
 
-	wheel->center = new_joint(NULL, x, y);
-	append_joint(&design->joints, wheel->center);
+	wheel->center = add_joint(arena, NULL, x, y);
 	wheel->center_att = new_attach_node(block);
 	append_attach_node(&wheel->center->att, wheel->center_att);
 
@@ -1326,7 +1888,7 @@ void action_new_rod(struct arena *arena, int x, int y)
 
 	if (!attached) {
 		if (joint) {
-			attach_new_rod(&arena->design, arena->new_block, joint);
+			attach_new_rod(arena, arena->new_block, joint);
 		} else {
 			rod->to->x = x_world;
 			rod->to->y = y_world;
@@ -1334,10 +1896,10 @@ void action_new_rod(struct arena *arena, int x, int y)
 		}
 	} else {
 		if (!joint) {
-			detach_new_rod(&arena->design, arena->new_block, x_world, y_world);
+			detach_new_rod(arena, arena->new_block, x_world, y_world);
 		} else if (joint != rod->to) {
-			detach_new_rod(&arena->design, arena->new_block, x_world, y_world);
-			attach_new_rod(&arena->design, arena->new_block, joint);
+			detach_new_rod(arena, arena->new_block, x_world, y_world);
+			attach_new_rod(arena, arena->new_block, joint);
 		}
 	}
 
@@ -1520,6 +2082,7 @@ void block_dfs(struct arena *arena, struct block *block, bool value, bool all)
 	if (block->visited == value)
 		return;
 	block->visited = value;
+	arena->block_graphics.dirty = true;
 
 	arena->blocks_moving = append_block_head(arena->blocks_moving, block);
 
@@ -1621,15 +2184,12 @@ void mouse_down_rod(struct arena *arena, float x, float y)
 	block->next = NULL;
 
 	j0 = arena->hover_joint;
-	if (!j0) {
-		j0 = new_joint(NULL, x, y);
-		append_joint(&design->joints, j0);
-	}
+	if (!j0)
+		j0 = add_joint(arena, NULL, x, y);
 	att0 = new_attach_node(block);
 	append_attach_node(&j0->att, att0);
 
-	j1 = new_joint(NULL, x, y);
-	append_joint(&design->joints, j1);
+	j1 = add_joint(arena, NULL, x, y);
 	att1 = new_attach_node(block);
 	append_attach_node(&j1->att, att1);
 
@@ -1645,6 +2205,7 @@ void mouse_down_rod(struct arena *arena, float x, float y)
 	block->goal = false;
 	block->overlap = false;
 	block->visited = false;
+	block->neighbours = NULL;
 
 	if (solid) {
 		block->r = solid_rod_r;
@@ -1661,6 +2222,7 @@ void mouse_down_rod(struct arena *arena, float x, float y)
 	gen_block(arena->world, block);
 
 	append_block(&design->player_blocks, block);
+	grid_insert_block(&arena->grid, block);
 
 	arena->hover_joint = j0;
 
@@ -1681,10 +2243,8 @@ void mouse_down_wheel(struct arena *arena, float x, float y)
 	block->next = NULL;
 
 	j0 = arena->hover_joint;
-	if (!j0 || has_wheel(j0, NULL)) {
-		j0 = new_joint(NULL, x, y);
-		append_joint(&design->joints, j0);
-	}
+	if (!j0 || has_wheel(j0, NULL))
+		j0 = add_joint(arena, NULL, x, y);
 	att0 = new_attach_node(block);
 	append_attach_node(&j0->att, att0);
 
@@ -1718,14 +2278,14 @@ void mouse_down_wheel(struct arena *arena, float x, float y)
 	for (i = 0; i < 4; i++) {
 		spoke_x = j0->x + fp_cos(a[i]) * 20.0;
 		spoke_y = j0->y + fp_sin(a[i]) * 20.0;
-		block->shape.wheel.spokes[i] = new_joint(block, spoke_x, spoke_y);
-		append_joint(&design->joints, block->shape.wheel.spokes[i]);
+		block->shape.wheel.spokes[i] = add_joint(arena, block, spoke_x, spoke_y);
 	}
 
 	block->material = &solid_material;
 	block->goal = false;
 	block->overlap = false;
 	block->visited = false;
+	block->neighbours = NULL;
 
 	switch (arena->tool) {
 	case TOOL_WHEEL:
@@ -1750,6 +2310,7 @@ void mouse_down_wheel(struct arena *arena, float x, float y)
 	gen_block(arena->world, block);
 
 	append_block(&design->player_blocks, block);
+	grid_insert_block(&arena->grid, block);
 
 	arena->hover_joint = j0;
 
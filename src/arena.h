@@ -40,6 +40,19 @@ struct joint_head {
 	double orig_y;
 };
 
+#define BLOCK_PALETTE_SIZE 32
+
+struct block_run {
+	int mesh;
+	int first;
+	int cnt;
+};
+
+/*
+ * Block meshes live in persistent buffers. Set dirty when blocks are
+ * added or removed or change color, this rebuilds and uploads everything.
+ * Set moved when only positions changed, this streams just the coords.
+ */
 struct block_graphics {
 	unsigned short *indices;
 	float *coords;
@@ -51,14 +64,59 @@ struct block_graphics {
 
 	int triangle_cnt;
 	int vertex_cnt;
+	int triangle_cap;
+	int vertex_cap;
+
+	bool dirty;
+	bool moved;
+
+	/*
+	 * With instanced arrays each block is one instance record of a unit
+	 * rectangle or circle mesh. Consecutive blocks with the same mesh form
+	 * a run that is drawn with one call, which keeps the draw order.
+	 */
+	bool instanced;
+	GLuint mesh_coord_buffer;
+	GLuint mesh_index_buffer;
+	GLuint instance_buffer;
+	float *instances;
+	int instance_cnt;
+	int instance_cap;
+	struct block_run *runs;
+	int run_cnt;
+	float palette[BLOCK_PALETTE_SIZE * 3];
+	int palette_cnt;
+};
+
+struct transform_snapshot {
+	float *xforms; /* x, y and angle of each block, level blocks first */
+	int cap;
+	uint64_t tick;
+};
+
+/*
+ * Lock-free triple buffer of block transforms. The thread holding the
+ * arena lock (the tick or the event handlers) publishes, arena_draw
+ * takes the newest complete snapshot without locking. middle is the
+ * index of the shared slot, with TRANSFORMS_FRESH set until it is taken.
+ */
+#define TRANSFORMS_FRESH 4
+
+struct transform_buffer {
+	struct transform_snapshot slots[3];
+	int back;
+	int middle;
+	int front;
 };
 
 struct arena {
 	struct design design;
+	struct grid grid;
 	b2World *world;
 
 	int ival;
 	int tick_ms;
+	int ticks_per_call;
 
 	struct view view;
 
@@ -91,6 +149,9 @@ struct arena {
 	uint64_t tick;
 	struct text_stream tick_counter;
 	bool has_won;
+
+	struct transform_buffer transforms;
+	bool transforms_stale;
 };
 
 bool arena_compile_shaders(void);
@@ -98,6 +159,7 @@ void arena_init(struct arena *arena, float w, float h, char *xml, int len);
 
 void arena_show(struct arena *arena);
 void arena_draw(struct arena *arena);
+void arena_publish(struct arena *arena);
 
 void arena_key_up_event(struct arena *arena, int key);
 void arena_key_down_event(struct arena *arena, int key);
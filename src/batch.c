@@ -0,0 +1,344 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "verify.h"
+
+#define DEFAULT_MAX_TICKS 100000
+
+struct task {
+	char *path;
+	bool failed;
+	double cpu_secs;
+	struct verify_result res;
+};
+
+/*
+ * Each worker owns a deque of task indices. The owner pops from the
+ * tail, idle workers steal from the head of someone else's deque, so
+ * long designs never leave the remaining cores without work.
+ */
+struct deque {
+	pthread_mutex_t lock;
+	int *tasks;
+	int head;
+	int tail;
+};
+
+struct pool {
+	struct task *tasks;
+	int task_cnt;
+	struct deque *deques;
+	int worker_cnt;
+	uint64_t max_ticks;
+};
+
+struct worker {
+	struct pool *pool;
+	int id;
+	pthread_t thread;
+};
+
+static bool pop_tail(struct deque *dq, int *task)
+{
+	bool res = false;
+
+	pthread_mutex_lock(&dq->lock);
+	if (dq->head < dq->tail) {
+		*task = dq->tasks[--dq->tail];
+		res = true;
+	}
+	pthread_mutex_unlock(&dq->lock);
+
+	return res;
+}
+
+static bool steal_head(struct deque *dq, int *task)
+{
+	bool res = false;
+
+	pthread_mutex_lock(&dq->lock);
+	if (dq->head < dq->tail) {
+		*task = dq->tasks[dq->head++];
+		res = true;
+	}
+	pthread_mutex_unlock(&dq->lock);
+
+	return res;
+}
+
+static bool next_task(struct worker *worker, int *task)
+{
+	struct pool *pool = worker->pool;
+	int i;
+
+	if (pop_tail(&pool->deques[worker->id], task))
+		return true;
+
+	for (i = 1; i < pool->worker_cnt; i++) {
+		if (steal_head(&pool->deques[(worker->id + i) % pool->worker_cnt], task))
+			return true;
+	}
+
+	return false;
+}
+
+static double cpu_time(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void run_task(struct task *task, uint64_t max_ticks)
+{
+	double start;
+	char *xml;
+	int len;
+
+	start = cpu_time();
+
+	xml = read_file(task->path, &len);
+	if (!xml) {
+		task->failed = true;
+		return;
+	}
+
+	task->failed = verify_design(xml, len, max_ticks, &task->res) != 0;
+	free(xml);
+
+	task->cpu_secs = cpu_time() - start;
+}
+
+static void *worker_func(void *arg)
+{
+	struct worker *worker = arg;
+	struct pool *pool = worker->pool;
+	int task;
+
+	while (next_task(worker, &task))
+		run_task(&pool->tasks[task], pool->max_ticks);
+
+	return NULL;
+}
+
+static void run_pool(struct pool *pool)
+{
+	struct worker *workers;
+	int per_worker;
+	int i;
+
+	per_worker = (pool->task_cnt + pool->worker_cnt - 1) / pool->worker_cnt;
+
+	pool->deques = calloc(pool->worker_cnt, sizeof(*pool->deques));
+	for (i = 0; i < pool->worker_cnt; i++) {
+		pthread_mutex_init(&pool->deques[i].lock, NULL);
+		pool->deques[i].tasks = malloc(per_worker * sizeof(int));
+	}
+
+	for (i = 0; i < pool->task_cnt; i++) {
+		struct deque *dq = &pool->deques[i % pool->worker_cnt];
+		dq->tasks[dq->tail++] = i;
+	}
+
+	workers = calloc(pool->worker_cnt, sizeof(*workers));
+	for (i = 0; i < pool->worker_cnt; i++) {
+		workers[i].pool = pool;
+		workers[i].id = i;
+		pthread_create(&workers[i].thread, NULL, worker_func, &workers[i]);
+	}
+
+	for (i = 0; i < pool->worker_cnt; i++)
+		pthread_join(workers[i].thread, NULL);
+
+	for (i = 0; i < pool->worker_cnt; i++) {
+		pthread_mutex_destroy(&pool->deques[i].lock);
+		free(pool->deques[i].tasks);
+	}
+	free(pool->deques);
+	free(workers);
+}
+
+struct path_list {
+	char **paths;
+	int cnt;
+	int cap;
+};
+
+static void append_path(struct path_list *list, char *path)
+{
+	if (list->cnt == list->cap) {
+		list->cap = list->cap ? list->cap * 2 : 64;
+		list->paths = realloc(list->paths, list->cap * sizeof(char *));
+	}
+	list->paths[list->cnt++] = path;
+}
+
+static int cmp_path(const void *a, const void *b)
+{
+	return strcmp(*(char **)a, *(char **)b);
+}
+
+static bool has_xml_suffix(const char *name)
+{
+	size_t len = strlen(name);
+
+	return len > 4 && !strcmp(name + len - 4, ".xml");
+}
+
+static int read_dir(const char *dir, struct path_list *list)
+{
+	struct dirent *ent;
+	DIR *dp;
+	char *path;
+
+	dp = opendir(dir);
+	if (!dp)
+		return -1;
+
+	while ((ent = readdir(dp))) {
+		if (!has_xml_suffix(ent->d_name))
+			continue;
+		path = malloc(strlen(dir) + strlen(ent->d_name) + 2);
+		sprintf(path, "%s/%s", dir, ent->d_name);
+		append_path(list, path);
+	}
+
+	closedir(dp);
+
+	qsort(list->paths, list->cnt, sizeof(char *), cmp_path);
+
+	return 0;
+}
+
+/* One design path per line, blank lines and lines starting with '#' are skipped. */
+static int read_manifest(const char *manifest, struct path_list *list)
+{
+	char line[4096];
+	size_t len;
+	FILE *fp;
+
+	fp = fopen(manifest, "r");
+	if (!fp)
+		return -1;
+
+	while (fgets(line, sizeof(line), fp)) {
+		len = strcspn(line, "\r\n");
+		line[len] = 0;
+		if (len == 0 || line[0] == '#')
+			continue;
+		append_path(list, strdup(line));
+	}
+
+	fclose(fp);
+
+	return 0;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s [-j jobs] [-t max_ticks] <dir|manifest>\n", prog);
+}
+
+int main(int argc, char **argv)
+{
+	struct path_list list = { 0 };
+	struct pool pool;
+	struct stat st;
+	struct timespec start, end;
+	uint64_t total_ticks = 0;
+	int solved_cnt = 0;
+	int jobs;
+	double secs;
+	int opt;
+	int res;
+	int i;
+
+	jobs = sysconf(_SC_NPROCESSORS_ONLN);
+	pool.max_ticks = DEFAULT_MAX_TICKS;
+
+	while ((opt = getopt(argc, argv, "j:t:")) != -1) {
+		switch (opt) {
+		case 'j':
+			jobs = atoi(optarg);
+			break;
+		case 't':
+			pool.max_ticks = strtoull(optarg, NULL, 10);
+			break;
+		default:
+			usage(argv[0]);
+			return 2;
+		}
+	}
+
+	if (optind != argc - 1 || jobs < 1) {
+		usage(argv[0]);
+		return 2;
+	}
+
+	if (stat(argv[optind], &st)) {
+		fprintf(stderr, "%s: cannot stat %s\n", argv[0], argv[optind]);
+		return 2;
+	}
+
+	if (S_ISDIR(st.st_mode))
+		res = read_dir(argv[optind], &list);
+	else
+		res = read_manifest(argv[optind], &list);
+
+	if (res) {
+		fprintf(stderr, "%s: cannot read %s\n", argv[0], argv[optind]);
+		return 2;
+	}
+
+	pool.task_cnt = list.cnt;
+	pool.tasks = calloc(list.cnt ? list.cnt : 1, sizeof(*pool.tasks));
+	for (i = 0; i < list.cnt; i++)
+		pool.tasks[i].path = list.paths[i];
+	pool.worker_cnt = jobs < list.cnt ? jobs : (list.cnt ? list.cnt : 1);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	run_pool(&pool);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	printf("design\tsolved\tsolve_tick\tticks\tcpu_s\thash\n");
+	for (i = 0; i < pool.task_cnt; i++) {
+		struct task *task = &pool.tasks[i];
+
+		if (task->failed) {
+			printf("%s\terror\t-\t-\t-\t-\n", task->path);
+			continue;
+		}
+
+		printf("%s\t%d\t%llu\t%llu\t%.6f\t%016llx\n",
+		       task->path,
+		       task->res.solved,
+		       (unsigned long long)task->res.solve_tick,
+		       (unsigned long long)task->res.ticks,
+		       task->cpu_secs,
+		       (unsigned long long)task->res.hash);
+
+		solved_cnt += task->res.solved;
+		total_ticks += task->res.ticks;
+	}
+
+	secs = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+	fprintf(stderr, "%d designs, %d solved, %llu ticks in %.3f s (%.0f ticks/s, %d threads)\n",
+		pool.task_cnt, solved_cnt, (unsigned long long)total_ticks,
+		secs, secs > 0.0 ? total_ticks / secs : 0.0, pool.worker_cnt);
+
+	for (i = 0; i < list.cnt; i++)
+		free(list.paths[i]);
+	free(list.paths);
+	free(pool.tasks);
+
+	return 0;
+}
@@ -0,0 +1,194 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "verify.h"
+
+#define DEFAULT_GOLDEN "corpus/golden.tsv"
+
+/*
+ * One line of the golden file: design path relative to the golden file,
+ * tick limit, expected solve tick ("-" if it is not solved within the
+ * limit) and expected final state hash. Fields are separated by tabs,
+ * lines starting with '#' are comments.
+ */
+struct golden {
+	char path[1024];
+	uint64_t max_ticks;
+	bool solved;
+	uint64_t solve_tick;
+	uint64_t hash;
+};
+
+static int parse_golden(char *line, struct golden *g)
+{
+	char *fields[4];
+	char *p = line;
+	int i;
+
+	for (i = 0; i < 4; i++) {
+		fields[i] = p;
+		p += strcspn(p, "\t");
+		if (*p)
+			*p++ = 0;
+		else if (i < 3)
+			return -1;
+	}
+
+	if (strlen(fields[0]) >= sizeof(g->path))
+		return -1;
+	strcpy(g->path, fields[0]);
+
+	g->max_ticks = strtoull(fields[1], NULL, 10);
+	g->solved = strcmp(fields[2], "-") != 0;
+	g->solve_tick = g->solved ? strtoull(fields[2], NULL, 10) : 0;
+	g->hash = strtoull(fields[3], NULL, 16);
+
+	return 0;
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s [-p] [-j threads] [golden.tsv]\n", prog);
+}
+
+int main(int argc, char **argv)
+{
+	const char *golden_path = DEFAULT_GOLDEN;
+	struct verify_opts opts = { 0 };
+	struct verify_result res;
+	struct golden g;
+	char line[4096];
+	char path[2048];
+	uint64_t total_ticks = 0;
+	double total_secs = 0.0;
+	bool print = false;
+	int dir_len;
+	int design_cnt = 0;
+	int diverged = 0;
+	double start, secs;
+	size_t len;
+	char *xml;
+	int xml_len;
+	FILE *fp;
+	int opt;
+	int err;
+
+	while ((opt = getopt(argc, argv, "pj:")) != -1) {
+		switch (opt) {
+		case 'p':
+			print = true;
+			break;
+		case 'j':
+			opts.threads = atoi(optarg);
+			break;
+		default:
+			usage(argv[0]);
+			return 2;
+		}
+	}
+
+	if (argc - optind > 1) {
+		usage(argv[0]);
+		return 2;
+	}
+	if (argc - optind == 1)
+		golden_path = argv[optind];
+
+	fp = fopen(golden_path, "r");
+	if (!fp) {
+		fprintf(stderr, "%s: cannot read %s\n", argv[0], golden_path);
+		return 2;
+	}
+
+	dir_len = strrchr(golden_path, '/') ? strrchr(golden_path, '/') - golden_path + 1 : 0;
+
+	if (!print)
+		printf("design\tticks\tticks/s\tresult\n");
+
+	while (fgets(line, sizeof(line), fp)) {
+		len = strcspn(line, "\r\n");
+		line[len] = 0;
+		if (len == 0 || line[0] == '#')
+			continue;
+
+		if (parse_golden(line, &g)) {
+			fprintf(stderr, "%s: malformed line in %s\n", argv[0], golden_path);
+			fclose(fp);
+			return 2;
+		}
+
+		snprintf(path, sizeof(path), "%.*s%s", dir_len, golden_path, g.path);
+		xml = read_file(path, &xml_len);
+		if (!xml) {
+			fprintf(stderr, "%s: cannot read %s\n", argv[0], path);
+			fclose(fp);
+			return 2;
+		}
+
+		start = now();
+		err = verify_design_opts(xml, xml_len, g.max_ticks, &opts, &res);
+		secs = now() - start;
+		free(xml);
+
+		if (err) {
+			fprintf(stderr, "%s: cannot parse %s\n", argv[0], path);
+			fclose(fp);
+			return 2;
+		}
+
+		design_cnt++;
+		total_ticks += res.ticks;
+		total_secs += secs;
+
+		if (print) {
+			if (res.solved)
+				printf("%s\t%llu\t%llu\t%016llx\n", g.path,
+				       (unsigned long long)g.max_ticks,
+				       (unsigned long long)res.solve_tick,
+				       (unsigned long long)res.hash);
+			else
+				printf("%s\t%llu\t-\t%016llx\n", g.path,
+				       (unsigned long long)g.max_ticks,
+				       (unsigned long long)res.hash);
+			continue;
+		}
+
+		printf("%s\t%llu\t%.0f\t", g.path, (unsigned long long)res.ticks,
+		       secs > 0.0 ? res.ticks / secs : 0.0);
+
+		if (res.solved != g.solved || res.solve_tick != g.solve_tick) {
+			printf("DIVERGED: solve tick %lld, expected %lld\n",
+			       res.solved ? (long long)res.solve_tick : -1LL,
+			       g.solved ? (long long)g.solve_tick : -1LL);
+			diverged++;
+		} else if (res.hash != g.hash) {
+			printf("DIVERGED: hash %016llx, expected %016llx\n",
+			       (unsigned long long)res.hash,
+			       (unsigned long long)g.hash);
+			diverged++;
+		} else {
+			printf("ok\n");
+		}
+	}
+
+	fclose(fp);
+
+	fprintf(stderr, "%d designs, %d diverged, %llu ticks in %.3f s (%.0f ticks/s)\n",
+		design_cnt, diverged, (unsigned long long)total_ticks, total_secs,
+		total_secs > 0.0 ? total_ticks / total_secs : 0.0);
+
+	return diverged ? 1 : 0;
+}
@@ -21,7 +21,7 @@
 #include <string.h>
 #include <limits.h>
 
-int32 b2BlockAllocator_s_blockSizes[b2_blockSizes] =
+const int32 b2BlockAllocator_s_blockSizes[b2_blockSizes] =
 {
 	16,		// 0
 	32,		// 1
@@ -38,8 +38,38 @@ int32 b2BlockAllocator_s_blockSizes[b2_blockSizes] =
 	512,	// 12
 	640,	// 13
 };
-uint8 b2BlockAllocator_s_blockSizeLookup[b2_maxBlockSize + 1];
-bool b2BlockAllocator_s_blockSizeLookupInitialized;
+
+// Maps an allocation size to an index into b2BlockAllocator_s_blockSizes.
+// Built at compile time so allocators on different threads never race
+// on lazy initialisation.
+#define B16(i)	i, i, i, i, i, i, i, i, i, i, i, i, i, i, i, i
+#define B32(i)	B16(i), B16(i)
+#define B64(i)	B32(i), B32(i)
+#define B128(i)	B64(i), B64(i)
+
+const uint8 b2BlockAllocator_s_blockSizeLookup[b2_maxBlockSize + 1] =
+{
+	0,
+	B16(0),		// 1 - 16
+	B16(1),		// 17 - 32
+	B32(2),		// 33 - 64
+	B32(3),		// 65 - 96
+	B32(4),		// 97 - 128
+	B32(5),		// 129 - 160
+	B32(6),		// 161 - 192
+	B32(7),		// 193 - 224
+	B32(8),		// 225 - 256
+	B64(9),		// 257 - 320
+	B64(10),	// 321 - 384
+	B64(11),	// 385 - 448
+	B64(12),	// 449 - 512
+	B128(13),	// 513 - 640
+};
+
+#undef B16
+#undef B32
+#undef B64
+#undef B128
 
 struct b2Chunk
 {
@@ -60,25 +90,6 @@ void b2BlockAllocator_ctor(b2BlockAllocator *allocator)
 
 	memset(allocator->m_chunks, 0, allocator->m_chunkSpace * sizeof(b2Chunk));
 	memset(allocator->m_freeLists, 0, sizeof(allocator->m_freeLists));
-
-	if (b2BlockAllocator_s_blockSizeLookupInitialized == false)
-	{
-		int32 j = 0;
-		for (int32 i = 1; i <= b2_maxBlockSize; ++i)
-		{
-			if (i <= b2BlockAllocator_s_blockSizes[j])
-			{
-				b2BlockAllocator_s_blockSizeLookup[i] = (uint8)j;
-			}
-			else
-			{
-				++j;
-				b2BlockAllocator_s_blockSizeLookup[i] = (uint8)j;
-			}
-		}
-
-		b2BlockAllocator_s_blockSizeLookupInitialized = true;
-	}
 }
 
 void b2BlockAllocator_dtor(b2BlockAllocator *allocator)
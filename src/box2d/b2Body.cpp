@@ -38,14 +38,18 @@ void b2BodyDef_ctor(b2BodyDef *def)
 	def->isSleeping = false;
 }
 
+// The world assigns body->m_state before calling this.
 void b2Body_ctor(b2Body *body, const b2BodyDef* bd, b2World* world)
 {
-	body->m_flags = 0;
-	body->m_position = bd->position;
-	body->m_rotation = bd->rotation;
-	b2Mat22_SetAngle(&body->m_R, body->m_rotation);
-	body->m_position0 = body->m_position;
-	body->m_rotation0 = body->m_rotation;
+	b2BodyState* state = body->m_state;
+	state->body = body;
+	state->flags = 0;
+	state->islandStamp = 0;
+	state->position = bd->position;
+	state->rotation = bd->rotation;
+	b2Mat22_SetAngle(&state->R, state->rotation);
+	body->m_position0 = state->position;
+	body->m_rotation0 = state->rotation;
 	body->m_world = world;
 
 	body->m_linearDamping = b2Clamp(1.0 - bd->linearDamping, 0.0, 1.0);
@@ -76,11 +80,11 @@ void b2Body_ctor(b2Body *body, const b2BodyDef* bd, b2World* world)
 	if (body->m_mass > 0.0)
 	{
 		body->m_center *= 1.0 / body->m_mass;
-		body->m_position += b2Mul(body->m_R, body->m_center);
+		state->position += b2Mul(state->R, body->m_center);
 	}
 	else
 	{
-		body->m_flags |= b2Body_e_staticFlag;
+		state->flags |= b2Body_e_staticFlag;
 	}
 
 	// Compute the moment of inertia.
@@ -96,26 +100,26 @@ void b2Body_ctor(b2Body *body, const b2BodyDef* bd, b2World* world)
 
 	if (body->m_mass > 0.0)
 	{
-		body->m_invMass = 1.0 / body->m_mass;
+		state->invMass = 1.0 / body->m_mass;
 	}
 	else
 	{
-		body->m_invMass = 0.0;
+		state->invMass = 0.0;
 	}
 
 	if (body->m_I > 0.0)
 	{
-		body->m_invI = 1.0 / body->m_I;
+		state->invI = 1.0 / body->m_I;
 	}
 	else
 	{
 		body->m_I = 0.0;
-		body->m_invI = 0.0;
+		state->invI = 0.0;
 	}
 
 	// Compute the center of mass velocity.
-	body->m_linearVelocity = bd->linearVelocity + b2Cross(bd->angularVelocity, body->m_center);
-	body->m_angularVelocity = bd->angularVelocity;
+	state->linearVelocity = bd->linearVelocity + b2Cross(bd->angularVelocity, body->m_center);
+	state->angularVelocity = bd->angularVelocity;
 
 	body->m_jointList = NULL;
 	body->m_contactList = NULL;
@@ -133,19 +137,22 @@ void b2Body_ctor(b2Body *body, const b2BodyDef* bd, b2World* world)
 	}
 
 	body->m_sleepTime = 0.0;
+	body->m_islandIndex = 0;
+	body->m_sleepChangedNext = NULL;
 	if (bd->allowSleep)
 	{
-		body->m_flags |= b2Body_e_allowSleepFlag;
+		state->flags |= b2Body_e_allowSleepFlag;
 	}
 	if (bd->isSleeping)
 	{
-		body->m_flags |= b2Body_e_sleepFlag;
+		// No contacts yet, so nothing to tell the contact manager.
+		state->flags |= b2Body_e_sleepFlag | b2Body_e_contactSleepFlag;
 	}
 
-	if ((body->m_flags & b2Body_e_sleepFlag)  || body->m_invMass == 0.0)
+	if ((state->flags & b2Body_e_sleepFlag)  || state->invMass == 0.0)
 	{
-		b2Vec2_Set(&body->m_linearVelocity, 0.0, 0.0);
-		body->m_angularVelocity = 0.0;
+		b2Vec2_Set(&state->linearVelocity, 0.0, 0.0);
+		state->angularVelocity = 0.0;
 	}
 
 	body->m_userData = bd->userData;
@@ -165,7 +172,7 @@ void b2Body_dtor(b2Body *body)
 
 b2Vec2 b2Body_GetOriginPosition(const b2Body *body)
 {
-        return body->m_position - b2Mul(body->m_R, body->m_center);
+        return body->m_state->position - b2Mul(body->m_state->R, body->m_center);
 }
 
 void b2Body_SynchronizeShapes(b2Body *body)
@@ -174,17 +181,37 @@ void b2Body_SynchronizeShapes(b2Body *body)
 	b2Mat22_SetAngle(&R0, body->m_rotation0);
 	for (b2Shape* s = body->m_shapeList; s; s = s->m_next)
 	{
-		s->Synchronize(s, body->m_position0, &R0, body->m_position, &body->m_R);
+		s->Synchronize(s, body->m_position0, &R0, body->m_state->position, &body->m_state->R);
 	}
 }
 
 void b2Body_Freeze(b2Body *body)
 {
-	body->m_flags |= b2Body_e_frozenFlag;
-	b2Vec2_SetZero(&body->m_linearVelocity);
-	body->m_angularVelocity = 0.0;
+	body->m_state->flags |= b2Body_e_frozenFlag;
+	b2Vec2_SetZero(&body->m_state->linearVelocity);
+	body->m_state->angularVelocity = 0.0;
 	for (b2Shape* s = body->m_shapeList; s; s = s->m_next)
 	{
 		b2Shape_DestroyProxy(s);
 	}
 }
+
+void b2Body_SleepChanged(b2Body *body)
+{
+	b2BodyState* state = body->m_state;
+	b2ContactManager* manager = &body->m_world->m_contactManager;
+	if (state->flags & b2Body_e_sleepChangedFlag)
+	{
+		return;
+	}
+
+	// The bodies b2World_CleanBodyList frees take their contacts along.
+	if ((state->flags & b2Body_e_destroyFlag) && manager->m_destroyImmediate)
+	{
+		return;
+	}
+
+	state->flags |= b2Body_e_sleepChangedFlag;
+	body->m_sleepChangedNext = manager->m_sleepChangedList;
+	manager->m_sleepChangedList = body;
+}
@@ -27,44 +27,18 @@
 #include <box2d/b2Body.h>
 #include <box2d/b2CMath.h>
 
-static b2ContactRegister s_registers[e_shapeTypeCount][e_shapeTypeCount];
-static bool s_initialized = false;
-
-static void AddType(b2ContactCreateFcn* createFcn,
-		    b2ContactDestroyFcn* destoryFcn,
-		    b2ShapeType type1, b2ShapeType type2);
-
-static void InitializeRegisters()
-{
-	AddType(b2CircleContact_Create, b2CircleContact_Destroy, e_circleShape, e_circleShape);
-	AddType(b2PolyAndCircleContact_Create, b2PolyAndCircleContact_Destroy, e_polyShape, e_circleShape);
-	AddType(b2PolyContact_Create, b2PolyContact_Destroy, e_polyShape, e_polyShape);
-}
-
-static void AddType(b2ContactCreateFcn* createFcn,
-		    b2ContactDestroyFcn* destoryFcn,
-		    b2ShapeType type1, b2ShapeType type2)
+// The contact factory is immutable so that worlds on different threads
+// can create contacts without synchronisation.
+static const b2ContactRegister s_registers[e_shapeTypeCount][e_shapeTypeCount] =
 {
-	s_registers[type1][type2].createFcn = createFcn;
-	s_registers[type1][type2].destroyFcn = destoryFcn;
-	s_registers[type1][type2].primary = true;
-
-	if (type1 != type2)
-	{
-		s_registers[type2][type1].createFcn = createFcn;
-		s_registers[type2][type1].destroyFcn = destoryFcn;
-		s_registers[type2][type1].primary = false;
-	}
-}
+	[e_circleShape][e_circleShape] = { b2CircleContact_Create, b2CircleContact_Destroy, true },
+	[e_polyShape][e_circleShape] = { b2PolyAndCircleContact_Create, b2PolyAndCircleContact_Destroy, true },
+	[e_circleShape][e_polyShape] = { b2PolyAndCircleContact_Create, b2PolyAndCircleContact_Destroy, false },
+	[e_polyShape][e_polyShape] = { b2PolyContact_Create, b2PolyContact_Destroy, true },
+};
 
 b2Contact* b2Contact_Create(b2Shape* shape1, b2Shape* shape2, b2BlockAllocator* allocator)
 {
-	if (s_initialized == false)
-	{
-		InitializeRegisters();
-		s_initialized = true;
-	}
-
 	b2ShapeType type1 = shape1->m_type;
 	b2ShapeType type2 = shape2->m_type;
 
@@ -110,9 +84,12 @@ void b2Contact_Destroy(b2Contact* contact, b2BlockAllocator* allocator)
 void b2Contact_ctor(b2Contact *contact, b2Shape* s1, b2Shape* s2)
 {
 	contact->m_flags = 0;
+	contact->m_islandStamp = 0;
 
 	contact->m_shape1 = s1;
 	contact->m_shape2 = s2;
+	contact->m_islandIndex1 = 0;
+	contact->m_islandIndex2 = 0;
 
 	contact->m_manifoldCount = 0;
 
@@ -120,6 +97,9 @@ void b2Contact_ctor(b2Contact *contact, b2Shape* s1, b2Shape* s2)
 	contact->m_restitution = b2Max(contact->m_shape1->m_restitution, contact->m_shape2->m_restitution);
 	contact->m_prev = NULL;
 	contact->m_next = NULL;
+	contact->m_listPrev = NULL;
+	contact->m_listNext = NULL;
+	contact->m_serial = 0;
 
 	contact->m_node1.contact = NULL;
 	contact->m_node1.prev = NULL;
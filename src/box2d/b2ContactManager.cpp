@@ -23,6 +23,38 @@
 
 static void b2ContactManager_DestroyContact(b2ContactManager *manager, b2Contact* c);
 
+static void b2ContactManager_PushFront(b2Contact** list, b2Contact* c)
+{
+	c->m_listPrev = NULL;
+	c->m_listNext = *list;
+	if (*list != NULL)
+	{
+		(*list)->m_listPrev = c;
+	}
+	*list = c;
+}
+
+static void b2ContactManager_Unlink(b2Contact** list, b2Contact* c)
+{
+	if (c->m_listPrev)
+	{
+		c->m_listPrev->m_listNext = c->m_listNext;
+	}
+
+	if (c->m_listNext)
+	{
+		c->m_listNext->m_listPrev = c->m_listPrev;
+	}
+
+	if (c == *list)
+	{
+		*list = c->m_listNext;
+	}
+
+	c->m_listPrev = NULL;
+	c->m_listNext = NULL;
+}
+
 // This is a callback from the broadphase when two AABB proxies begin
 // to overlap. We create a b2Contact to manage the narrow phase.
 void* b2ContactManager_PairAdded(b2PairCallback *callback, void* proxyUserData1, void* proxyUserData2)
@@ -55,7 +87,7 @@ void* b2ContactManager_PairAdded(b2PairCallback *callback, void* proxyUserData1,
 	}
 
 	// Ensure that body2 is dynamic (body1 is static or dynamic).
-	if (body2->m_invMass == 0.0)
+	if (body2->m_state->invMass == 0.0)
 	{
 		b2Swap(shape1, shape2);
 		b2Swap(body1, body2);
@@ -79,6 +111,10 @@ void* b2ContactManager_PairAdded(b2PairCallback *callback, void* proxyUserData1,
 		}
 		manager->m_world->m_contactList = contact;
 		++manager->m_world->m_contactCount;
+
+		// The newest contact comes first in both lists.
+		contact->m_serial = manager->m_contactSerial++;
+		b2ContactManager_PushFront(&manager->m_awakeList, contact);
 	}
 
 	return contact;
@@ -130,6 +166,15 @@ static void b2ContactManager_DestroyContact(b2ContactManager *manager, b2Contact
 		manager->m_world->m_contactList = c->m_next;
 	}
 
+	if (c->m_flags & b2Contact_e_sleepFlag)
+	{
+		b2ContactManager_Unlink(&manager->m_sleepingList, c);
+	}
+	else
+	{
+		b2ContactManager_Unlink(&manager->m_awakeList, c);
+	}
+
 	// If there are contact points, then disconnect from the island graph.
 	if (c->m_manifoldCount > 0)
 	{
@@ -201,97 +246,310 @@ void b2ContactManager_CleanContactList(b2ContactManager *manager)
 	}
 }
 
-// This is the top level collision call for the time step. Here
-// all the narrow phase collision is processed for the world
-// contact list.
-void b2ContactManager_Collide(b2ContactManager *manager)
+// Run the narrow phase on one contact and connect it to or disconnect
+// it from the island graph when it starts or stops touching.
+static void b2ContactManager_Update(b2Contact* c)
 {
-	for (b2Contact* c = manager->m_world->m_contactList; c; c = c->m_next)
+	int32 oldCount = c->m_manifoldCount;
+	c->Evaluate(c);
+
+	int32 newCount = c->m_manifoldCount;
+
+	if (oldCount == 0 && newCount > 0)
 	{
-		if (b2Body_IsSleeping(c->m_shape1->m_body) &&
-			b2Body_IsSleeping(c->m_shape2->m_body))
+		// Connect to island graph.
+		b2Body* body1 = c->m_shape1->m_body;
+		b2Body* body2 = c->m_shape2->m_body;
+
+		// Connect to body 1
+		c->m_node1.contact = c;
+		c->m_node1.other = body2;
+
+		c->m_node1.prev = NULL;
+		c->m_node1.next = body1->m_contactList;
+		if (c->m_node1.next != NULL)
 		{
-			continue;
+			c->m_node1.next->prev = &c->m_node1;
 		}
+		body1->m_contactList = &c->m_node1;
 
-		int32 oldCount = c->m_manifoldCount;
-		c->Evaluate(c);
+		// Connect to body 2
+		c->m_node2.contact = c;
+		c->m_node2.other = body1;
 
-		int32 newCount = c->m_manifoldCount;
+		c->m_node2.prev = NULL;
+		c->m_node2.next = body2->m_contactList;
+		if (c->m_node2.next != NULL)
+		{
+			c->m_node2.next->prev = &c->m_node2;
+		}
+		body2->m_contactList = &c->m_node2;
+	}
+	else if (oldCount > 0 && newCount == 0)
+	{
+		// Disconnect from island graph.
+		b2Body* body1 = c->m_shape1->m_body;
+		b2Body* body2 = c->m_shape2->m_body;
 
-		if (oldCount == 0 && newCount > 0)
+		// Remove from body 1
+		if (c->m_node1.prev)
 		{
-			// Connect to island graph.
-			b2Body* body1 = c->m_shape1->m_body;
-			b2Body* body2 = c->m_shape2->m_body;
+			c->m_node1.prev->next = c->m_node1.next;
+		}
 
-			// Connect to body 1
-			c->m_node1.contact = c;
-			c->m_node1.other = body2;
+		if (c->m_node1.next)
+		{
+			c->m_node1.next->prev = c->m_node1.prev;
+		}
 
-			c->m_node1.prev = NULL;
-			c->m_node1.next = body1->m_contactList;
-			if (c->m_node1.next != NULL)
-			{
-				c->m_node1.next->prev = &c->m_node1;
-			}
-			body1->m_contactList = &c->m_node1;
+		if (&c->m_node1 == body1->m_contactList)
+		{
+			body1->m_contactList = c->m_node1.next;
+		}
 
-			// Connect to body 2
-			c->m_node2.contact = c;
-			c->m_node2.other = body1;
+		c->m_node1.prev = NULL;
+		c->m_node1.next = NULL;
 
-			c->m_node2.prev = NULL;
-			c->m_node2.next = body2->m_contactList;
-			if (c->m_node2.next != NULL)
-			{
-				c->m_node2.next->prev = &c->m_node2;
-			}
-			body2->m_contactList = &c->m_node2;
+		// Remove from body 2
+		if (c->m_node2.prev)
+		{
+			c->m_node2.prev->next = c->m_node2.next;
 		}
-		else if (oldCount > 0 && newCount == 0)
+
+		if (c->m_node2.next)
 		{
-			// Disconnect from island graph.
-			b2Body* body1 = c->m_shape1->m_body;
-			b2Body* body2 = c->m_shape2->m_body;
+			c->m_node2.next->prev = c->m_node2.prev;
+		}
 
-			// Remove from body 1
-			if (c->m_node1.prev)
-			{
-				c->m_node1.prev->next = c->m_node1.next;
-			}
+		if (&c->m_node2 == body2->m_contactList)
+		{
+			body2->m_contactList = c->m_node2.next;
+		}
 
-			if (c->m_node1.next)
-			{
-				c->m_node1.next->prev = c->m_node1.prev;
-			}
+		c->m_node2.prev = NULL;
+		c->m_node2.next = NULL;
+	}
+}
 
-			if (&c->m_node1 == body1->m_contactList)
-			{
-				body1->m_contactList = c->m_node1.next;
-			}
+// Merge sort on m_listNext, newest contact first.
+static b2Contact* b2ContactManager_SortBySerial(b2Contact* list)
+{
+	if (list == NULL || list->m_listNext == NULL)
+	{
+		return list;
+	}
 
-			c->m_node1.prev = NULL;
-			c->m_node1.next = NULL;
+	b2Contact* middle = list;
+	for (b2Contact* c = list->m_listNext; c && c->m_listNext; c = c->m_listNext->m_listNext)
+	{
+		middle = middle->m_listNext;
+	}
 
-			// Remove from body 2
-			if (c->m_node2.prev)
-			{
-				c->m_node2.prev->next = c->m_node2.next;
-			}
+	b2Contact* a = middle->m_listNext;
+	middle->m_listNext = NULL;
+	a = b2ContactManager_SortBySerial(a);
+	b2Contact* b = b2ContactManager_SortBySerial(list);
 
-			if (c->m_node2.next)
+	b2Contact* head = NULL;
+	b2Contact** tail = &head;
+	while (a && b)
+	{
+		b2Contact** first = a->m_serial > b->m_serial ? &a : &b;
+		*tail = *first;
+		tail = &(*first)->m_listNext;
+		*first = (*first)->m_listNext;
+	}
+	*tail = a ? a : b;
+
+	return head;
+}
+
+// A touching contact is parked in the sleeping list while both of its
+// bodies sleep. Each body records the sleep flag its contacts were last
+// sorted by, so a body that fell asleep and woke up again since the last
+// sync costs nothing. Woken contacts are merged back into the awake list
+// by serial, which keeps it in world list order.
+void b2ContactManager_SyncSleep(b2ContactManager *manager)
+{
+	b2Contact* woken = NULL;
+
+	b2Body* b = manager->m_sleepChangedList;
+	manager->m_sleepChangedList = NULL;
+	while (b)
+	{
+		b2Body* b0 = b;
+		b = b->m_sleepChangedNext;
+		b0->m_sleepChangedNext = NULL;
+
+		b2BodyState* state = b0->m_state;
+		state->flags &= ~b2Body_e_sleepChangedFlag;
+
+		bool sleeping = (state->flags & b2Body_e_sleepFlag) != 0;
+		bool synced = (state->flags & b2Body_e_contactSleepFlag) != 0;
+		if (sleeping == synced)
+		{
+			continue;
+		}
+
+		state->flags ^= b2Body_e_contactSleepFlag;
+
+		for (b2ContactNode* cn = b0->m_contactList; cn; cn = cn->next)
+		{
+			b2Contact* c = cn->contact;
+			bool asleep = sleeping && b2Body_IsSleeping(cn->other);
+			bool parked = (c->m_flags & b2Contact_e_sleepFlag) != 0;
+
+			if (asleep && !parked)
 			{
-				c->m_node2.next->prev = c->m_node2.prev;
+				b2ContactManager_Unlink(&manager->m_awakeList, c);
+				b2ContactManager_PushFront(&manager->m_sleepingList, c);
+				c->m_flags |= b2Contact_e_sleepFlag;
 			}
-
-			if (&c->m_node2 == body2->m_contactList)
+			else if (!asleep && parked)
 			{
-				body2->m_contactList = c->m_node2.next;
+				b2ContactManager_Unlink(&manager->m_sleepingList, c);
+				c->m_flags &= ~b2Contact_e_sleepFlag;
+				c->m_listNext = woken;
+				woken = c;
 			}
+		}
+	}
+
+	woken = b2ContactManager_SortBySerial(woken);
 
-			c->m_node2.prev = NULL;
-			c->m_node2.next = NULL;
+	b2Contact* prev = NULL;
+	b2Contact* c = manager->m_awakeList;
+	while (woken)
+	{
+		if (c && c->m_serial > woken->m_serial)
+		{
+			prev = c;
+			c = c->m_listNext;
+			continue;
+		}
+
+		b2Contact* w = woken;
+		woken = woken->m_listNext;
+
+		w->m_listPrev = prev;
+		w->m_listNext = c;
+		if (prev)
+		{
+			prev->m_listNext = w;
+		}
+		else
+		{
+			manager->m_awakeList = w;
+		}
+		if (c)
+		{
+			c->m_listPrev = w;
+		}
+		prev = w;
+	}
+}
+
+void b2ContactManager_ResetSleep(b2ContactManager *manager)
+{
+	b2World* world = manager->m_world;
+
+	manager->m_awakeList = NULL;
+	manager->m_sleepingList = NULL;
+	manager->m_sleepChangedList = NULL;
+
+	for (int32 i = 0; i < world->m_bodyStateCount; ++i)
+	{
+		b2BodyState* state = world->m_bodyStates + i;
+		state->body->m_sleepChangedNext = NULL;
+		state->flags &= ~(b2Body_e_sleepChangedFlag | b2Body_e_contactSleepFlag);
+		if (state->flags & b2Body_e_sleepFlag)
+		{
+			state->flags |= b2Body_e_contactSleepFlag;
 		}
 	}
+
+	manager->m_contactSerial = world->m_contactCount;
+
+	uint64 serial = manager->m_contactSerial;
+	b2Contact* tail = NULL;
+	for (b2Contact* c = world->m_contactList; c; c = c->m_next)
+	{
+		c->m_serial = --serial;
+
+		if (c->m_manifoldCount > 0 &&
+			b2Body_IsSleeping(c->m_shape1->m_body) &&
+			b2Body_IsSleeping(c->m_shape2->m_body))
+		{
+			c->m_flags |= b2Contact_e_sleepFlag;
+			b2ContactManager_PushFront(&manager->m_sleepingList, c);
+			continue;
+		}
+
+		c->m_flags &= ~b2Contact_e_sleepFlag;
+		c->m_listPrev = tail;
+		c->m_listNext = NULL;
+		if (tail)
+		{
+			tail->m_listNext = c;
+		}
+		else
+		{
+			manager->m_awakeList = c;
+		}
+		tail = c;
+	}
+}
+
+// This is the top level collision call for the time step. Here
+// all the narrow phase collision is processed for the awake
+// contacts. Returns the number of contacts evaluated.
+int32 b2ContactManager_Collide(b2ContactManager *manager)
+{
+	int32 evaluated = 0;
+
+	b2ContactManager_SyncSleep(manager);
+
+	for (b2Contact* c = manager->m_awakeList; c; c = c->m_listNext)
+	{
+		if (b2Body_IsSleeping(c->m_shape1->m_body) &&
+			b2Body_IsSleeping(c->m_shape2->m_body))
+		{
+			continue;
+		}
+
+		b2ContactManager_Update(c);
+		++evaluated;
+	}
+
+	return evaluated;
+}
+
+// Like Collide, but only evaluates the contacts with a shape for which
+// filter returns true. The other contacts keep their last manifolds.
+int32 b2ContactManager_CollideFiltered(b2ContactManager *manager,
+				       bool (*filter)(b2Shape* shape, void* data),
+				       void* data)
+{
+	int32 evaluated = 0;
+
+	b2ContactManager_SyncSleep(manager);
+
+	for (b2Contact* c = manager->m_awakeList; c; c = c->m_listNext)
+	{
+		if (b2Body_IsSleeping(c->m_shape1->m_body) &&
+			b2Body_IsSleeping(c->m_shape2->m_body))
+		{
+			continue;
+		}
+
+		if (!filter(c->m_shape1, data) && !filter(c->m_shape2, data))
+		{
+			continue;
+		}
+
+		b2ContactManager_Update(c);
+		++evaluated;
+	}
+
+	return evaluated;
 }
\ No newline at end of file
@@ -20,11 +20,13 @@
 #include <box2d/b2Contact.h>
 #include <box2d/b2Body.h>
 #include <box2d/b2World.h>
+#include <box2d/b2Island.h>
 #include <box2d/b2StackAllocator.h>
 
-void b2ContactSolver_ctor(b2ContactSolver *solver, b2Contact** contacts, int32 contactCount, b2StackAllocator* allocator)
+void b2ContactSolver_ctor(b2ContactSolver *solver, b2Contact** contacts, int32 contactCount, b2SolverData* data, b2StackAllocator* allocator)
 {
 	solver->m_allocator = allocator;
+	solver->m_data = data;
 
 	solver->m_constraintCount = 0;
 	for (int32 i = 0; i < contactCount; ++i)
@@ -38,17 +40,25 @@ void b2ContactSolver_ctor(b2ContactSolver *solver, b2Contact** contacts, int32 c
 	for (int32 i = 0; i < contactCount; ++i)
 	{
 		b2Contact* contact = contacts[i];
-		b2Body* b1 = contact->m_shape1->m_body;
-		b2Body* b2 = contact->m_shape2->m_body;
+		int32 index1 = contact->m_islandIndex1;
+		int32 index2 = contact->m_islandIndex2;
 		int32 manifoldCount = contact->m_manifoldCount;
 		b2Manifold* manifolds = contact->GetManifolds(contact);
 		float64 friction = contact->m_friction;
 		float64 restitution = contact->m_restitution;
 
-		b2Vec2 v1 = b1->m_linearVelocity;
-		b2Vec2 v2 = b2->m_linearVelocity;
-		float64 w1 = b1->m_angularVelocity;
-		float64 w2 = b2->m_angularVelocity;
+		b2Vec2 x1 = data->positions[index1];
+		b2Vec2 x2 = data->positions[index2];
+		b2Mat22 R1 = data->Rs[index1];
+		b2Mat22 R2 = data->Rs[index2];
+		b2Vec2 v1 = data->linearVelocities[index1];
+		b2Vec2 v2 = data->linearVelocities[index2];
+		float64 w1 = data->angularVelocities[index1];
+		float64 w2 = data->angularVelocities[index2];
+		float64 invMass1 = data->invMasses[index1];
+		float64 invMass2 = data->invMasses[index2];
+		float64 invI1 = data->invIs[index1];
+		float64 invI2 = data->invIs[index2];
 
 		for (int32 j = 0; j < manifoldCount; ++j)
 		{
@@ -57,8 +67,8 @@ void b2ContactSolver_ctor(b2ContactSolver *solver, b2Contact** contacts, int32 c
 			const b2Vec2 normal = manifold->normal;
 
 			b2ContactConstraint* c = solver->m_constraints + count;
-			c->body1 = b1;
-			c->body2 = b2;
+			c->index1 = index1;
+			c->index2 = index2;
 			c->manifold = manifold;
 			c->normal = normal;
 			c->pointCount = manifold->pointCount;
@@ -76,27 +86,27 @@ void b2ContactSolver_ctor(b2ContactSolver *solver, b2Contact** contacts, int32 c
 				unsigned long long dupa = 0x7fffffffe0000000LLU;
 				ccp->positionImpulse = *(double *)&dupa;
 
-				b2Vec2 r1 = cp->position - b1->m_position;
-				b2Vec2 r2 = cp->position - b2->m_position;
+				b2Vec2 r1 = cp->position - x1;
+				b2Vec2 r2 = cp->position - x2;
 
-				ccp->localAnchor1 = b2MulT(b1->m_R, r1);
-				ccp->localAnchor2 = b2MulT(b2->m_R, r2);
+				ccp->localAnchor1 = b2MulT(R1, r1);
+				ccp->localAnchor2 = b2MulT(R2, r2);
 
 				float64 r1Sqr = b2Dot(r1, r1);
 				float64 r2Sqr = b2Dot(r2, r2);
 
 				float64 rn1 = b2Dot(r1, normal);
 				float64 rn2 = b2Dot(r2, normal);
-				float64 kNormal = b1->m_invMass + b2->m_invMass;
-				kNormal += b1->m_invI * (r1Sqr - rn1 * rn1) + b2->m_invI * (r2Sqr - rn2 * rn2);
+				float64 kNormal = invMass1 + invMass2;
+				kNormal += invI1 * (r1Sqr - rn1 * rn1) + invI2 * (r2Sqr - rn2 * rn2);
 				ccp->normalMass = 1.0 / kNormal;
 
 				b2Vec2 tangent = b2Cross(normal, 1.0);
 
 				float64 rt1 = b2Dot(r1, tangent);
 				float64 rt2 = b2Dot(r2, tangent);
-				float64 kTangent = b1->m_invMass + b2->m_invMass;
-				kTangent += b1->m_invI * (r1Sqr - rt1 * rt1) + b2->m_invI * (r2Sqr - rt2 * rt2);
+				float64 kTangent = invMass1 + invMass2;
+				kTangent += invI1 * (r1Sqr - rt1 * rt1) + invI2 * (r2Sqr - rt2 * rt2);
 				ccp->tangentMass = 1.0 /  kTangent;
 
 				// Setup a velocity bias for restitution.
@@ -123,37 +133,51 @@ void b2ContactSolver_dtor(b2ContactSolver *solver)
 	b2StackAllocator_Free(solver->m_allocator, solver->m_constraints);
 }
 
-void b2ContactSolver_PreSolve(b2ContactSolver *solver)
+void b2ContactSolver_PreSolve(b2ContactSolver *solver, const b2TimeStep* step)
 {
+	b2SolverData* data = solver->m_data;
+
 	// Warm start.
 	for (int32 i = 0; i < solver->m_constraintCount; ++i)
 	{
 		b2ContactConstraint* c = solver->m_constraints + i;
 
-		b2Body* b1 = c->body1;
-		b2Body* b2 = c->body2;
-		float64 invMass1 = b1->m_invMass;
-		float64 invI1 = b1->m_invI;
-		float64 invMass2 = b2->m_invMass;
-		float64 invI2 = b2->m_invI;
+		int32 index1 = c->index1;
+		int32 index2 = c->index2;
+		float64 invMass1 = data->invMasses[index1];
+		float64 invI1 = data->invIs[index1];
+		float64 invMass2 = data->invMasses[index2];
+		float64 invI2 = data->invIs[index2];
 		b2Vec2 normal = c->normal;
 		b2Vec2 tangent = b2Cross(normal, 1.0);
 
-		if (b2World_s_enableWarmStarting)
+		if (step->warmStarting)
 		{
+			b2Mat22 R1 = data->Rs[index1];
+			b2Mat22 R2 = data->Rs[index2];
+			b2Vec2 v1 = data->linearVelocities[index1];
+			b2Vec2 v2 = data->linearVelocities[index2];
+			float64 w1 = data->angularVelocities[index1];
+			float64 w2 = data->angularVelocities[index2];
+
 			for (int32 j = 0; j < c->pointCount; ++j)
 			{
 				b2ContactConstraintPoint* ccp = c->points + j;
 				b2Vec2 P = ccp->normalImpulse * normal + ccp->tangentImpulse * tangent;
-				b2Vec2 r1 = b2Mul(b1->m_R, ccp->localAnchor1);
-				b2Vec2 r2 = b2Mul(b2->m_R, ccp->localAnchor2);
-				b1->m_angularVelocity -= invI1 * b2Cross(r1, P);
-				b1->m_linearVelocity -= invMass1 * P;
-				b2->m_angularVelocity += invI2 * b2Cross(r2, P);
-				b2->m_linearVelocity += invMass2 * P;
+				b2Vec2 r1 = b2Mul(R1, ccp->localAnchor1);
+				b2Vec2 r2 = b2Mul(R2, ccp->localAnchor2);
+				w1 -= invI1 * b2Cross(r1, P);
+				v1 -= invMass1 * P;
+				w2 += invI2 * b2Cross(r2, P);
+				v2 += invMass2 * P;
 
 				ccp->positionImpulse = 0.0;
 			}
+
+			data->linearVelocities[index1] = v1;
+			data->linearVelocities[index2] = v2;
+			data->angularVelocities[index1] = w1;
+			data->angularVelocities[index2] = w2;
 		}
 		else
 		{
@@ -171,29 +195,38 @@ void b2ContactSolver_PreSolve(b2ContactSolver *solver)
 
 void b2ContactSolver_SolveVelocityConstraints(b2ContactSolver *solver)
 {
+	b2SolverData* data = solver->m_data;
+
 	for (int32 i = 0; i < solver->m_constraintCount; ++i)
 	{
 		b2ContactConstraint* c = solver->m_constraints + i;
-		b2Body* b1 = c->body1;
-		b2Body* b2 = c->body2;
-		float64 invMass1 = b1->m_invMass;
-		float64 invI1 = b1->m_invI;
-		float64 invMass2 = b2->m_invMass;
-		float64 invI2 = b2->m_invI;
+		int32 index1 = c->index1;
+		int32 index2 = c->index2;
+		float64 invMass1 = data->invMasses[index1];
+		float64 invI1 = data->invIs[index1];
+		float64 invMass2 = data->invMasses[index2];
+		float64 invI2 = data->invIs[index2];
 		b2Vec2 normal = c->normal;
 		b2Vec2 tangent = b2Cross(normal, 1.0);
 
+		b2Mat22 R1 = data->Rs[index1];
+		b2Mat22 R2 = data->Rs[index2];
+		b2Vec2 v1 = data->linearVelocities[index1];
+		b2Vec2 v2 = data->linearVelocities[index2];
+		float64 w1 = data->angularVelocities[index1];
+		float64 w2 = data->angularVelocities[index2];
+
 		// Solver normal constraints
 		for (int32 j = 0; j < c->pointCount; ++j)
 		{
 		{
 			b2ContactConstraintPoint* ccp = c->points + j;
 
-			b2Vec2 r1 = b2Mul(b1->m_R, ccp->localAnchor1);
-			b2Vec2 r2 = b2Mul(b2->m_R, ccp->localAnchor2);
+			b2Vec2 r1 = b2Mul(R1, ccp->localAnchor1);
+			b2Vec2 r2 = b2Mul(R2, ccp->localAnchor2);
 
 			// Relative velocity at contact
-			b2Vec2 dv = b2->m_linearVelocity + b2Cross(b2->m_angularVelocity, r2) - b1->m_linearVelocity - b2Cross(b1->m_angularVelocity, r1);
+			b2Vec2 dv = v2 + b2Cross(w2, r2) - v1 - b2Cross(w1, r1);
 
 			// Compute normal impulse
 			float64 vn = b2Dot(dv, normal);
@@ -206,11 +239,11 @@ void b2ContactSolver_SolveVelocityConstraints(b2ContactSolver *solver)
 			// Apply contact impulse
 			b2Vec2 P = lambda * normal;
 
-			b1->m_linearVelocity -= invMass1 * P;
-			b1->m_angularVelocity -= invI1 * b2Cross(r1, P);
+			v1 -= invMass1 * P;
+			w1 -= invI1 * b2Cross(r1, P);
 
-			b2->m_linearVelocity += invMass2 * P;
-			b2->m_angularVelocity += invI2 * b2Cross(r2, P);
+			v2 += invMass2 * P;
+			w2 += invI2 * b2Cross(r2, P);
 
 			ccp->normalImpulse = newImpulse;
 		}
@@ -219,11 +252,11 @@ void b2ContactSolver_SolveVelocityConstraints(b2ContactSolver *solver)
 		{
 			b2ContactConstraintPoint* ccp = c->points + j;
 
-			b2Vec2 r1 = b2Mul(b1->m_R, ccp->localAnchor1);
-			b2Vec2 r2 = b2Mul(b2->m_R, ccp->localAnchor2);
+			b2Vec2 r1 = b2Mul(R1, ccp->localAnchor1);
+			b2Vec2 r2 = b2Mul(R2, ccp->localAnchor2);
 
 			// Relative velocity at contact
-			b2Vec2 dv = b2->m_linearVelocity + b2Cross(b2->m_angularVelocity, r2) - b1->m_linearVelocity - b2Cross(b1->m_angularVelocity, r1);
+			b2Vec2 dv = v2 + b2Cross(w2, r2) - v1 - b2Cross(w1, r1);
 
 			// Compute tangent impulse
 			float64 vt = b2Dot(dv, tangent);
@@ -237,44 +270,57 @@ void b2ContactSolver_SolveVelocityConstraints(b2ContactSolver *solver)
 			// Apply contact impulse
 			b2Vec2 P = lambda * tangent;
 
-			b1->m_linearVelocity -= invMass1 * P;
-			b1->m_angularVelocity -= invI1 * b2Cross(r1, P);
+			v1 -= invMass1 * P;
+			w1 -= invI1 * b2Cross(r1, P);
 
-			b2->m_linearVelocity += invMass2 * P;
-			b2->m_angularVelocity += invI2 * b2Cross(r2, P);
+			v2 += invMass2 * P;
+			w2 += invI2 * b2Cross(r2, P);
 
 			ccp->tangentImpulse = newImpulse;
 		}
 		}
+
+		data->linearVelocities[index1] = v1;
+		data->linearVelocities[index2] = v2;
+		data->angularVelocities[index1] = w1;
+		data->angularVelocities[index2] = w2;
 	}
 }
 
 bool b2ContactSolver_SolvePositionConstraints(b2ContactSolver *solver, float64 beta)
 {
+	b2SolverData* data = solver->m_data;
 	float64 minSeparation = 0.0;
 
 	for (int32 i = 0; i < solver->m_constraintCount; ++i)
 	{
 		b2ContactConstraint* c = solver->m_constraints + i;
-		b2Body* b1 = c->body1;
-		b2Body* b2 = c->body2;
-		float64 invMass1 = b1->m_invMass;
-		float64 invI1 = b1->m_invI;
-		float64 invMass2 = b2->m_invMass;
-		float64 invI2 = b2->m_invI;
+		int32 index1 = c->index1;
+		int32 index2 = c->index2;
+		float64 invMass1 = data->invMasses[index1];
+		float64 invI1 = data->invIs[index1];
+		float64 invMass2 = data->invMasses[index2];
+		float64 invI2 = data->invIs[index2];
 		b2Vec2 normal = c->normal;
 		b2Vec2 tangent = b2Cross(normal, 1.0);
 
+		b2Vec2 x1 = data->positions[index1];
+		b2Vec2 x2 = data->positions[index2];
+		float64 a1 = data->rotations[index1];
+		float64 a2 = data->rotations[index2];
+		b2Mat22 R1 = data->Rs[index1];
+		b2Mat22 R2 = data->Rs[index2];
+
 		// Solver normal constraints
 		for (int32 j = 0; j < c->pointCount; ++j)
 		{
 			b2ContactConstraintPoint* ccp = c->points + j;
 
-			b2Vec2 r1 = b2Mul(b1->m_R, ccp->localAnchor1);
-			b2Vec2 r2 = b2Mul(b2->m_R, ccp->localAnchor2);
+			b2Vec2 r1 = b2Mul(R1, ccp->localAnchor1);
+			b2Vec2 r2 = b2Mul(R2, ccp->localAnchor2);
 
-			b2Vec2 p1 = b1->m_position + r1;
-			b2Vec2 p2 = b2->m_position + r2;
+			b2Vec2 p1 = x1 + r1;
+			b2Vec2 p2 = x2 + r2;
 			b2Vec2 dp = p2 - p1;
 
 			// Approximate the current separation.
@@ -296,14 +342,21 @@ bool b2ContactSolver_SolvePositionConstraints(b2ContactSolver *solver, float64 b
 
 			b2Vec2 impulse = dImpulse * normal;
 
-			b1->m_position -= invMass1 * impulse;
-			b1->m_rotation -= invI1 * b2Cross(r1, impulse);
-			b2Mat22_SetAngle(&b1->m_R, b1->m_rotation);
+			x1 -= invMass1 * impulse;
+			a1 -= invI1 * b2Cross(r1, impulse);
+			b2Mat22_SetAngle(&R1, a1);
 
-			b2->m_position += invMass2 * impulse;
-			b2->m_rotation += invI2 * b2Cross(r2, impulse);
-			b2Mat22_SetAngle(&b2->m_R, b2->m_rotation);
+			x2 += invMass2 * impulse;
+			a2 += invI2 * b2Cross(r2, impulse);
+			b2Mat22_SetAngle(&R2, a2);
 		}
+
+		data->positions[index1] = x1;
+		data->positions[index2] = x2;
+		data->rotations[index1] = a1;
+		data->rotations[index2] = a2;
+		data->Rs[index1] = R1;
+		data->Rs[index2] = R2;
 	}
 
 	return minSeparation >= -b2_linearSlop;
@@ -23,6 +23,7 @@
 #include <box2d/b2ContactSolver.h>
 #include <box2d/b2Joint.h>
 #include <box2d/b2StackAllocator.h>
+#include <box2d/b2Timer.h>
 
 /*
 Position Correction Notes
@@ -117,6 +118,8 @@ void b2Island_ctor(b2Island *island, int32 bodyCapacity, int32 contactCapacity,
 	island->m_joints = (b2Joint**)b2StackAllocator_Allocate(allocator, jointCapacity * sizeof(b2Joint*));
 
 	island->m_allocator = allocator;
+	island->m_positionIterations = 0;
+	island->m_profile = NULL;
 }
 
 void b2Island_dtor(b2Island *island)
@@ -134,35 +137,89 @@ void b2Island_Clear(b2Island *island)
 	island->m_jointCount = 0;
 }
 
+// A static body can be in several islands, and its m_islandIndex is only
+// its slot in the island built last. Copy the slots to the contacts and
+// joints as soon as the island is built, while they still refer to it.
+void b2Island_IndexConstraints(b2Island *island)
+{
+	for (int32 i = 0; i < island->m_contactCount; ++i)
+	{
+		b2Contact* c = island->m_contacts[i];
+		c->m_islandIndex1 = c->m_shape1->m_body->m_islandIndex;
+		c->m_islandIndex2 = c->m_shape2->m_body->m_islandIndex;
+	}
+
+	for (int32 i = 0; i < island->m_jointCount; ++i)
+	{
+		b2Joint* j = island->m_joints[i];
+		j->m_islandIndex1 = j->m_body1->m_islandIndex;
+		j->m_islandIndex2 = j->m_body2->m_islandIndex;
+	}
+}
+
 void b2Island_Solve(b2Island *island, const b2TimeStep* step, const b2Vec2& gravity)
 {
-	for (int32 i = 0; i < island->m_bodyCount; ++i)
+	b2Profile* profile = island->m_profile;
+	b2Timer timer;
+	if (profile)
+	{
+		b2Timer_ctor(&timer);
+	}
+
+	int32 count = island->m_bodyCount;
+	b2SolverData data;
+	data.positions = (b2Vec2*)b2StackAllocator_Allocate(island->m_allocator, count * sizeof(b2Vec2));
+	data.rotations = (float64*)b2StackAllocator_Allocate(island->m_allocator, count * sizeof(float64));
+	data.Rs = (b2Mat22*)b2StackAllocator_Allocate(island->m_allocator, count * sizeof(b2Mat22));
+	data.linearVelocities = (b2Vec2*)b2StackAllocator_Allocate(island->m_allocator, count * sizeof(b2Vec2));
+	data.angularVelocities = (float64*)b2StackAllocator_Allocate(island->m_allocator, count * sizeof(float64));
+	data.invMasses = (float64*)b2StackAllocator_Allocate(island->m_allocator, count * sizeof(float64));
+	data.invIs = (float64*)b2StackAllocator_Allocate(island->m_allocator, count * sizeof(float64));
+
+	for (int32 i = 0; i < count; ++i)
 	{
 		b2Body* b = island->m_bodies[i];
+		b2BodyState* state = b->m_state;
 
-		if (b->m_invMass == 0.0)
-			continue;
+		b2Vec2 v = state->linearVelocity;
+		float64 w = state->angularVelocity;
+
+		if (state->invMass != 0.0)
+		{
+			v += step->dt * (gravity + state->invMass * b->m_force);
+			w += step->dt * state->invI * b->m_torque;
 
-		b->m_linearVelocity += step->dt * (gravity + b->m_invMass * b->m_force);
-		b->m_angularVelocity += step->dt * b->m_invI * b->m_torque;
+			v *= b->m_linearDamping;
+			w *= b->m_angularDamping;
 
-		b->m_linearVelocity *= b->m_linearDamping;
-		b->m_angularVelocity *= b->m_angularDamping;
+			// Store positions for conservative advancement.
+			b->m_position0 = state->position;
+			b->m_rotation0 = state->rotation;
+		}
 
-		// Store positions for conservative advancement.
-		b->m_position0 = b->m_position;
-		b->m_rotation0 = b->m_rotation;
+		data.positions[i] = state->position;
+		data.rotations[i] = state->rotation;
+		data.Rs[i] = state->R;
+		data.linearVelocities[i] = v;
+		data.angularVelocities[i] = w;
+		data.invMasses[i] = state->invMass;
+		data.invIs[i] = state->invI;
 	}
 
 	b2ContactSolver contactSolver;
-	b2ContactSolver_ctor(&contactSolver, island->m_contacts, island->m_contactCount, island->m_allocator);
+	b2ContactSolver_ctor(&contactSolver, island->m_contacts, island->m_contactCount, &data, island->m_allocator);
 
 	// Pre-solve
-	b2ContactSolver_PreSolve(&contactSolver);
+	b2ContactSolver_PreSolve(&contactSolver, step);
 
 	for (int32 i = 0; i < island->m_jointCount; ++i)
 	{
-		island->m_joints[i]->PrepareVelocitySolver(island->m_joints[i]);
+		island->m_joints[i]->PrepareVelocitySolver(island->m_joints[i], step, &data);
+	}
+
+	if (profile)
+	{
+		profile->preSolve += b2Timer_Lap(&timer);
 	}
 
 	// Solve velocity constraints.
@@ -172,35 +229,46 @@ void b2Island_Solve(b2Island *island, const b2TimeStep* step, const b2Vec2& grav
 	
 		for (int32 j = 0; j < island->m_jointCount; ++j)
 		{
-			island->m_joints[j]->SolveVelocityConstraints(island->m_joints[j], step);
+			island->m_joints[j]->SolveVelocityConstraints(island->m_joints[j], step, &data);
 		}
 	}
 
-	// Integrate positions.
-	for (int32 i = 0; i < island->m_bodyCount; ++i)
+	if (profile)
 	{
-		b2Body* b = island->m_bodies[i];
+		profile->solveVelocity += b2Timer_Lap(&timer);
+	}
 
-		if (b->m_invMass == 0.0)
+	// Integrate positions.
+	for (int32 i = 0; i < count; ++i)
+	{
+		if (data.invMasses[i] == 0.0)
 			continue;
 
-		b->m_position += step->dt * b->m_linearVelocity;
-		b->m_rotation += step->dt * b->m_angularVelocity;
+		data.positions[i] += step->dt * data.linearVelocities[i];
+		data.rotations[i] += step->dt * data.angularVelocities[i];
 
-		b2Mat22_SetAngle(&b->m_R, b->m_rotation);
+		b2Mat22_SetAngle(&data.Rs[i], data.rotations[i]);
+	}
+
+	if (profile)
+	{
+		profile->integratePositions += b2Timer_Lap(&timer);
 	}
 
 	// Solve position constraints.
-	if (b2World_s_enablePositionCorrection)
+	island->m_positionIterations = 0;
+	if (step->positionCorrection)
 	{
 		for (int32 iter = 0; iter < step->iterations; ++iter)
 		{
+			++island->m_positionIterations;
+
 			bool contactsOkay = b2ContactSolver_SolvePositionConstraints(&contactSolver, b2_contactBaumgarte);
 
 			bool jointsOkay = true;
 			for (int i = 0; i < island->m_jointCount; ++i)
 			{
-				bool jointOkay = island->m_joints[i]->SolvePositionConstraints(island->m_joints[i]);
+				bool jointOkay = island->m_joints[i]->SolvePositionConstraints(island->m_joints[i], &data);
 				jointsOkay = jointsOkay && jointOkay;
 			}
 
@@ -211,25 +279,74 @@ void b2Island_Solve(b2Island *island, const b2TimeStep* step, const b2Vec2& grav
 		}
 	}
 
+	if (profile)
+	{
+		profile->solvePosition += b2Timer_Lap(&timer);
+	}
+
 	// Post-solve.
 	b2ContactSolver_PostSolve(&contactSolver);
 
-	// Synchronize shapes and reset forces.
+	b2ContactSolver_dtor(&contactSolver);
+
+	// Static bodies are shared with other islands, possibly being solved on
+	// other threads. Their slots only ever get zero-mass updates, so they are
+	// left out of the write back.
+	for (int32 i = 0; i < count; ++i)
+	{
+		b2BodyState* state = island->m_bodies[i]->m_state;
+
+		if (state->invMass == 0.0)
+			continue;
+
+		state->position = data.positions[i];
+		state->rotation = data.rotations[i];
+		state->R = data.Rs[i];
+		state->linearVelocity = data.linearVelocities[i];
+		state->angularVelocity = data.angularVelocities[i];
+	}
+
+	// Warning: the order should reverse the allocation order.
+	b2StackAllocator_Free(island->m_allocator, data.invIs);
+	b2StackAllocator_Free(island->m_allocator, data.invMasses);
+	b2StackAllocator_Free(island->m_allocator, data.angularVelocities);
+	b2StackAllocator_Free(island->m_allocator, data.linearVelocities);
+	b2StackAllocator_Free(island->m_allocator, data.Rs);
+	b2StackAllocator_Free(island->m_allocator, data.rotations);
+	b2StackAllocator_Free(island->m_allocator, data.positions);
+}
+
+// Synchronize shapes and reset forces. This moves broadphase proxies, so
+// unlike Solve it must run for one island at a time, in island order.
+void b2Island_Synchronize(b2Island *island)
+{
+	b2Profile* profile = island->m_profile;
+	b2Timer timer;
+
+	if (profile)
+	{
+		b2Timer_ctor(&timer);
+	}
+
 	for (int32 i = 0; i < island->m_bodyCount; ++i)
 	{
 		b2Body* b = island->m_bodies[i];
+		b2BodyState* state = b->m_state;
 
-		if (b->m_invMass == 0.0)
+		if (state->invMass == 0.0)
 			continue;
 
-		b2Mat22_SetAngle(&b->m_R, b->m_rotation);
+		b2Mat22_SetAngle(&state->R, state->rotation);
 
 		b2Body_SynchronizeShapes(b);
 		b2Vec2_Set(&b->m_force, 0.0, 0.0);
 		b->m_torque = 0.0;
 	}
 
-	b2ContactSolver_dtor(&contactSolver);
+	if (profile)
+	{
+		profile->synchronize += b2Timer_GetMilliseconds(&timer);
+	}
 }
 
 void b2Island_UpdateSleep(b2Island *island, float64 dt)
@@ -242,20 +359,21 @@ void b2Island_UpdateSleep(b2Island *island, float64 dt)
 	for (int32 i = 0; i < island->m_bodyCount; ++i)
 	{
 		b2Body* b = island->m_bodies[i];
-		if (b->m_invMass == 0.0)
+		b2BodyState* state = b->m_state;
+		if (state->invMass == 0.0)
 		{
 			continue;
 		}
 
-		if ((b->m_flags & b2Body_e_allowSleepFlag) == 0)
+		if ((state->flags & b2Body_e_allowSleepFlag) == 0)
 		{
 			b->m_sleepTime = 0.0;
 			minSleepTime = 0.0;
 		}
 
-		if ((b->m_flags & b2Body_e_allowSleepFlag) == 0 ||
-			b->m_angularVelocity * b->m_angularVelocity > angTolSqr ||
-			b2Dot(b->m_linearVelocity, b->m_linearVelocity) > linTolSqr)
+		if ((state->flags & b2Body_e_allowSleepFlag) == 0 ||
+			state->angularVelocity * state->angularVelocity > angTolSqr ||
+			b2Dot(state->linearVelocity, state->linearVelocity) > linTolSqr)
 		{
 			b->m_sleepTime = 0.0;
 			minSleepTime = 0.0;
@@ -271,8 +389,7 @@ void b2Island_UpdateSleep(b2Island *island, float64 dt)
 	{
 		for (int32 i = 0; i < island->m_bodyCount; ++i)
 		{
-			b2Body* b = island->m_bodies[i];
-			b->m_flags |= b2Body_e_sleepFlag;
+			b2Body_SetSleepFlag(island->m_bodies[i], true);
 		}
 	}
 }
@@ -58,7 +58,9 @@ void b2Joint_ctor(b2Joint *joint, const b2JointDef* def)
 	joint->m_next = NULL;
 	joint->m_body1 = def->body1;
 	joint->m_body2 = def->body2;
+	joint->m_islandIndex1 = 0;
+	joint->m_islandIndex2 = 0;
 	joint->m_collideConnected = def->collideConnected;
-	joint->m_islandFlag = false;
+	joint->m_islandStamp = 0;
 	joint->m_userData = def->userData;
 }
@@ -60,10 +60,10 @@ void b2RevoluteJoint_ctor(b2RevoluteJoint *rev_joint, const b2RevoluteJointDef*
 	rev_joint->m_joint.SolveVelocityConstraints = b2RevoluteJoint_SolveVelocityConstraints;
 	rev_joint->m_joint.SolvePositionConstraints = b2RevoluteJoint_SolvePositionConstraints;
 
-	rev_joint->m_localAnchor1 = b2MulT(rev_joint->m_joint.m_body1->m_R, def->anchorPoint - rev_joint->m_joint.m_body1->m_position);
-	rev_joint->m_localAnchor2 = b2MulT(rev_joint->m_joint.m_body2->m_R, def->anchorPoint - rev_joint->m_joint.m_body2->m_position);
+	rev_joint->m_localAnchor1 = b2MulT(rev_joint->m_joint.m_body1->m_state->R, def->anchorPoint - rev_joint->m_joint.m_body1->m_state->position);
+	rev_joint->m_localAnchor2 = b2MulT(rev_joint->m_joint.m_body2->m_state->R, def->anchorPoint - rev_joint->m_joint.m_body2->m_state->position);
 
-	rev_joint->m_intialAngle = rev_joint->m_joint.m_body2->m_rotation - rev_joint->m_joint.m_body1->m_rotation;
+	rev_joint->m_intialAngle = rev_joint->m_joint.m_body2->m_state->rotation - rev_joint->m_joint.m_body1->m_state->rotation;
 
 	b2Vec2_Set(&rev_joint->m_ptpImpulse, 0.0, 0.0);
 	rev_joint->m_motorImpulse = 0.0;
@@ -78,21 +78,21 @@ void b2RevoluteJoint_ctor(b2RevoluteJoint *rev_joint, const b2RevoluteJointDef*
 	rev_joint->m_enableMotor = def->enableMotor;
 }
 
-void b2RevoluteJoint_PrepareVelocitySolver(b2Joint *joint)
+void b2RevoluteJoint_PrepareVelocitySolver(b2Joint *joint, const b2TimeStep* step, b2SolverData* data)
 {
 	b2RevoluteJoint *revoluteJoint = (b2RevoluteJoint *)joint;
-	b2Body* b1 = joint->m_body1;
-	b2Body* b2 = joint->m_body2;
+	int32 index1 = joint->m_islandIndex1;
+	int32 index2 = joint->m_islandIndex2;
 
 	// Compute the effective mass matrix.
-	b2Vec2 r1 = b2Mul(b1->m_R, revoluteJoint->m_localAnchor1);
-	b2Vec2 r2 = b2Mul(b2->m_R, revoluteJoint->m_localAnchor2);
+	b2Vec2 r1 = b2Mul(data->Rs[index1], revoluteJoint->m_localAnchor1);
+	b2Vec2 r2 = b2Mul(data->Rs[index2], revoluteJoint->m_localAnchor2);
 
 	// K    = [(1/m1 + 1/m2) * eye(2) - skew(r1) * invI1 * skew(r1) - skew(r2) * invI2 * skew(r2)]
 	//      = [1/m1+1/m2     0    ] + invI1 * [r1.y*r1.y -r1.x*r1.y] + invI2 * [r1.y*r1.y -r1.x*r1.y]
 	//        [    0     1/m1+1/m2]           [-r1.x*r1.y r1.x*r1.x]           [-r1.x*r1.y r1.x*r1.x]
-	float64 invMass1 = b1->m_invMass, invMass2 = b2->m_invMass;
-	float64 invI1 = b1->m_invI, invI2 = b2->m_invI;
+	float64 invMass1 = data->invMasses[index1], invMass2 = data->invMasses[index2];
+	float64 invI1 = data->invIs[index1], invI2 = data->invIs[index2];
 
 	b2Mat22 K1;
 	K1.col1.x = invMass1 + invMass2;	K1.col2.x = 0.0;
@@ -118,7 +118,7 @@ void b2RevoluteJoint_PrepareVelocitySolver(b2Joint *joint)
 
 	if (revoluteJoint->m_enableLimit)
 	{
-		float64 jointAngle = b2->m_rotation - b1->m_rotation - revoluteJoint->m_intialAngle;
+		float64 jointAngle = data->rotations[index2] - data->rotations[index1] - revoluteJoint->m_intialAngle;
 		if (b2Abs(revoluteJoint->m_upperAngle - revoluteJoint->m_lowerAngle) < 2.0 * b2_angularSlop)
 		{
 			revoluteJoint->m_limitState = e_equalLimits;
@@ -150,13 +150,13 @@ void b2RevoluteJoint_PrepareVelocitySolver(b2Joint *joint)
 		revoluteJoint->m_limitImpulse = 0.0;
 	}
 
-	if (b2World_s_enableWarmStarting)
+	if (step->warmStarting)
 	{
-		b1->m_linearVelocity -= invMass1 * revoluteJoint->m_ptpImpulse;
-		b1->m_angularVelocity -= invI1 * (b2Cross(r1, revoluteJoint->m_ptpImpulse) + revoluteJoint->m_motorImpulse + revoluteJoint->m_limitImpulse);
+		data->linearVelocities[index1] -= invMass1 * revoluteJoint->m_ptpImpulse;
+		data->angularVelocities[index1] -= invI1 * (b2Cross(r1, revoluteJoint->m_ptpImpulse) + revoluteJoint->m_motorImpulse + revoluteJoint->m_limitImpulse);
 
-		b2->m_linearVelocity += invMass2 * revoluteJoint->m_ptpImpulse;
-		b2->m_angularVelocity += invI2 * (b2Cross(r2, revoluteJoint->m_ptpImpulse) + revoluteJoint->m_motorImpulse + revoluteJoint->m_limitImpulse);
+		data->linearVelocities[index2] += invMass2 * revoluteJoint->m_ptpImpulse;
+		data->angularVelocities[index2] += invI2 * (b2Cross(r2, revoluteJoint->m_ptpImpulse) + revoluteJoint->m_motorImpulse + revoluteJoint->m_limitImpulse);
 	}
 	else
 	{
@@ -168,41 +168,47 @@ void b2RevoluteJoint_PrepareVelocitySolver(b2Joint *joint)
 	revoluteJoint->m_limitPositionImpulse = 0.0;
 }
 
-void b2RevoluteJoint_SolveVelocityConstraints(b2Joint *joint, const b2TimeStep* step)
+void b2RevoluteJoint_SolveVelocityConstraints(b2Joint *joint, const b2TimeStep* step, b2SolverData* data)
 {
 	b2RevoluteJoint *revoluteJoint = (b2RevoluteJoint *)joint;
 
-	b2Body* b1 = joint->m_body1;
-	b2Body* b2 = joint->m_body2;
+	int32 index1 = joint->m_islandIndex1;
+	int32 index2 = joint->m_islandIndex2;
+	float64 invMass1 = data->invMasses[index1], invMass2 = data->invMasses[index2];
+	float64 invI1 = data->invIs[index1], invI2 = data->invIs[index2];
+	b2Vec2 v1 = data->linearVelocities[index1];
+	b2Vec2 v2 = data->linearVelocities[index2];
+	float64 w1 = data->angularVelocities[index1];
+	float64 w2 = data->angularVelocities[index2];
 
-	b2Vec2 r1 = b2Mul(b1->m_R, revoluteJoint->m_localAnchor1);
-	b2Vec2 r2 = b2Mul(b2->m_R, revoluteJoint->m_localAnchor2);
+	b2Vec2 r1 = b2Mul(data->Rs[index1], revoluteJoint->m_localAnchor1);
+	b2Vec2 r2 = b2Mul(data->Rs[index2], revoluteJoint->m_localAnchor2);
 
 	// Solve point-to-point constraint
-	b2Vec2 ptpCdot = b2->m_linearVelocity + b2Cross(b2->m_angularVelocity, r2) - b1->m_linearVelocity - b2Cross(b1->m_angularVelocity, r1);
+	b2Vec2 ptpCdot = v2 + b2Cross(w2, r2) - v1 - b2Cross(w1, r1);
 	b2Vec2 ptpImpulse = -b2Mul(revoluteJoint->m_ptpMass, ptpCdot);
 	revoluteJoint->m_ptpImpulse += ptpImpulse;
 
-	b1->m_linearVelocity -= b1->m_invMass * ptpImpulse;
-	b1->m_angularVelocity -= b1->m_invI * b2Cross(r1, ptpImpulse);
+	v1 -= invMass1 * ptpImpulse;
+	w1 -= invI1 * b2Cross(r1, ptpImpulse);
 
-	b2->m_linearVelocity += b2->m_invMass * ptpImpulse;
-	b2->m_angularVelocity += b2->m_invI * b2Cross(r2, ptpImpulse);
+	v2 += invMass2 * ptpImpulse;
+	w2 += invI2 * b2Cross(r2, ptpImpulse);
 
 	if (revoluteJoint->m_enableMotor && revoluteJoint->m_limitState != e_equalLimits)
 	{
-		float64 motorCdot = b2->m_angularVelocity - b1->m_angularVelocity - revoluteJoint->m_motorSpeed;
+		float64 motorCdot = w2 - w1 - revoluteJoint->m_motorSpeed;
 		float64 motorImpulse = -revoluteJoint->m_motorMass * motorCdot;
 		float64 oldMotorImpulse = revoluteJoint->m_motorImpulse;
 		revoluteJoint->m_motorImpulse = b2Clamp(revoluteJoint->m_motorImpulse + motorImpulse, -step->dt * revoluteJoint->m_maxMotorTorque, step->dt * revoluteJoint->m_maxMotorTorque);
 		motorImpulse = revoluteJoint->m_motorImpulse - oldMotorImpulse;
-		b1->m_angularVelocity -= b1->m_invI * motorImpulse;
-		b2->m_angularVelocity += b2->m_invI * motorImpulse;
+		w1 -= invI1 * motorImpulse;
+		w2 += invI2 * motorImpulse;
 	}
 
 	if (revoluteJoint->m_enableLimit && revoluteJoint->m_limitState != e_inactiveLimit)
 	{
-		float64 limitCdot = b2->m_angularVelocity - b1->m_angularVelocity;
+		float64 limitCdot = w2 - w1;
 		float64 limitImpulse = -revoluteJoint->m_motorMass * limitCdot;
 
 		if (revoluteJoint->m_limitState == e_equalLimits)
@@ -222,26 +228,37 @@ void b2RevoluteJoint_SolveVelocityConstraints(b2Joint *joint, const b2TimeStep*
 			limitImpulse = revoluteJoint->m_limitImpulse - oldLimitImpulse;
 		}
 
-		b1->m_angularVelocity -= b1->m_invI * limitImpulse;
-		b2->m_angularVelocity += b2->m_invI * limitImpulse;
+		w1 -= invI1 * limitImpulse;
+		w2 += invI2 * limitImpulse;
 	}
+
+	data->linearVelocities[index1] = v1;
+	data->linearVelocities[index2] = v2;
+	data->angularVelocities[index1] = w1;
+	data->angularVelocities[index2] = w2;
 }
 
-bool b2RevoluteJoint_SolvePositionConstraints(b2Joint *joint)
+bool b2RevoluteJoint_SolvePositionConstraints(b2Joint *joint, b2SolverData* data)
 {
 	b2RevoluteJoint *revoluteJoint = (b2RevoluteJoint *)joint;
 
-	b2Body* b1 = joint->m_body1;
-	b2Body* b2 = joint->m_body2;
+	int32 index1 = joint->m_islandIndex1;
+	int32 index2 = joint->m_islandIndex2;
+	b2Vec2 x1 = data->positions[index1];
+	b2Vec2 x2 = data->positions[index2];
+	float64 a1 = data->rotations[index1];
+	float64 a2 = data->rotations[index2];
+	b2Mat22 R1 = data->Rs[index1];
+	b2Mat22 R2 = data->Rs[index2];
 
 	float64 positionError = 0.0;
 
 	// Solve point-to-point position error.
-	b2Vec2 r1 = b2Mul(b1->m_R, revoluteJoint->m_localAnchor1);
-	b2Vec2 r2 = b2Mul(b2->m_R, revoluteJoint->m_localAnchor2);
+	b2Vec2 r1 = b2Mul(R1, revoluteJoint->m_localAnchor1);
+	b2Vec2 r2 = b2Mul(R2, revoluteJoint->m_localAnchor2);
 
-	b2Vec2 p1 = b1->m_position + r1;
-	b2Vec2 p2 = b2->m_position + r2;
+	b2Vec2 p1 = x1 + r1;
+	b2Vec2 p2 = x2 + r2;
 	b2Vec2 ptpC = p2 - p1;
 
 	positionError = b2Vec2_Length(&ptpC);
@@ -250,8 +267,8 @@ bool b2RevoluteJoint_SolvePositionConstraints(b2Joint *joint)
 	//b2Vec2 dpMax(b2_maxLinearCorrection, b2_maxLinearCorrection);
 	//ptpC = b2Clamp(ptpC, -dpMax, dpMax);
 
-	float64 invMass1 = b1->m_invMass, invMass2 = b2->m_invMass;
-	float64 invI1 = b1->m_invI, invI2 = b2->m_invI;
+	float64 invMass1 = data->invMasses[index1], invMass2 = data->invMasses[index2];
+	float64 invI1 = data->invIs[index1], invI2 = data->invIs[index2];
 
 	b2Mat22 K1;
 	K1.col1.x = invMass1 + invMass2;	K1.col2.x = 0.0;
@@ -268,20 +285,20 @@ bool b2RevoluteJoint_SolvePositionConstraints(b2Joint *joint)
 	b2Mat22 K = K1 + K2 + K3;
 	b2Vec2 impulse = b2Mat22_Solve(&K, -ptpC);
 
-	b1->m_position -= b1->m_invMass * impulse;
-	b1->m_rotation -= b1->m_invI * b2Cross(r1, impulse);
-	b2Mat22_SetAngle(&b1->m_R, b1->m_rotation);
+	x1 -= invMass1 * impulse;
+	a1 -= invI1 * b2Cross(r1, impulse);
+	b2Mat22_SetAngle(&R1, a1);
 
-	b2->m_position += b2->m_invMass * impulse;
-	b2->m_rotation += b2->m_invI * b2Cross(r2, impulse);
-	b2Mat22_SetAngle(&b2->m_R, b2->m_rotation);
+	x2 += invMass2 * impulse;
+	a2 += invI2 * b2Cross(r2, impulse);
+	b2Mat22_SetAngle(&R2, a2);
 
 	// Handle limits.
 	float64 angularError = 0.0;
 
 	if (revoluteJoint->m_enableLimit && revoluteJoint->m_limitState != e_inactiveLimit)
 	{
-		float64 angle = b2->m_rotation - b1->m_rotation - revoluteJoint->m_intialAngle;
+		float64 angle = a2 - a1 - revoluteJoint->m_intialAngle;
 		float64 limitImpulse = 0.0;
 
 		if (revoluteJoint->m_limitState == e_equalLimits)
@@ -316,12 +333,20 @@ bool b2RevoluteJoint_SolvePositionConstraints(b2Joint *joint)
 			limitImpulse = revoluteJoint->m_limitPositionImpulse - oldLimitImpulse;
 		}
 
-		b1->m_rotation -= b1->m_invI * limitImpulse;
-		b2Mat22_SetAngle(&b1->m_R, b1->m_rotation);
-		b2->m_rotation += b2->m_invI * limitImpulse;
-		b2Mat22_SetAngle(&b2->m_R, b2->m_rotation);
+		a1 -= invI1 * limitImpulse;
+		b2Mat22_SetAngle(&R1, a1);
+
+		a2 += invI2 * limitImpulse;
+		b2Mat22_SetAngle(&R2, a2);
 	}
 
+	data->positions[index1] = x1;
+	data->positions[index2] = x2;
+	data->rotations[index1] = a1;
+	data->rotations[index2] = a2;
+	data->Rs[index1] = R1;
+	data->Rs[index2] = R2;
+
 	return positionError <= b2_linearSlop && angularError <= b2_angularSlop;
 }
 
@@ -329,14 +354,14 @@ b2Vec2 b2RevoluteJoint_GetAnchor1(b2Joint *joint)
 {
 	b2RevoluteJoint *revoluteJoint = (b2RevoluteJoint *)joint;
 	b2Body* b1 = joint->m_body1;
-	return b1->m_position + b2Mul(b1->m_R, revoluteJoint->m_localAnchor1);
+	return b1->m_state->position + b2Mul(b1->m_state->R, revoluteJoint->m_localAnchor1);
 }
 
 b2Vec2 b2RevoluteJoint_GetAnchor2(b2Joint *joint)
 {
 	b2RevoluteJoint *revoluteJoint = (b2RevoluteJoint *)joint;
 	b2Body* b2 = joint->m_body2;
-	return b2->m_position + b2Mul(b2->m_R, revoluteJoint->m_localAnchor2);
+	return b2->m_state->position + b2Mul(b2->m_state->R, revoluteJoint->m_localAnchor2);
 }
 
 b2Vec2 b2RevoluteJoint_GetReactionForce(b2Joint *joint, float64 invTimeStep)
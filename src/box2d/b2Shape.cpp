@@ -305,9 +305,9 @@ static void b2CircleShape_ctor(b2CircleShape *circleShape, const b2ShapeDef* def
 	circleShape->m_shape.m_type = e_circleShape;
 	circleShape->m_radius = circle->radius;
 
-	circleShape->m_shape.m_R = circleShape->m_shape.m_body->m_R;
-	b2Vec2 r = b2Mul(circleShape->m_shape.m_body->m_R, circleShape->m_localPosition);
-	circleShape->m_shape.m_position = circleShape->m_shape.m_body->m_position + r;
+	circleShape->m_shape.m_R = circleShape->m_shape.m_body->m_state->R;
+	b2Vec2 r = b2Mul(circleShape->m_shape.m_body->m_state->R, circleShape->m_localPosition);
+	circleShape->m_shape.m_position = circleShape->m_shape.m_body->m_state->position + r;
 
 	b2AABB aabb;
 	b2Vec2_Set(&aabb.minVertex, circleShape->m_shape.m_position.x - circleShape->m_radius, circleShape->m_shape.m_position.y - circleShape->m_radius);
@@ -497,8 +497,8 @@ void b2PolyShape_ctor(b2PolyShape *polyShape,
 		b2Vec2_Normalize(&polyShape->m_normals[i]);
 	}
 
-	polyShape->m_shape.m_R = polyShape->m_shape.m_body->m_R;
-	polyShape->m_shape.m_position = polyShape->m_shape.m_body->m_position + b2Mul(polyShape->m_shape.m_body->m_R, polyShape->m_localCentroid);
+	polyShape->m_shape.m_R = polyShape->m_shape.m_body->m_state->R;
+	polyShape->m_shape.m_position = polyShape->m_shape.m_body->m_state->position + b2Mul(polyShape->m_shape.m_body->m_state->R, polyShape->m_localCentroid);
 
 	b2Mat22 R = b2Mul(polyShape->m_shape.m_R, polyShape->m_localOBB.R);
 	b2Mat22 absR = b2Abs(R);
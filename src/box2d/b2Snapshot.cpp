@@ -0,0 +1,980 @@
+/*
+* Copyright (c) 2006-2007 Erin Catto http://www.gphysics.com
+*
+* This software is provided 'as-is', without any express or implied
+* warranty.  In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+#include <box2d/b2Snapshot.h>
+#include <box2d/b2World.h>
+#include <box2d/b2Body.h>
+#include <box2d/b2Joint.h>
+#include <box2d/b2RevoluteJoint.h>
+#include <box2d/b2Contact.h>
+#include <box2d/b2Shape.h>
+#include <box2d/b2BroadPhase.h>
+#include <stdint.h>
+#include <string.h>
+
+static const uint32 b2_snapshotMagic = 0x4e533262;	// "b2SN"
+static const uint32 b2_snapshotVersion = 6;
+
+// Every record starts at a multiple of this, so that it can be patched
+// in place through a pointer to its type. b2BodyState needs more and is
+// patched before it is appended.
+static const int32 b2_snapshotAlignment = 8;
+
+static inline int32 b2Snapshot_AlignOffset(int32 offset)
+{
+	return (offset + b2_snapshotAlignment - 1) & ~(b2_snapshotAlignment - 1);
+}
+
+// Pointers are stored as one-based indices so that NULL stays NULL.
+static inline void* b2Swizzle(int32 index)
+{
+	return (void*)(intptr_t)(index + 1);
+}
+
+static inline int32 b2Unswizzle(const void* p)
+{
+	return (int32)((intptr_t)p - 1);
+}
+
+static int32 b2ShapeSize(b2ShapeType type)
+{
+	switch (type)
+	{
+	case e_circleShape:
+		return sizeof(b2CircleShape);
+
+	case e_polyShape:
+		return sizeof(b2PolyShape);
+
+	default:
+		return 0;
+	}
+}
+
+static int32 b2JointSize(b2JointType type)
+{
+	switch (type)
+	{
+	case e_revoluteJoint:
+		return sizeof(b2RevoluteJoint);
+
+	default:
+		return 0;
+	}
+}
+
+void b2Snapshot_ctor(b2Snapshot *snapshot)
+{
+	snapshot->data = NULL;
+	snapshot->size = 0;
+	snapshot->capacity = 0;
+}
+
+void b2Snapshot_dtor(b2Snapshot *snapshot)
+{
+	b2Free(snapshot->data);
+}
+
+// Returns the location of the appended bytes so that pointers can be
+// swizzled in place. It is only valid until the next append.
+static void* b2Snapshot_Append(b2Snapshot *snapshot, const void* data, int32 size)
+{
+	int32 offset = b2Snapshot_AlignOffset(snapshot->size);
+	if (offset + size > snapshot->capacity)
+	{
+		int32 capacity = snapshot->capacity ? snapshot->capacity : 4096;
+		while (capacity < offset + size)
+		{
+			capacity *= 2;
+		}
+
+		char* newData = (char*)b2Alloc(capacity);
+		if (snapshot->size)
+		{
+			memcpy(newData, snapshot->data, snapshot->size);
+		}
+		b2Free(snapshot->data);
+		snapshot->data = newData;
+		snapshot->capacity = capacity;
+	}
+
+	memset(snapshot->data + snapshot->size, 0, offset - snapshot->size);
+	void* p = snapshot->data + offset;
+	memcpy(p, data, size);
+	snapshot->size = offset + size;
+	return p;
+}
+
+static void b2Snapshot_AppendInt(b2Snapshot *snapshot, int32 value)
+{
+	b2Snapshot_Append(snapshot, &value, sizeof(value));
+}
+
+// Maps object addresses to their index in the snapshot. This is an open
+// addressing hash table with linear probing.
+typedef struct b2PtrIndex b2PtrIndex;
+struct b2PtrIndex
+{
+	const void* ptr;
+	int32 index;
+};
+
+typedef struct b2PtrMap b2PtrMap;
+struct b2PtrMap
+{
+	b2PtrIndex* entries;
+	uint32 mask;
+};
+
+static inline uint32 b2PtrMap_Hash(const void* p)
+{
+	uint64_t key = (uintptr_t)p;
+	return (uint32)((key * 0x9E3779B97F4A7C15ull) >> 32);
+}
+
+static void b2PtrMap_ctor(b2PtrMap *map, void** objects, int32 count)
+{
+	uint32 capacity = 16;
+	while (capacity < 2 * (uint32)count)
+	{
+		capacity *= 2;
+	}
+
+	map->entries = (b2PtrIndex*)b2Alloc(capacity * sizeof(b2PtrIndex));
+	map->mask = capacity - 1;
+	memset(map->entries, 0, capacity * sizeof(b2PtrIndex));
+
+	for (int32 i = 0; i < count; ++i)
+	{
+		uint32 h = b2PtrMap_Hash(objects[i]) & map->mask;
+		while (map->entries[h].ptr)
+		{
+			h = (h + 1) & map->mask;
+		}
+		map->entries[h].ptr = objects[i];
+		map->entries[h].index = i;
+	}
+}
+
+static void b2PtrMap_dtor(b2PtrMap *map)
+{
+	b2Free(map->entries);
+}
+
+static int32 b2PtrMap_Find(const b2PtrMap *map, const void* p)
+{
+	for (uint32 h = b2PtrMap_Hash(p) & map->mask; map->entries[h].ptr; h = (h + 1) & map->mask)
+	{
+		if (map->entries[h].ptr == p)
+		{
+			return map->entries[h].index;
+		}
+	}
+	return -1;
+}
+
+typedef struct b2Saver b2Saver;
+struct b2Saver
+{
+	b2World* world;
+	b2Snapshot* snapshot;
+	b2SnapshotUserDataFcn fcn;
+	void* context;
+
+	b2Body** bodies;
+	b2Shape** shapes;
+	b2Joint** joints;
+	b2Contact** contacts;
+	int32 bodyCount;
+	int32 shapeCount;
+	int32 jointCount;
+	int32 contactCount;
+
+	b2PtrMap bodyMap;
+	b2PtrMap shapeMap;
+	b2PtrMap jointMap;
+	b2PtrMap contactMap;
+};
+
+static void* b2Saver_Ref(const b2PtrMap *map, const void* p)
+{
+	return p ? b2Swizzle(b2PtrMap_Find(map, p)) : NULL;
+}
+
+static void* b2Saver_UserData(b2Saver *saver, void* userData)
+{
+	return saver->fcn && userData ? saver->fcn(userData, saver->context) : userData;
+}
+
+// Nodes live inside their contact or joint, so they are stored as the
+// owner index times two plus the node number.
+static void* b2Saver_ContactNode(b2Saver *saver, const b2ContactNode* node)
+{
+	if (node == NULL)
+	{
+		return NULL;
+	}
+
+	int32 index = b2PtrMap_Find(&saver->contactMap, node->contact);
+	return b2Swizzle(2 * index + (node == &node->contact->m_node2));
+}
+
+static void* b2Saver_JointNode(b2Saver *saver, const b2JointNode* node)
+{
+	if (node == NULL)
+	{
+		return NULL;
+	}
+
+	int32 index = b2PtrMap_Find(&saver->jointMap, node->joint);
+	return b2Swizzle(2 * index + (node == &node->joint->m_node2));
+}
+
+static void b2Saver_Collect(b2Saver *saver)
+{
+	b2World* world = saver->world;
+
+	// Bodies waiting for deferred destruction are still connected to
+	// contacts and joints, so they are saved too.
+	saver->bodyCount = 0;
+	saver->shapeCount = 0;
+	for (int32 list = 0; list < 2; ++list)
+	{
+		for (b2Body* b = list ? world->m_bodyDestroyList : world->m_bodyList; b; b = b->m_next)
+		{
+			++saver->bodyCount;
+			saver->shapeCount += b->m_shapeCount;
+		}
+	}
+
+	saver->jointCount = 0;
+	for (b2Joint* j = world->m_jointList; j; j = j->m_next)
+	{
+		++saver->jointCount;
+	}
+
+	saver->contactCount = 0;
+	for (b2Contact* c = world->m_contactList; c; c = c->m_next)
+	{
+		++saver->contactCount;
+	}
+
+	saver->bodies = (b2Body**)b2Alloc((saver->bodyCount + 1) * sizeof(b2Body*));
+	saver->shapes = (b2Shape**)b2Alloc((saver->shapeCount + 1) * sizeof(b2Shape*));
+	saver->joints = (b2Joint**)b2Alloc((saver->jointCount + 1) * sizeof(b2Joint*));
+	saver->contacts = (b2Contact**)b2Alloc((saver->contactCount + 1) * sizeof(b2Contact*));
+
+	int32 bodyIndex = 0;
+	int32 shapeIndex = 0;
+	for (int32 list = 0; list < 2; ++list)
+	{
+		for (b2Body* b = list ? world->m_bodyDestroyList : world->m_bodyList; b; b = b->m_next)
+		{
+			saver->bodies[bodyIndex++] = b;
+			for (b2Shape* s = b->m_shapeList; s; s = s->m_next)
+			{
+				saver->shapes[shapeIndex++] = s;
+			}
+		}
+	}
+
+	int32 jointIndex = 0;
+	for (b2Joint* j = world->m_jointList; j; j = j->m_next)
+	{
+		saver->joints[jointIndex++] = j;
+	}
+
+	int32 contactIndex = 0;
+	for (b2Contact* c = world->m_contactList; c; c = c->m_next)
+	{
+		saver->contacts[contactIndex++] = c;
+	}
+
+	b2PtrMap_ctor(&saver->bodyMap, (void**)saver->bodies, saver->bodyCount);
+	b2PtrMap_ctor(&saver->shapeMap, (void**)saver->shapes, saver->shapeCount);
+	b2PtrMap_ctor(&saver->jointMap, (void**)saver->joints, saver->jointCount);
+	b2PtrMap_ctor(&saver->contactMap, (void**)saver->contacts, saver->contactCount);
+}
+
+static void b2Saver_SaveBody(b2Saver *saver, const b2Body* body)
+{
+	b2Body* b = (b2Body*)b2Snapshot_Append(saver->snapshot, body, sizeof(b2Body));
+	b->m_state = NULL;
+	b->m_world = NULL;
+	b->m_prev = (b2Body*)b2Saver_Ref(&saver->bodyMap, body->m_prev);
+	b->m_next = (b2Body*)b2Saver_Ref(&saver->bodyMap, body->m_next);
+	b->m_shapeList = (b2Shape*)b2Saver_Ref(&saver->shapeMap, body->m_shapeList);
+	b->m_jointList = (b2JointNode*)b2Saver_JointNode(saver, body->m_jointList);
+	b->m_contactList = (b2ContactNode*)b2Saver_ContactNode(saver, body->m_contactList);
+	b->m_sleepChangedNext = NULL;
+	b->m_userData = b2Saver_UserData(saver, body->m_userData);
+
+	// States are cache line aligned, which the snapshot bytes are not.
+	b2BodyState state = *body->m_state;
+	state.body = NULL;
+	b2Snapshot_Append(saver->snapshot, &state, sizeof(b2BodyState));
+}
+
+static void b2Saver_SaveShape(b2Saver *saver, const b2Shape* shape)
+{
+	b2Snapshot_AppendInt(saver->snapshot, shape->m_type);
+
+	b2Shape* s = (b2Shape*)b2Snapshot_Append(saver->snapshot, shape, b2ShapeSize(shape->m_type));
+	s->TestPoint = NULL;
+	s->ResetProxy = NULL;
+	s->Synchronize = NULL;
+	s->Support = NULL;
+	s->m_next = (b2Shape*)b2Saver_Ref(&saver->shapeMap, shape->m_next);
+	s->m_body = (b2Body*)b2Saver_Ref(&saver->bodyMap, shape->m_body);
+	s->m_userData = b2Saver_UserData(saver, shape->m_userData);
+}
+
+static void b2Saver_SaveJoint(b2Saver *saver, const b2Joint* joint)
+{
+	b2Snapshot_AppendInt(saver->snapshot, joint->m_type);
+
+	b2Joint* j = (b2Joint*)b2Snapshot_Append(saver->snapshot, joint, b2JointSize(joint->m_type));
+	j->GetAnchor1 = NULL;
+	j->GetAnchor2 = NULL;
+	j->GetReactionForce = NULL;
+	j->GetReactionTorque = NULL;
+	j->PrepareVelocitySolver = NULL;
+	j->SolveVelocityConstraints = NULL;
+	j->SolvePositionConstraints = NULL;
+	j->m_prev = (b2Joint*)b2Saver_Ref(&saver->jointMap, joint->m_prev);
+	j->m_next = (b2Joint*)b2Saver_Ref(&saver->jointMap, joint->m_next);
+	j->m_body1 = (b2Body*)b2Saver_Ref(&saver->bodyMap, joint->m_body1);
+	j->m_body2 = (b2Body*)b2Saver_Ref(&saver->bodyMap, joint->m_body2);
+	j->m_userData = b2Saver_UserData(saver, joint->m_userData);
+
+	const b2JointNode* nodes[2] = { &joint->m_node1, &joint->m_node2 };
+	b2JointNode* savedNodes[2] = { &j->m_node1, &j->m_node2 };
+	for (int32 i = 0; i < 2; ++i)
+	{
+		savedNodes[i]->other = (b2Body*)b2Saver_Ref(&saver->bodyMap, nodes[i]->other);
+		savedNodes[i]->joint = (b2Joint*)b2Saver_Ref(&saver->jointMap, nodes[i]->joint);
+		savedNodes[i]->prev = (b2JointNode*)b2Saver_JointNode(saver, nodes[i]->prev);
+		savedNodes[i]->next = (b2JointNode*)b2Saver_JointNode(saver, nodes[i]->next);
+	}
+}
+
+static void b2Saver_SaveContact(b2Saver *saver, b2Contact* contact)
+{
+	b2Contact* c = (b2Contact*)b2Snapshot_Append(saver->snapshot, contact, sizeof(b2Contact));
+	c->GetManifolds = NULL;
+	c->Evaluate = NULL;
+	c->m_prev = (b2Contact*)b2Saver_Ref(&saver->contactMap, contact->m_prev);
+	c->m_next = (b2Contact*)b2Saver_Ref(&saver->contactMap, contact->m_next);
+	c->m_listPrev = NULL;
+	c->m_listNext = NULL;
+	c->m_shape1 = (b2Shape*)b2Saver_Ref(&saver->shapeMap, contact->m_shape1);
+	c->m_shape2 = (b2Shape*)b2Saver_Ref(&saver->shapeMap, contact->m_shape2);
+
+	const b2ContactNode* nodes[2] = { &contact->m_node1, &contact->m_node2 };
+	b2ContactNode* savedNodes[2] = { &c->m_node1, &c->m_node2 };
+	for (int32 i = 0; i < 2; ++i)
+	{
+		savedNodes[i]->other = (b2Body*)b2Saver_Ref(&saver->bodyMap, nodes[i]->other);
+		savedNodes[i]->contact = (b2Contact*)b2Saver_Ref(&saver->contactMap, nodes[i]->contact);
+		savedNodes[i]->prev = (b2ContactNode*)b2Saver_ContactNode(saver, nodes[i]->prev);
+		savedNodes[i]->next = (b2ContactNode*)b2Saver_ContactNode(saver, nodes[i]->next);
+	}
+
+	// The manifold holds the accumulated impulses used for warm starting.
+	b2Snapshot_Append(saver->snapshot, contact->GetManifolds(contact), sizeof(b2Manifold));
+}
+
+static void b2Saver_SaveBroadPhase(b2Saver *saver)
+{
+	b2World* world = saver->world;
+	b2BroadPhase* bp = (b2BroadPhase*)b2Snapshot_Append(saver->snapshot, world->m_broadPhase, sizeof(b2BroadPhase));
+
+	bp->m_pairManager.m_broadPhase = NULL;
+	bp->m_pairManager.m_callback = NULL;
+
+	// Free proxies and pairs have no user data.
+	for (int32 i = 0; i < b2_maxProxies; ++i)
+	{
+		b2Proxy* proxy = bp->m_proxyPool + i;
+		proxy->userData = b2Saver_Ref(&saver->shapeMap, proxy->userData);
+	}
+
+	// Pair user data is a contact or the null contact. The null contact
+	// is stored as index -1.
+	void* nullContact = &world->m_contactManager.m_nullContact;
+	for (int32 i = 0; i < b2_maxPairs; ++i)
+	{
+		b2Pair* pair = bp->m_pairManager.m_pairs + i;
+		if (pair->userData == nullContact)
+		{
+			pair->userData = b2Swizzle(-2);
+		}
+		else
+		{
+			pair->userData = b2Saver_Ref(&saver->contactMap, pair->userData);
+		}
+	}
+}
+
+void b2World_Save(b2World *world, b2Snapshot *snapshot,
+		  b2SnapshotUserDataFcn fcn, void* context)
+{
+	b2Saver saver;
+	saver.world = world;
+	saver.snapshot = snapshot;
+	saver.fcn = fcn;
+	saver.context = context;
+
+	b2Saver_Collect(&saver);
+
+	snapshot->size = 0;
+
+	b2Snapshot_AppendInt(snapshot, b2_snapshotMagic);
+	b2Snapshot_AppendInt(snapshot, b2_snapshotVersion);
+	b2Snapshot_AppendInt(snapshot, sizeof(void*));
+	b2Snapshot_AppendInt(snapshot, sizeof(b2Body));
+	b2Snapshot_AppendInt(snapshot, sizeof(b2BodyState));
+	b2Snapshot_AppendInt(snapshot, sizeof(b2BroadPhase));
+
+	b2Snapshot_AppendInt(snapshot, saver.bodyCount);
+	b2Snapshot_AppendInt(snapshot, saver.shapeCount);
+	b2Snapshot_AppendInt(snapshot, saver.jointCount);
+	b2Snapshot_AppendInt(snapshot, saver.contactCount);
+
+	b2Snapshot_AppendInt(snapshot, world->m_bodyCount);
+	b2Snapshot_AppendInt(snapshot, world->m_contactCount);
+	b2Snapshot_AppendInt(snapshot, world->m_jointCount);
+
+	b2Snapshot_AppendInt(snapshot, b2PtrMap_Find(&saver.bodyMap, world->m_bodyList));
+	b2Snapshot_AppendInt(snapshot, b2PtrMap_Find(&saver.bodyMap, world->m_bodyDestroyList));
+	b2Snapshot_AppendInt(snapshot, b2PtrMap_Find(&saver.bodyMap, world->m_groundBody));
+	b2Snapshot_AppendInt(snapshot, b2PtrMap_Find(&saver.jointMap, world->m_jointList));
+	b2Snapshot_AppendInt(snapshot, b2PtrMap_Find(&saver.contactMap, world->m_contactList));
+
+	b2Snapshot_Append(snapshot, &world->m_gravity, sizeof(world->m_gravity));
+	b2Snapshot_AppendInt(snapshot, world->m_allowSleep);
+	b2Snapshot_AppendInt(snapshot, world->m_warmStarting);
+	b2Snapshot_AppendInt(snapshot, world->m_positionCorrection);
+	b2Snapshot_AppendInt(snapshot, world->m_islandStamp);
+
+	for (int32 i = 0; i < saver.bodyCount; ++i)
+	{
+		b2Saver_SaveBody(&saver, saver.bodies[i]);
+	}
+
+	for (int32 i = 0; i < saver.shapeCount; ++i)
+	{
+		b2Saver_SaveShape(&saver, saver.shapes[i]);
+	}
+
+	for (int32 i = 0; i < saver.jointCount; ++i)
+	{
+		b2Saver_SaveJoint(&saver, saver.joints[i]);
+	}
+
+	for (int32 i = 0; i < saver.contactCount; ++i)
+	{
+		b2Saver_SaveContact(&saver, saver.contacts[i]);
+	}
+
+	b2Saver_SaveBroadPhase(&saver);
+
+	b2PtrMap_dtor(&saver.bodyMap);
+	b2PtrMap_dtor(&saver.shapeMap);
+	b2PtrMap_dtor(&saver.jointMap);
+	b2PtrMap_dtor(&saver.contactMap);
+	b2Free(saver.bodies);
+	b2Free(saver.shapes);
+	b2Free(saver.joints);
+	b2Free(saver.contacts);
+}
+
+typedef struct b2Loader b2Loader;
+struct b2Loader
+{
+	b2World* world;
+	const char* data;
+	int32 size;
+	int32 offset;
+	bool error;
+
+	b2SnapshotUserDataFcn fcn;
+	void* context;
+
+	b2Body** bodies;
+	b2Shape** shapes;
+	b2Joint** joints;
+	b2Contact** contacts;
+	int32 bodyCount;
+	int32 shapeCount;
+	int32 jointCount;
+	int32 contactCount;
+};
+
+static bool b2Loader_Read(b2Loader *loader, void* dst, int32 size)
+{
+	int32 offset = b2Snapshot_AlignOffset(loader->offset);
+	if (loader->error || size <= 0 || size > loader->size - offset)
+	{
+		loader->error = true;
+		return false;
+	}
+
+	memcpy(dst, loader->data + offset, size);
+	loader->offset = offset + size;
+	return true;
+}
+
+static int32 b2Loader_ReadInt(b2Loader *loader)
+{
+	int32 value = 0;
+	b2Loader_Read(loader, &value, sizeof(value));
+	return value;
+}
+
+// Resolves a stored index against an object table, flagging an error if
+// it is out of range.
+static void* b2Loader_Resolve(b2Loader *loader, void** objects, int32 count, int32 index)
+{
+	if (index == -1)
+	{
+		return NULL;
+	}
+
+	if (index < 0 || index >= count)
+	{
+		loader->error = true;
+		return NULL;
+	}
+
+	return objects[index];
+}
+
+static void* b2Loader_Ref(b2Loader *loader, void** objects, int32 count, const void* p)
+{
+	return b2Loader_Resolve(loader, objects, count, b2Unswizzle(p));
+}
+
+static b2Body* b2Loader_Body(b2Loader *loader, const void* p)
+{
+	return (b2Body*)b2Loader_Ref(loader, (void**)loader->bodies, loader->bodyCount, p);
+}
+
+static b2Shape* b2Loader_Shape(b2Loader *loader, const void* p)
+{
+	return (b2Shape*)b2Loader_Ref(loader, (void**)loader->shapes, loader->shapeCount, p);
+}
+
+static b2Joint* b2Loader_Joint(b2Loader *loader, const void* p)
+{
+	return (b2Joint*)b2Loader_Ref(loader, (void**)loader->joints, loader->jointCount, p);
+}
+
+static b2Contact* b2Loader_Contact(b2Loader *loader, const void* p)
+{
+	return (b2Contact*)b2Loader_Ref(loader, (void**)loader->contacts, loader->contactCount, p);
+}
+
+static b2ContactNode* b2Loader_ContactNode(b2Loader *loader, const void* p)
+{
+	int32 code = b2Unswizzle(p);
+	b2Contact* c = (b2Contact*)b2Loader_Resolve(loader, (void**)loader->contacts, loader->contactCount, code < 0 ? code : code / 2);
+	if (c == NULL)
+	{
+		return NULL;
+	}
+
+	return code & 1 ? &c->m_node2 : &c->m_node1;
+}
+
+static b2JointNode* b2Loader_JointNode(b2Loader *loader, const void* p)
+{
+	int32 code = b2Unswizzle(p);
+	b2Joint* j = (b2Joint*)b2Loader_Resolve(loader, (void**)loader->joints, loader->jointCount, code < 0 ? code : code / 2);
+	if (j == NULL)
+	{
+		return NULL;
+	}
+
+	return code & 1 ? &j->m_node2 : &j->m_node1;
+}
+
+// A token that the callback cannot map back means the snapshot belongs
+// to something else.
+static void* b2Loader_UserData(b2Loader *loader, void* userData)
+{
+	if (loader->fcn == NULL || userData == NULL)
+	{
+		return userData;
+	}
+
+	void* p = loader->fcn(userData, loader->context);
+	if (p == NULL)
+	{
+		loader->error = true;
+	}
+	return p;
+}
+
+// The states are laid out in body order, which may differ from the saved
+// world's array. Nothing depends on that order.
+static void b2Loader_LoadBodies(b2Loader *loader)
+{
+	b2World* world = loader->world;
+	int32 capacity = b2Max(loader->bodyCount, 1);
+	world->m_bodyStateBuffer = b2Alloc(capacity * sizeof(b2BodyState) + b2_cacheLineSize - 1);
+	uintptr_t aligned = ((uintptr_t)world->m_bodyStateBuffer + b2_cacheLineSize - 1) & ~(uintptr_t)(b2_cacheLineSize - 1);
+	world->m_bodyStates = (b2BodyState*)aligned;
+	world->m_bodyStateCount = loader->bodyCount;
+	world->m_bodyStateCapacity = capacity;
+
+	for (int32 i = 0; i < loader->bodyCount; ++i)
+	{
+		b2Body* b = (b2Body*)b2BlockAllocator_Allocate(&world->m_blockAllocator, sizeof(b2Body));
+		b2BodyState* state = world->m_bodyStates + i;
+		loader->bodies[i] = b;
+		b2Loader_Read(loader, b, sizeof(b2Body));
+		b2Loader_Read(loader, state, sizeof(b2BodyState));
+		b->m_state = state;
+		state->body = b;
+	}
+}
+
+static void b2Loader_LoadShapes(b2Loader *loader)
+{
+	for (int32 i = 0; i < loader->shapeCount; ++i)
+	{
+		b2ShapeType type = (b2ShapeType)b2Loader_ReadInt(loader);
+		int32 size = b2ShapeSize(type);
+		if (size == 0)
+		{
+			loader->error = true;
+			return;
+		}
+
+		b2Shape* s = (b2Shape*)b2BlockAllocator_Allocate(&loader->world->m_blockAllocator, size);
+		loader->shapes[i] = s;
+		if (b2Loader_Read(loader, s, size) == false || s->m_type != type)
+		{
+			loader->error = true;
+			return;
+		}
+
+		switch (type)
+		{
+		case e_circleShape:
+			s->TestPoint = b2CircleShape_TestPoint;
+			s->ResetProxy = b2CircleShape_ResetProxy;
+			s->Synchronize = b2CircleShape_Synchronize;
+			s->Support = b2CircleShape_Support;
+			break;
+
+		case e_polyShape:
+			s->TestPoint = b2PolyShape_TestPoint;
+			s->ResetProxy = b2PolyShape_ResetProxy;
+			s->Synchronize = b2PolyShape_Synchronize;
+			s->Support = b2PolyShape_Support;
+			break;
+
+		default:
+			break;
+		}
+	}
+}
+
+static void b2Loader_LoadJoints(b2Loader *loader)
+{
+	for (int32 i = 0; i < loader->jointCount; ++i)
+	{
+		b2JointType type = (b2JointType)b2Loader_ReadInt(loader);
+		int32 size = b2JointSize(type);
+		if (size == 0)
+		{
+			loader->error = true;
+			return;
+		}
+
+		b2Joint* j = (b2Joint*)b2BlockAllocator_Allocate(&loader->world->m_blockAllocator, size);
+		loader->joints[i] = j;
+		if (b2Loader_Read(loader, j, size) == false || j->m_type != type)
+		{
+			loader->error = true;
+			return;
+		}
+
+		switch (type)
+		{
+		case e_revoluteJoint:
+			j->GetAnchor1 = b2RevoluteJoint_GetAnchor1;
+			j->GetAnchor2 = b2RevoluteJoint_GetAnchor2;
+			j->GetReactionForce = b2RevoluteJoint_GetReactionForce;
+			j->GetReactionTorque = b2RevoluteJoint_GetReactionTorque;
+			j->PrepareVelocitySolver = b2RevoluteJoint_PrepareVelocitySolver;
+			j->SolveVelocityConstraints = b2RevoluteJoint_SolveVelocityConstraints;
+			j->SolvePositionConstraints = b2RevoluteJoint_SolvePositionConstraints;
+			break;
+
+		default:
+			break;
+		}
+	}
+}
+
+// Contacts are created through the factory to get the right concrete
+// type, then their saved state is copied over.
+static void b2Loader_LoadContacts(b2Loader *loader)
+{
+	for (int32 i = 0; i < loader->contactCount; ++i)
+	{
+		b2Contact saved;
+		b2Manifold manifold;
+		if (b2Loader_Read(loader, &saved, sizeof(saved)) == false ||
+		    b2Loader_Read(loader, &manifold, sizeof(manifold)) == false)
+		{
+			return;
+		}
+
+		b2Shape* s1 = b2Loader_Shape(loader, saved.m_shape1);
+		b2Shape* s2 = b2Loader_Shape(loader, saved.m_shape2);
+		if (s1 == NULL || s2 == NULL)
+		{
+			loader->error = true;
+			return;
+		}
+
+		b2Contact* c = b2Contact_Create(s1, s2, &loader->world->m_blockAllocator);
+		if (c == NULL || c->m_shape1 != s1)
+		{
+			loader->error = true;
+			return;
+		}
+		loader->contacts[i] = c;
+
+		saved.GetManifolds = c->GetManifolds;
+		saved.Evaluate = c->Evaluate;
+		*c = saved;
+		*c->GetManifolds(c) = manifold;
+	}
+}
+
+static void b2Loader_Link(b2Loader *loader)
+{
+	b2World* world = loader->world;
+
+	for (int32 i = 0; i < loader->bodyCount; ++i)
+	{
+		b2Body* b = loader->bodies[i];
+		b->m_world = world;
+		b->m_prev = b2Loader_Body(loader, b->m_prev);
+		b->m_next = b2Loader_Body(loader, b->m_next);
+		b->m_shapeList = b2Loader_Shape(loader, b->m_shapeList);
+		b->m_jointList = b2Loader_JointNode(loader, b->m_jointList);
+		b->m_contactList = b2Loader_ContactNode(loader, b->m_contactList);
+		b->m_userData = b2Loader_UserData(loader, b->m_userData);
+	}
+
+	for (int32 i = 0; i < loader->shapeCount; ++i)
+	{
+		b2Shape* s = loader->shapes[i];
+		s->m_next = b2Loader_Shape(loader, s->m_next);
+		s->m_body = b2Loader_Body(loader, s->m_body);
+		s->m_userData = b2Loader_UserData(loader, s->m_userData);
+	}
+
+	for (int32 i = 0; i < loader->jointCount; ++i)
+	{
+		b2Joint* j = loader->joints[i];
+		j->m_prev = b2Loader_Joint(loader, j->m_prev);
+		j->m_next = b2Loader_Joint(loader, j->m_next);
+		j->m_body1 = b2Loader_Body(loader, j->m_body1);
+		j->m_body2 = b2Loader_Body(loader, j->m_body2);
+		j->m_userData = b2Loader_UserData(loader, j->m_userData);
+
+		b2JointNode* nodes[2] = { &j->m_node1, &j->m_node2 };
+		for (int32 k = 0; k < 2; ++k)
+		{
+			nodes[k]->other = b2Loader_Body(loader, nodes[k]->other);
+			nodes[k]->joint = b2Loader_Joint(loader, nodes[k]->joint);
+			nodes[k]->prev = b2Loader_JointNode(loader, nodes[k]->prev);
+			nodes[k]->next = b2Loader_JointNode(loader, nodes[k]->next);
+		}
+	}
+
+	for (int32 i = 0; i < loader->contactCount; ++i)
+	{
+		b2Contact* c = loader->contacts[i];
+		c->m_prev = b2Loader_Contact(loader, c->m_prev);
+		c->m_next = b2Loader_Contact(loader, c->m_next);
+		c->m_shape1 = b2Loader_Shape(loader, c->m_shape1);
+		c->m_shape2 = b2Loader_Shape(loader, c->m_shape2);
+
+		b2ContactNode* nodes[2] = { &c->m_node1, &c->m_node2 };
+		for (int32 k = 0; k < 2; ++k)
+		{
+			nodes[k]->other = b2Loader_Body(loader, nodes[k]->other);
+			nodes[k]->contact = b2Loader_Contact(loader, nodes[k]->contact);
+			nodes[k]->prev = b2Loader_ContactNode(loader, nodes[k]->prev);
+			nodes[k]->next = b2Loader_ContactNode(loader, nodes[k]->next);
+		}
+	}
+}
+
+static void b2Loader_LoadBroadPhase(b2Loader *loader)
+{
+	b2World* world = loader->world;
+	b2BroadPhase* bp = world->m_broadPhase;
+
+	if (b2Loader_Read(loader, bp, sizeof(b2BroadPhase)) == false)
+	{
+		return;
+	}
+
+	bp->m_pairManager.m_broadPhase = bp;
+	bp->m_pairManager.m_callback = &world->m_contactManager.m_pairCallback;
+
+	for (int32 i = 0; i < b2_maxProxies; ++i)
+	{
+		b2Proxy* proxy = bp->m_proxyPool + i;
+		proxy->userData = b2Loader_Shape(loader, proxy->userData);
+	}
+
+	for (int32 i = 0; i < b2_maxPairs; ++i)
+	{
+		b2Pair* pair = bp->m_pairManager.m_pairs + i;
+		if (b2Unswizzle(pair->userData) == -2)
+		{
+			pair->userData = &world->m_contactManager.m_nullContact;
+		}
+		else
+		{
+			pair->userData = b2Loader_Contact(loader, pair->userData);
+		}
+	}
+}
+
+bool b2World_Restore(b2World *world, const char* data, int32 size,
+		     b2SnapshotUserDataFcn fcn, void* context)
+{
+	b2Loader loader;
+	loader.world = world;
+	loader.data = data;
+	loader.size = size;
+	loader.offset = 0;
+	loader.error = false;
+	loader.fcn = fcn;
+	loader.context = context;
+
+	if ((uint32)b2Loader_ReadInt(&loader) != b2_snapshotMagic ||
+	    (uint32)b2Loader_ReadInt(&loader) != b2_snapshotVersion ||
+	    b2Loader_ReadInt(&loader) != (int32)sizeof(void*) ||
+	    b2Loader_ReadInt(&loader) != (int32)sizeof(b2Body) ||
+	    b2Loader_ReadInt(&loader) != (int32)sizeof(b2BodyState) ||
+	    b2Loader_ReadInt(&loader) != (int32)sizeof(b2BroadPhase))
+	{
+		return false;
+	}
+
+	loader.bodyCount = b2Loader_ReadInt(&loader);
+	loader.shapeCount = b2Loader_ReadInt(&loader);
+	loader.jointCount = b2Loader_ReadInt(&loader);
+	loader.contactCount = b2Loader_ReadInt(&loader);
+
+	// Every object takes more than one byte, this rejects bogus counts
+	// before anything is allocated.
+	int32 remaining = size - loader.offset;
+	if (loader.error ||
+	    loader.bodyCount < 0 || loader.bodyCount > remaining ||
+	    loader.shapeCount < 0 || loader.shapeCount > remaining ||
+	    loader.jointCount < 0 || loader.jointCount > remaining ||
+	    loader.contactCount < 0 || loader.contactCount > remaining)
+	{
+		return false;
+	}
+
+	b2BlockAllocator_ctor(&world->m_blockAllocator);
+	b2StackAllocator_ctor(&world->m_stackAllocator);
+	b2ContactManager_ctor(&world->m_contactManager);
+	world->m_contactManager.m_world = world;
+	world->m_filter = NULL;
+	world->m_profiling = false;
+	world->m_parallelFor = NULL;
+	world->m_parallelContext = NULL;
+	world->m_workerAllocators = NULL;
+	world->m_workerCount = 0;
+	b2Profile_ctor(&world->m_profile);
+	b2Profile_ctor(&world->m_profileTotal);
+	world->m_broadPhase = (b2BroadPhase *)b2Alloc(sizeof(b2BroadPhase));
+
+	loader.bodies = (b2Body**)b2Alloc((loader.bodyCount + 1) * sizeof(b2Body*));
+	loader.shapes = (b2Shape**)b2Alloc((loader.shapeCount + 1) * sizeof(b2Shape*));
+	loader.joints = (b2Joint**)b2Alloc((loader.jointCount + 1) * sizeof(b2Joint*));
+	loader.contacts = (b2Contact**)b2Alloc((loader.contactCount + 1) * sizeof(b2Contact*));
+
+	world->m_bodyCount = b2Loader_ReadInt(&loader);
+	world->m_contactCount = b2Loader_ReadInt(&loader);
+	world->m_jointCount = b2Loader_ReadInt(&loader);
+
+	int32 bodyList = b2Loader_ReadInt(&loader);
+	int32 bodyDestroyList = b2Loader_ReadInt(&loader);
+	int32 groundBody = b2Loader_ReadInt(&loader);
+	int32 jointList = b2Loader_ReadInt(&loader);
+	int32 contactList = b2Loader_ReadInt(&loader);
+
+	b2Loader_Read(&loader, &world->m_gravity, sizeof(world->m_gravity));
+	world->m_allowSleep = b2Loader_ReadInt(&loader) != 0;
+	world->m_warmStarting = b2Loader_ReadInt(&loader) != 0;
+	world->m_positionCorrection = b2Loader_ReadInt(&loader) != 0;
+	world->m_islandStamp = (uint32)b2Loader_ReadInt(&loader);
+
+	b2Loader_LoadBodies(&loader);
+	b2Loader_LoadShapes(&loader);
+	b2Loader_LoadJoints(&loader);
+	b2Loader_LoadContacts(&loader);
+
+	if (loader.error == false)
+	{
+		b2Loader_Link(&loader);
+		b2Loader_LoadBroadPhase(&loader);
+
+		world->m_bodyList = (b2Body*)b2Loader_Resolve(&loader, (void**)loader.bodies, loader.bodyCount, bodyList);
+		world->m_bodyDestroyList = (b2Body*)b2Loader_Resolve(&loader, (void**)loader.bodies, loader.bodyCount, bodyDestroyList);
+		world->m_groundBody = (b2Body*)b2Loader_Resolve(&loader, (void**)loader.bodies, loader.bodyCount, groundBody);
+		world->m_jointList = (b2Joint*)b2Loader_Resolve(&loader, (void**)loader.joints, loader.jointCount, jointList);
+		world->m_contactList = (b2Contact*)b2Loader_Resolve(&loader, (void**)loader.contacts, loader.contactCount, contactList);
+	}
+
+	if (loader.error == false)
+	{
+		b2ContactManager_ResetSleep(&world->m_contactManager);
+	}
+
+	b2Free(loader.bodies);
+	b2Free(loader.shapes);
+	b2Free(loader.joints);
+	b2Free(loader.contacts);
+
+	if (loader.error || loader.offset != size || world->m_groundBody == NULL)
+	{
+		b2Free(world->m_broadPhase);
+		b2Free(world->m_bodyStateBuffer);
+		b2BlockAllocator_dtor(&world->m_blockAllocator);
+		return false;
+	}
+
+	return true;
+}
@@ -0,0 +1,64 @@
+/*
+* Copyright (c) 2006-2007 Erin Catto http://www.gphysics.com
+*
+* This software is provided 'as-is', without any express or implied
+* warranty.  In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+#include <box2d/b2Timer.h>
+
+#ifdef __wasm__
+
+double performance_now(void);
+
+static float64 b2Timer_Now(void)
+{
+	return performance_now();
+}
+
+#else
+
+#include <time.h>
+
+static float64 b2Timer_Now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000.0 + ts.tv_nsec * 1e-6;
+}
+
+#endif
+
+void b2Timer_ctor(b2Timer *timer)
+{
+	b2Timer_Reset(timer);
+}
+
+void b2Timer_Reset(b2Timer *timer)
+{
+	timer->m_start = b2Timer_Now();
+}
+
+float64 b2Timer_GetMilliseconds(const b2Timer *timer)
+{
+	return b2Timer_Now() - timer->m_start;
+}
+
+float64 b2Timer_Lap(b2Timer *timer)
+{
+	float64 now = b2Timer_Now();
+	float64 elapsed = now - timer->m_start;
+	timer->m_start = now;
+	return elapsed;
+}
@@ -24,9 +24,9 @@
 #include <box2d/b2Collision.h>
 #include <box2d/b2BroadPhase.h>
 #include <box2d/b2Shape.h>
-
-int32 b2World_s_enablePositionCorrection = 1;
-int32 b2World_s_enableWarmStarting = 1;
+#include <box2d/b2Timer.h>
+#include <stdint.h>
+#include <string.h>
 
 void b2World_ctor(b2World *world, const b2AABB *worldAABB, b2Vec2 gravity, bool doSleep)
 {
@@ -46,10 +46,29 @@ void b2World_ctor(b2World *world, const b2AABB *worldAABB, b2Vec2 gravity, bool
 
 	world->m_bodyDestroyList = NULL;
 
+	world->m_bodyStates = NULL;
+	world->m_bodyStateBuffer = NULL;
+	world->m_bodyStateCount = 0;
+	world->m_bodyStateCapacity = 0;
+
+	world->m_islandStamp = 0;
+
 	world->m_allowSleep = doSleep;
 
+	world->m_warmStarting = true;
+	world->m_positionCorrection = true;
+
 	world->m_gravity = gravity;
 
+	world->m_profiling = false;
+	b2Profile_ctor(&world->m_profile);
+	b2Profile_ctor(&world->m_profileTotal);
+
+	world->m_parallelFor = NULL;
+	world->m_parallelContext = NULL;
+	world->m_workerAllocators = NULL;
+	world->m_workerCount = 0;
+
 	world->m_contactManager.m_world = world;
 	world->m_broadPhase = (b2BroadPhase *)b2Alloc(sizeof(b2BroadPhase));
 	b2BroadPhase_ctor(world->m_broadPhase, *worldAABB, &world->m_contactManager.m_pairCallback);
@@ -63,18 +82,110 @@ void b2World_dtor(b2World *world)
 {
 	b2World_DestroyBody(world, world->m_groundBody);
 	b2Free(world->m_broadPhase);
+	b2World_SetParallel(world, NULL, NULL, 0);
+	b2Free(world->m_bodyStateBuffer);
 
 	b2BlockAllocator_dtor(&world->m_blockAllocator);
 }
 
+void b2Profile_ctor(b2Profile *profile)
+{
+	memset(profile, 0, sizeof(b2Profile));
+}
+
+void b2Profile_Add(b2Profile *total, const b2Profile *profile)
+{
+	total->step += profile->step;
+	total->cleanContactList += profile->cleanContactList;
+	total->cleanBodyList += profile->cleanBodyList;
+	total->collide += profile->collide;
+	total->islandSearch += profile->islandSearch;
+	total->preSolve += profile->preSolve;
+	total->solveVelocity += profile->solveVelocity;
+	total->integratePositions += profile->integratePositions;
+	total->solvePosition += profile->solvePosition;
+	total->synchronize += profile->synchronize;
+	total->broadPhaseCommit += profile->broadPhaseCommit;
+	total->parallelSolve += profile->parallelSolve;
+
+	total->stepCount += profile->stepCount;
+	total->contactsEvaluated += profile->contactsEvaluated;
+	total->islandCount += profile->islandCount;
+	total->islandBodyCount += profile->islandBodyCount;
+	total->maxIslandBodyCount = b2Max(total->maxIslandBodyCount, profile->maxIslandBodyCount);
+	total->positionIterations += profile->positionIterations;
+}
+
 void b2World_SetFilter(b2World *world, b2CollisionFilter filter)
 {
 	world->m_filter = filter;
 }
 
+void b2World_SetParallel(b2World *world, b2ParallelFor parallelFor, void* context, int32 workerCount)
+{
+	if (world->m_workerAllocators)
+	{
+		b2Free(world->m_workerAllocators);
+		world->m_workerAllocators = NULL;
+		world->m_workerCount = 0;
+	}
+
+	world->m_parallelFor = parallelFor;
+	world->m_parallelContext = context;
+
+	if (parallelFor == NULL)
+	{
+		return;
+	}
+
+	world->m_workerAllocators = (b2StackAllocator*)b2Alloc(workerCount * sizeof(b2StackAllocator));
+	world->m_workerCount = workerCount;
+	for (int32 i = 0; i < workerCount; ++i)
+	{
+		b2StackAllocator_ctor(world->m_workerAllocators + i);
+	}
+}
+
+// Growing the state array moves every state, the owners are re-pointed.
+static b2BodyState* b2World_AllocateBodyState(b2World *world)
+{
+	if (world->m_bodyStateCount == world->m_bodyStateCapacity)
+	{
+		int32 capacity = world->m_bodyStateCapacity ? 2 * world->m_bodyStateCapacity : 64;
+		void* buffer = b2Alloc(capacity * sizeof(b2BodyState) + b2_cacheLineSize - 1);
+		uintptr_t aligned = ((uintptr_t)buffer + b2_cacheLineSize - 1) & ~(uintptr_t)(b2_cacheLineSize - 1);
+		b2BodyState* states = (b2BodyState*)aligned;
+
+		for (int32 i = 0; i < world->m_bodyStateCount; ++i)
+		{
+			states[i] = world->m_bodyStates[i];
+			states[i].body->m_state = states + i;
+		}
+
+		b2Free(world->m_bodyStateBuffer);
+		world->m_bodyStates = states;
+		world->m_bodyStateBuffer = buffer;
+		world->m_bodyStateCapacity = capacity;
+	}
+
+	return world->m_bodyStates + world->m_bodyStateCount++;
+}
+
+// Keeps the array dense by moving the last state into the hole.
+static void b2World_FreeBodyState(b2World *world, b2BodyState* state)
+{
+	b2BodyState* last = world->m_bodyStates + --world->m_bodyStateCount;
+	if (state != last)
+	{
+		*state = *last;
+		state->body->m_state = state;
+	}
+}
+
 b2Body* b2World_CreateBody(b2World *world, const b2BodyDef* def)
 {
 	b2Body* b = (b2Body *)b2BlockAllocator_Allocate(&world->m_blockAllocator, sizeof(b2Body));
+	b->m_state = b2World_AllocateBodyState(world);
 	b2Body_ctor(b, def, world);
 	b->m_prev = NULL;
 
@@ -92,7 +203,7 @@ b2Body* b2World_CreateBody(b2World *world, const b2BodyDef* def)
 // Body destruction is deferred to make contact processing more robust.
 void b2World_DestroyBody(b2World *world, b2Body* b)
 {
-	if (b->m_flags & b2Body_e_destroyFlag)
+	if (b->m_state->flags & b2Body_e_destroyFlag)
 	{
 		return;
 	}
@@ -113,7 +224,7 @@ void b2World_DestroyBody(b2World *world, b2Body* b)
 		world->m_bodyList = b->m_next;
 	}
 
-	b->m_flags |= b2Body_e_destroyFlag;
+	b->m_state->flags |= b2Body_e_destroyFlag;
 	--world->m_bodyCount;
 
 	// Add to the deferred destruction list.
@@ -125,6 +236,12 @@ void b2World_DestroyBody(b2World *world, b2Body* b)
 extern "C"
 void b2World_CleanBodyList(b2World *world)
 {
+	// The contact manager may still hold some of these bodies.
+	if (world->m_bodyDestroyList)
+	{
+		b2ContactManager_SyncSleep(&world->m_contactManager);
+	}
+
 	world->m_contactManager.m_destroyImmediate = true;
 
 	b2Body* b = world->m_bodyDestroyList;
@@ -145,6 +262,7 @@ void b2World_CleanBodyList(b2World *world)
 		}
 
 		b2Body_dtor(b0);
+		b2World_FreeBodyState(world, b0->m_state);
 		b2BlockAllocator_Free(&world->m_blockAllocator, b0, sizeof(b2Body));
 	}
 
@@ -279,11 +397,216 @@ void b2World_DestroyJoint(b2World *world, b2Joint* j)
 	}
 }
 
+// Add everything connected to seed to the island, marking it with stamp.
+// stack must have room for every body.
+static void b2World_BuildIsland(b2Island* island, b2Body* seed, b2Body** stack, uint32 stamp)
+{
+	int32 stackCount = 0;
+	stack[stackCount++] = seed;
+	seed->m_state->islandStamp = stamp;
+
+	// Perform a depth first search (DFS) on the constraint graph.
+	while (stackCount > 0)
+	{
+		// Grab the next body off the stack and add it to the island.
+		b2Body* b = stack[--stackCount];
+		b2Island_AddBody(island, b);
+
+		// Make sure the body is awake.
+		b2Body_SetSleepFlag(b, false);
+
+		// To keep islands as small as possible, we don't
+		// propagate islands across static bodies.
+		if (b->m_state->flags & b2Body_e_staticFlag)
+		{
+			continue;
+		}
+
+		// Search all contacts connected to this body.
+		for (b2ContactNode* cn = b->m_contactList; cn; cn = cn->next)
+		{
+			if (cn->contact->m_islandStamp == stamp)
+			{
+				continue;
+			}
+
+			b2Island_AddContact(island, cn->contact);
+			cn->contact->m_islandStamp = stamp;
+
+			b2Body* other = cn->other;
+			if (other->m_state->islandStamp == stamp)
+			{
+				continue;
+			}
+
+			stack[stackCount++] = other;
+			other->m_state->islandStamp = stamp;
+		}
+
+		// Search all joints connect to this body.
+		for (b2JointNode* jn = b->m_jointList; jn; jn = jn->next)
+		{
+			if (jn->joint->m_islandStamp == stamp)
+			{
+				continue;
+			}
+
+			b2Island_AddJoint(island, jn->joint);
+			jn->joint->m_islandStamp = stamp;
+
+			b2Body* other = jn->other;
+			if (other->m_state->islandStamp == stamp)
+			{
+				continue;
+			}
+
+			stack[stackCount++] = other;
+			other->m_state->islandStamp = stamp;
+		}
+	}
+
+	b2Island_IndexConstraints(island);
+}
+
+typedef struct b2ParallelSolve b2ParallelSolve;
+struct b2ParallelSolve
+{
+	b2World* world;
+	const b2TimeStep* step;
+	b2Island* islands;
+};
+
+static void b2World_SolveIsland(void* data, int32 index, int32 worker)
+{
+	b2ParallelSolve* solve = (b2ParallelSolve*)data;
+	b2Island* island = solve->islands + index;
+
+	island->m_allocator = solve->world->m_workerAllocators + worker;
+	b2Island_Solve(island, solve->step, solve->world->m_gravity);
+}
+
+// Islands share nothing but static bodies, which the solvers leave
+// alone, so their solves can run at the same time. First all islands
+// are built, then solved through the parallel for. What has to happen
+// in order, moving the broadphase proxies and the sleep flags of the
+// static bodies, is then done island by island like the sequential loop.
+static void b2World_SolveParallel(b2World* world, const b2TimeStep* step, b2Body** stack, b2Profile* profile, b2Timer* timer)
+{
+	b2StackAllocator* allocator = &world->m_stackAllocator;
+
+	// A static body joins an island through one of its contacts or
+	// joints, so this bounds the bodies of all islands together.
+	int32 bodyCapacity = world->m_bodyCount + world->m_contactCount + world->m_jointCount;
+
+	b2Island* islands = (b2Island*)b2StackAllocator_Allocate(allocator, world->m_bodyCount * sizeof(b2Island));
+	b2Body** bodies = (b2Body**)b2StackAllocator_Allocate(allocator, bodyCapacity * sizeof(b2Body*));
+	b2Contact** contacts = (b2Contact**)b2StackAllocator_Allocate(allocator, world->m_contactCount * sizeof(b2Contact*));
+	b2Joint** joints = (b2Joint**)b2StackAllocator_Allocate(allocator, world->m_jointCount * sizeof(b2Joint*));
+
+	uint32 stamp = world->m_islandStamp;
+	int32 islandCount = 0;
+	int32 bodyCount = 0;
+	int32 contactCount = 0;
+	int32 jointCount = 0;
+
+	for (b2Body* seed = world->m_bodyList; seed; seed = seed->m_next)
+	{
+		if (seed->m_state->flags & (b2Body_e_staticFlag | b2Body_e_sleepFlag | b2Body_e_frozenFlag) ||
+			seed->m_state->islandStamp == stamp)
+		{
+			continue;
+		}
+
+		b2Island* island = islands + islandCount++;
+		island->m_allocator = NULL;
+		island->m_bodies = bodies + bodyCount;
+		island->m_contacts = contacts + contactCount;
+		island->m_joints = joints + jointCount;
+		island->m_bodyCapacity = bodyCapacity - bodyCount;
+		island->m_contactCapacity = world->m_contactCount - contactCount;
+		island->m_jointCapacity = world->m_jointCount - jointCount;
+		island->m_positionIterations = 0;
+		island->m_profile = NULL;
+
+		b2Island_Clear(island);
+		b2World_BuildIsland(island, seed, stack, stamp);
+
+		bodyCount += island->m_bodyCount;
+		contactCount += island->m_contactCount;
+		jointCount += island->m_jointCount;
+
+		// Allow static bodies to participate in other islands.
+		for (int32 i = 0; i < island->m_bodyCount; ++i)
+		{
+			b2Body* b = island->m_bodies[i];
+			if (b->m_state->flags & b2Body_e_staticFlag)
+			{
+				b->m_state->islandStamp = 0;
+			}
+		}
+	}
+
+	if (profile)
+	{
+		profile->islandSearch += b2Timer_Lap(timer);
+	}
+
+	b2ParallelSolve solve;
+	solve.world = world;
+	solve.step = step;
+	solve.islands = islands;
+	world->m_parallelFor(world->m_parallelContext, b2World_SolveIsland, &solve, islandCount);
+
+	if (profile)
+	{
+		profile->parallelSolve += b2Timer_Lap(timer);
+	}
+
+	for (int32 i = 0; i < islandCount; ++i)
+	{
+		b2Island* island = islands + i;
+
+		island->m_profile = profile;
+		b2Island_Synchronize(island);
+
+		if (profile)
+		{
+			profile->islandCount += 1;
+			profile->islandBodyCount += island->m_bodyCount;
+			profile->maxIslandBodyCount = b2Max(profile->maxIslandBodyCount, (uint32)island->m_bodyCount);
+			profile->positionIterations += island->m_positionIterations;
+		}
+
+		if (world->m_allowSleep)
+		{
+			// Building this island woke its static bodies, but an
+			// earlier island may have put them back to sleep since.
+			for (int32 j = 0; j < island->m_bodyCount; ++j)
+			{
+				b2Body* b = island->m_bodies[j];
+				if (b->m_state->flags & b2Body_e_staticFlag)
+				{
+					b2Body_SetSleepFlag(b, false);
+				}
+			}
+
+			b2Island_UpdateSleep(island, step->dt);
+		}
+	}
+
+	b2StackAllocator_Free(allocator, joints);
+	b2StackAllocator_Free(allocator, contacts);
+	b2StackAllocator_Free(allocator, bodies);
+	b2StackAllocator_Free(allocator, islands);
+}
+
 void b2World_Step(b2World *world, float64 dt, int32 iterations)
 {
 	b2TimeStep step;
 	step.dt = dt;
 	step.iterations	= iterations;
+	step.warmStarting = world->m_warmStarting;
+	step.positionCorrection = world->m_positionCorrection;
 	if (dt > 0.0)
 	{
 		step.inv_dt = 1.0 / dt;
@@ -293,131 +616,140 @@ void b2World_Step(b2World *world, float64 dt, int32 iterations)
 		step.inv_dt = 0.0;
 	}
 
+	b2Profile* profile = world->m_profiling ? &world->m_profile : NULL;
+	b2Timer stepTimer, timer;
+	if (profile)
+	{
+		b2Profile_ctor(profile);
+		profile->stepCount = 1;
+		b2Timer_ctor(&stepTimer);
+		b2Timer_ctor(&timer);
+	}
+
 	// Handle deferred contact destruction.
 	b2ContactManager_CleanContactList(&world->m_contactManager);
 
+	if (profile)
+	{
+		profile->cleanContactList = b2Timer_Lap(&timer);
+	}
+
 	// Handle deferred body destruction.
 	b2World_CleanBodyList(world);
 
+	if (profile)
+	{
+		profile->cleanBodyList = b2Timer_Lap(&timer);
+	}
+
 	// Update contacts.
-	b2ContactManager_Collide(&world->m_contactManager);
+	int32 contactsEvaluated = b2ContactManager_Collide(&world->m_contactManager);
+
+	if (profile)
+	{
+		profile->collide = b2Timer_Lap(&timer);
+		profile->contactsEvaluated = contactsEvaluated;
+	}
 
 	// Size the island for the worst case.
 	b2Island island;
 	b2Island_ctor(&island, world->m_bodyCount, world->m_contactCount, world->m_jointCount, &world->m_stackAllocator);
+	island.m_profile = profile;
 
-	// Clear all the island flags.
-	for (b2Body* b = world->m_bodyList; b; b = b->m_next)
-	{
-		b->m_flags &= ~b2Body_e_islandFlag;
-	}
-	for (b2Contact* c = world->m_contactList; c; c = c->m_next)
-	{
-		c->m_flags &= ~b2Contact_e_islandFlag;
-	}
-	for (b2Joint* j = world->m_jointList; j; j = j->m_next)
+	// A fresh stamp unmarks everything at once. Should it ever wrap, the
+	// old marks are cleared so that none of them can match it.
+	uint32 stamp = ++world->m_islandStamp;
+	if (stamp == 0)
 	{
-		j->m_islandFlag = false;
+		for (int32 i = 0; i < world->m_bodyStateCount; ++i)
+		{
+			world->m_bodyStates[i].islandStamp = 0;
+		}
+		for (b2Contact* c = world->m_contactList; c; c = c->m_next)
+		{
+			c->m_islandStamp = 0;
+		}
+		for (b2Joint* j = world->m_jointList; j; j = j->m_next)
+		{
+			j->m_islandStamp = 0;
+		}
+
+		stamp = world->m_islandStamp = 1;
 	}
-	
+
 	// Build and simulate all awake islands.
 	int32 stackSize = world->m_bodyCount;
 	b2Body** stack = (b2Body**)b2StackAllocator_Allocate(&world->m_stackAllocator, stackSize * sizeof(b2Body*));
-	for (b2Body* seed = world->m_bodyList; seed; seed = seed->m_next)
+	if (world->m_parallelFor != NULL)
 	{
-		if (seed->m_flags & (b2Body_e_staticFlag | b2Body_e_islandFlag | b2Body_e_sleepFlag | b2Body_e_frozenFlag))
-		{
-			continue;
-		}
-
-		// Reset island and stack.
-		b2Island_Clear(&island);
-		int32 stackCount = 0;
-		stack[stackCount++] = seed;
-		seed->m_flags |= b2Body_e_islandFlag;
-
-		// Perform a depth first search (DFS) on the constraint graph.
-		while (stackCount > 0)
+		b2World_SolveParallel(world, &step, stack, profile, &timer);
+	}
+	else
+	{
+		for (b2Body* seed = world->m_bodyList; seed; seed = seed->m_next)
 		{
-			// Grab the next body off the stack and add it to the island.
-			b2Body* b = stack[--stackCount];
-			b2Island_AddBody(&island, b);
-
-			// Make sure the body is awake.
-			b->m_flags &= ~b2Body_e_sleepFlag;
-
-			// To keep islands as small as possible, we don't
-			// propagate islands across static bodies.
-			if (b->m_flags & b2Body_e_staticFlag)
+			if (seed->m_state->flags & (b2Body_e_staticFlag | b2Body_e_sleepFlag | b2Body_e_frozenFlag) ||
+				seed->m_state->islandStamp == stamp)
 			{
 				continue;
 			}
 
-			// Search all contacts connected to this body.
-			for (b2ContactNode* cn = b->m_contactList; cn; cn = cn->next)
-			{
-				if (cn->contact->m_flags & b2Contact_e_islandFlag)
-				{
-					continue;
-				}
-
-				b2Island_AddContact(&island, cn->contact);
-				cn->contact->m_flags |= b2Contact_e_islandFlag;
-
-				b2Body* other = cn->other;
-				if (other->m_flags & b2Body_e_islandFlag)
-				{
-					continue;
-				}
-
-				stack[stackCount++] = other;
-				other->m_flags |= b2Body_e_islandFlag;
-			}
+			// Reset island and stack.
+			b2Island_Clear(&island);
+			b2World_BuildIsland(&island, seed, stack, stamp);
 
-			// Search all joints connect to this body.
-			for (b2JointNode* jn = b->m_jointList; jn; jn = jn->next)
+			// The island search time also covers the sleep and flag
+			// bookkeeping after each solve.
+			if (profile)
 			{
-				if (jn->joint->m_islandFlag == true)
-				{
-					continue;
-				}
-
-				b2Island_AddJoint(&island, jn->joint);
-				jn->joint->m_islandFlag = true;
+				profile->islandSearch += b2Timer_Lap(&timer);
+			}
 
-				b2Body* other = jn->other;
-				if (other->m_flags & b2Body_e_islandFlag)
-				{
-					continue;
-				}
+			b2Island_Solve(&island, &step, world->m_gravity);
+			b2Island_Synchronize(&island);
 
-				stack[stackCount++] = other;
-				other->m_flags |= b2Body_e_islandFlag;
+			if (profile)
+			{
+				b2Timer_Reset(&timer);
+				profile->islandCount += 1;
+				profile->islandBodyCount += island.m_bodyCount;
+				profile->maxIslandBodyCount = b2Max(profile->maxIslandBodyCount, (uint32)island.m_bodyCount);
+				profile->positionIterations += island.m_positionIterations;
 			}
-		}
-
-		b2Island_Solve(&island, &step, world->m_gravity);
 		
-		if (world->m_allowSleep)
-		{
-			b2Island_UpdateSleep(&island, dt);
-		}
+			if (world->m_allowSleep)
+			{
+				b2Island_UpdateSleep(&island, dt);
+			}
 
-		// Post solve cleanup.
-		for (int32 i = 0; i < island.m_bodyCount; ++i)
-		{
-			// Allow static bodies to participate in other islands.
-			b2Body* b = island.m_bodies[i];
-			if (b->m_flags & b2Body_e_staticFlag)
+			// Post solve cleanup.
+			for (int32 i = 0; i < island.m_bodyCount; ++i)
 			{
-				b->m_flags &= ~b2Body_e_islandFlag;
+				// Allow static bodies to participate in other islands.
+				b2Body* b = island.m_bodies[i];
+				if (b->m_state->flags & b2Body_e_staticFlag)
+				{
+					b->m_state->islandStamp = 0;
+				}
 			}
 		}
 	}
 
 	b2StackAllocator_Free(&world->m_stackAllocator, stack);
 
+	if (profile)
+	{
+		profile->islandSearch += b2Timer_Lap(&timer);
+	}
+
 	b2BroadPhase_Commit(world->m_broadPhase);
 
 	b2Island_dtor(&island);
+
+	if (profile)
+	{
+		profile->broadPhaseCommit = b2Timer_Lap(&timer);
+		profile->step = b2Timer_GetMilliseconds(&stepTimer);
+		b2Profile_Add(&world->m_profileTotal, profile);
+	}
 }
@@ -6,6 +6,7 @@
 #include "graph.h"
 #include "button.h"
 #include "text.h"
+#include "grid.h"
 #include "arena.h"
 #include "xml.h"
 
@@ -14,31 +15,37 @@ struct arena the_arena;
 void key_down(int key)
 {
 	arena_key_down_event(&the_arena, key);
+	arena_publish(&the_arena);
 }
 
 void key_up(int key)
 {
 	arena_key_up_event(&the_arena, key);
+	arena_publish(&the_arena);
 }
 
 void move(int x, int y)
 {
 	arena_mouse_move_event(&the_arena, x, y);
+	arena_publish(&the_arena);
 }
 
 void button_down(int button)
 {
 	arena_mouse_button_down_event(&the_arena, button);
+	arena_publish(&the_arena);
 }
 
 void button_up(int button)
 {
 	arena_mouse_button_up_event(&the_arena, button);
+	arena_publish(&the_arena);
 }
 
 void scroll(int delta)
 {
 	arena_scroll_event(&the_arena, delta);
+	arena_publish(&the_arena);
 }
 
 void resize(int w, int h)
@@ -46,6 +53,7 @@ void resize(int w, int h)
 	glViewport(0, 0, w, h);
 
 	arena_size_event(&the_arena, w, h);
+	gl_flush();
 }
 
 void init(char *xml, int len)
@@ -61,6 +69,7 @@ void init(char *xml, int len)
 	*/
 
 	arena_init(&the_arena, 800, 800, xml, len);
+	gl_flush();
 }
 
 char *export_design(struct design *design, char *user, char *name, char *desc);
@@ -73,6 +82,7 @@ char *export(char *user, char *name, char *desc)
 void draw(void)
 {
 	arena_draw(&the_arena);
+	gl_flush();
 }
 
 void call(void (*func)(void *arg), void *arg)
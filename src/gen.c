@@ -6,9 +6,27 @@
 #include <box2d/b2Body.h>
 #include <box2d/b2World.h>
 #include <box2d/b2RevoluteJoint.h>
+#include <box2d/b2Snapshot.h>
 
 #include "graph.h"
 
+static bool is_neighbour(struct block *block, int index)
+{
+	int lo = 0;
+	int hi = block->neighbour_cnt;
+	int mid;
+
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		if (block->neighbours[mid] < index)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo < block->neighbour_cnt && block->neighbours[lo] == index;
+}
+
 static bool share_joint(struct block *block1, struct block *block2)
 {
 	struct joint *j1[5];
@@ -16,6 +34,9 @@ static bool share_joint(struct block *block1, struct block *block2)
 	int n1, n2;
 	int i1, i2;
 
+	if (block1->neighbours && block2->neighbours)
+		return is_neighbour(block1, block2->index);
+
 	n1 = get_block_joints(block1, j1);
 	n2 = get_block_joints(block2, j2);
 
@@ -128,6 +149,74 @@ void get_shell(struct shell *shell, struct shape *shape)
 	}
 }
 
+static void get_rect_bb(struct shell *shell, struct area *area)
+{
+	float sina = fp_sin(shell->angle);
+	float cosa = fp_cos(shell->angle);
+	float wc = shell->rect.w * cosa;
+	float ws = shell->rect.w * sina;
+	float hc = shell->rect.h * cosa;
+	float hs = shell->rect.h * sina;
+
+	area->x = shell->x;
+	area->y = shell->y;
+	area->w = fabs(wc) + fabs(hs);
+	area->h = fabs(ws) + fabs(hc);
+}
+
+static void get_circ_bb(struct shell *shell, struct area *area)
+{
+	area->x = shell->x;
+	area->y = shell->y;
+	area->w = shell->circ.radius * 2;
+	area->h = shell->circ.radius * 2;
+}
+
+static void get_block_bb(struct block *block, struct area *area)
+{
+	struct shell shell;
+
+	get_shell(&shell, &block->shape);
+	if (block->body) {
+		shell.x = block->body->m_state->position.x;
+		shell.y = block->body->m_state->position.y;
+		shell.angle = block->body->m_state->rotation;
+	}
+
+	if (shell.type == SHELL_CIRC)
+		get_circ_bb(&shell, area);
+	else
+		get_rect_bb(&shell, area);
+}
+
+int block_inside_area(struct block *block, struct area *area)
+{
+	struct area bb;
+
+	get_block_bb(block, &bb);
+
+	return bb.x - bb.w / 2 >= area->x - area->w / 2
+	    && bb.x + bb.w / 2 <= area->x + area->w / 2
+	    && bb.y - bb.h / 2 >= area->y - area->h / 2
+	    && bb.y + bb.h / 2 <= area->y + area->h / 2;
+}
+
+bool goal_blocks_inside_goal_area(struct design *design)
+{
+	struct block *block;
+	bool any = false;
+
+	for (block = design->player_blocks.head; block; block = block->next) {
+		if (block->goal) {
+			any = true;
+			if (!block_inside_area(block, &design->goal_area))
+				return false;
+		}
+	}
+
+	return any;
+}
+
 void gen_block(b2World *world, struct block *block)
 {
 	struct material *mat = block->material;
@@ -215,6 +304,158 @@ static void gen_joint_stack(b2World *world, struct joint *joint)
 	}
 }
 
+static int index_blocks(struct block_list *list, int index)
+{
+	struct block *block;
+
+	for (block = list->head; block; block = block->next) {
+		block->index = index++;
+		block->neighbour_cnt = 0;
+	}
+
+	return index;
+}
+
+static int count_rows(struct block_list *list)
+{
+	struct block *block;
+	int total = 0;
+
+	for (block = list->head; block; block = block->next)
+		total += block->neighbour_cnt;
+
+	return total;
+}
+
+static int *carve_rows(struct block_list *list, int *buf)
+{
+	struct block *block;
+
+	for (block = list->head; block; block = block->next) {
+		block->neighbours = buf;
+		buf += block->neighbour_cnt;
+		block->neighbour_cnt = 0;
+	}
+
+	return buf;
+}
+
+static int joint_block_cnt(struct joint *joint)
+{
+	struct attach_node *node;
+	int cnt = joint->gen ? 1 : 0;
+
+	for (node = joint->att.head; node; node = node->next)
+		cnt++;
+
+	return cnt;
+}
+
+/* Upper bound, a block attached to a joint twice is counted twice. */
+static void count_neighbours(struct joint *joint)
+{
+	struct attach_node *node;
+	int n = joint_block_cnt(joint);
+
+	if (joint->gen)
+		joint->gen->neighbour_cnt += n - 1;
+	for (node = joint->att.head; node; node = node->next)
+		node->block->neighbour_cnt += n - 1;
+}
+
+static void add_neighbours(struct joint *joint, struct block *block)
+{
+	struct attach_node *node;
+
+	if (joint->gen && joint->gen != block)
+		block->neighbours[block->neighbour_cnt++] = joint->gen->index;
+
+	for (node = joint->att.head; node; node = node->next) {
+		if (node->block != block)
+			block->neighbours[block->neighbour_cnt++] = node->block->index;
+	}
+}
+
+static void sort_row(struct block *block)
+{
+	int *row = block->neighbours;
+	int cnt = 0;
+	int val;
+	int i, j;
+
+	for (i = 1; i < block->neighbour_cnt; i++) {
+		val = row[i];
+		for (j = i; j > 0 && row[j - 1] > val; j--)
+			row[j] = row[j - 1];
+		row[j] = val;
+	}
+
+	for (i = 0; i < block->neighbour_cnt; i++) {
+		if (cnt == 0 || row[cnt - 1] != row[i])
+			row[cnt++] = row[i];
+	}
+
+	block->neighbour_cnt = cnt;
+}
+
+/*
+ * Blocks that share a joint never collide. Every new broadphase pair
+ * asks collision_filter(), so the blocks sharing a joint with each
+ * block are listed up front, from the joints' gen and attach lists,
+ * and looked up by index. Blocks the editor regenerates later drop
+ * their list and fall back to comparing joints.
+ */
+static void list_neighbours(struct design *design)
+{
+	struct attach_node *node;
+	struct joint *joint;
+	struct block *block;
+	int total;
+
+	index_blocks(&design->level_blocks,
+		     index_blocks(&design->player_blocks, 0));
+
+	for (joint = design->joints.head; joint; joint = joint->next)
+		count_neighbours(joint);
+
+	total = count_rows(&design->player_blocks) +
+		count_rows(&design->level_blocks);
+
+	/* Never NULL, an empty list is still a list. */
+	free(design->neighbour_buf);
+	design->neighbour_buf = malloc((total + 1) * sizeof(int));
+	carve_rows(&design->level_blocks,
+		   carve_rows(&design->player_blocks, design->neighbour_buf));
+
+	for (joint = design->joints.head; joint; joint = joint->next) {
+		if (joint->gen)
+			add_neighbours(joint, joint->gen);
+		for (node = joint->att.head; node; node = node->next)
+			add_neighbours(joint, node->block);
+	}
+
+	for (block = design->player_blocks.head; block; block = block->next)
+		sort_row(block);
+	for (block = design->level_blocks.head; block; block = block->next)
+		sort_row(block);
+}
+
+static void unlist_blocks(struct block_list *list)
+{
+	struct block *block;
+
+	for (block = list->head; block; block = block->next)
+		block->neighbours = NULL;
+}
+
+static void unlist_neighbours(struct design *design)
+{
+	unlist_blocks(&design->player_blocks);
+	unlist_blocks(&design->level_blocks);
+	free(design->neighbour_buf);
+	design->neighbour_buf = NULL;
+}
+
 b2World *gen_world(struct design *design)
 {
 	b2World *world = malloc(sizeof(*world));
@@ -231,6 +472,7 @@ b2World *gen_world(struct design *design)
 	aabb.maxVertex.y = 1450;
 	b2World_ctor(world, &aabb, gravity, true);
 	b2World_SetFilter(world, collision_filter);
+	list_neighbours(design);
 
 	for (block = design->player_blocks.head; block; block = block->next)
 		gen_block(world, block);
@@ -250,6 +492,7 @@ void free_world(b2World *world, struct design *design)
 
 	b2World_dtor(world);
 	free(world);
+	unlist_neighbours(design);
 
 	for (block = design->player_blocks.head; block; block = block->next)
 		block->body = NULL;
@@ -258,7 +501,163 @@ void free_world(b2World *world, struct design *design)
 		block->body = NULL;
 }
 
-void step(struct b2World *world)
+/*
+ * Shape user data points at blocks, which are stored in snapshots as
+ * their position in the design: player blocks first, then level blocks.
+ * That is the index list_neighbours() gave them, plus one so that no
+ * block is stored as NULL.
+ */
+static void *block_to_token(void *user_data, void *context)
+{
+	struct block *block = user_data;
+
+	return (void *)(intptr_t)(block->index + 1);
+}
+
+struct block_table {
+	struct block **blocks;
+	int cnt;
+};
+
+static int count_blocks(struct design *design)
+{
+	struct block *block;
+	int cnt = 0;
+
+	for (block = design->player_blocks.head; block; block = block->next)
+		cnt++;
+
+	for (block = design->level_blocks.head; block; block = block->next)
+		cnt++;
+
+	return cnt;
+}
+
+static void fill_table(struct block_table *table, struct design *design)
+{
+	struct block *block;
+	int i = 0;
+
+	table->cnt = count_blocks(design);
+	table->blocks = malloc((table->cnt + 1) * sizeof(*table->blocks));
+
+	for (block = design->player_blocks.head; block; block = block->next)
+		table->blocks[i++] = block;
+
+	for (block = design->level_blocks.head; block; block = block->next)
+		table->blocks[i++] = block;
+}
+
+/* Unknown tokens map to NULL, which makes b2World_Restore() fail. */
+static void *token_to_block(void *token, void *context)
+{
+	struct block_table *table = context;
+	intptr_t index = (intptr_t)token - 1;
+
+	if (index < 0 || index >= table->cnt)
+		return NULL;
+
+	return table->blocks[index];
+}
+
+/* Only valid for worlds made by gen_world() or restore_world(). */
+void save_world(b2World *world, struct design *design, b2Snapshot *snapshot)
+{
+	b2World_Save(world, snapshot, block_to_token, design);
+}
+
+/*
+ * Every block must get back exactly one body, anything else means the
+ * snapshot was taken from another design.
+ */
+b2World *restore_world(struct design *design, const char *data, int len)
+{
+	b2World *world = malloc(sizeof(*world));
+	struct block_table table;
+	struct block *block;
+	b2Body *body;
+	b2Shape *shape;
+	int body_cnt = 0;
+	bool ok;
+	int i;
+
+	fill_table(&table, design);
+	ok = b2World_Restore(world, data, len, token_to_block, &table);
+	if (!ok) {
+		free(table.blocks);
+		free(world);
+		return NULL;
+	}
+	b2World_SetFilter(world, collision_filter);
+	list_neighbours(design);
+
+	for (block = design->player_blocks.head; block; block = block->next)
+		block->body = NULL;
+
+	for (block = design->level_blocks.head; block; block = block->next)
+		block->body = NULL;
+
+	for (body = world->m_bodyList; body; body = body->m_next) {
+		if (body != world->m_groundBody)
+			body_cnt++;
+		for (shape = body->m_shapeList; shape; shape = shape->m_next) {
+			block = b2Shape_GetUserData(shape);
+			if (block)
+				block->body = body;
+		}
+	}
+
+	ok = body_cnt == table.cnt;
+	for (i = 0; ok && i < table.cnt; i++)
+		ok = table.blocks[i]->body != NULL;
+
+	free(table.blocks);
+	if (!ok) {
+		free_world(world, design);
+		return NULL;
+	}
+
+	return world;
+}
+
+uint64_t fnv1a(uint64_t hash, const void *data, size_t len)
+{
+	const unsigned char *p = data;
+
+	while (len--) {
+		hash ^= *p++;
+		hash *= 0x100000001b3;
+	}
+
+	return hash;
+}
+
+/*
+ * FNV-1a over the exact bit patterns of every body's position, rotation
+ * and velocities, in body list order, followed by the live joint count.
+ */
+uint64_t hash_world(struct b2World *world)
+{
+	uint64_t hash = 0xcbf29ce484222325;
+	b2Body *body;
+
+	for (body = world->m_bodyList; body; body = body->m_next) {
+		hash = fnv1a(hash, &body->m_state->position, sizeof(body->m_state->position));
+		hash = fnv1a(hash, &body->m_state->rotation, sizeof(body->m_state->rotation));
+		hash = fnv1a(hash, &body->m_state->linearVelocity, sizeof(body->m_state->linearVelocity));
+		hash = fnv1a(hash, &body->m_state->angularVelocity, sizeof(body->m_state->angularVelocity));
+	}
+	hash = fnv1a(hash, &world->m_jointCount, sizeof(world->m_jointCount));
+
+	return hash;
+}
+
+/*
+ * Advance the world by one tick. If hash is not NULL, the state hash
+ * after the tick is stored there, so that hash streams of two builds can
+ * be compared tick by tick.
+ */
+void step(struct b2World *world, uint64_t *hash)
 {
 	b2World_Step(world, 1.0 / 30.0, 10);
 
@@ -271,4 +670,7 @@ void step(struct b2World *world)
 			b2World_DestroyJoint(world, joint);
 		joint = next;
 	}
+
+	if (hash)
+		*hash = hash_world(world);
 }
@@ -468,3 +468,21 @@ GL_APICALL void GL_APIENTRY glVertexAttrib4f (GLuint index, GLfloat x, GLfloat y
 GL_APICALL void GL_APIENTRY glVertexAttrib4fv (GLuint index, const GLfloat *v);
 GL_APICALL void GL_APIENTRY glVertexAttribPointer (GLuint index, GLint size, GLenum type, GLboolean normalized, GLsizei stride, const void *pointer);
 GL_APICALL void GL_APIENTRY glViewport (GLint x, GLint y, GLsizei width, GLsizei height);
+
+/*
+ * ANGLE_instanced_arrays. Only call these if gl_instanced_arrays() says
+ * the extension is available.
+ */
+GLboolean gl_instanced_arrays(void);
+GL_APICALL void GL_APIENTRY glVertexAttribDivisorANGLE (GLuint index, GLuint divisor);
+GL_APICALL void GL_APIENTRY glDrawElementsInstancedANGLE (GLenum mode, GLsizei count, GLenum type, const void *indices, GLsizei primcount);
+
+/*
+ * The wasm build queues GL calls and sends them to JS in one go, see
+ * arch/wasm/gl.c. Call this before returning to JS.
+ */
+#ifdef __wasm__
+void gl_flush(void);
+#else
+static inline void gl_flush(void) { }
+#endif
@@ -537,6 +537,7 @@ static void add_level_block(struct design *design, struct xml_block *xml_block)
 	block->body = NULL;
 	block->overlap = false;
 	block->visited = false;
+	block->neighbours = NULL;
 
 	append_block(&design->level_blocks, block);
 }
@@ -603,6 +604,7 @@ static void add_player_block(struct design *design, struct xml_block *xml_block)
 	block->body = NULL;
 	block->overlap = false;
 	block->visited = false;
+	block->neighbours = NULL;
 
 	append_block(&design->player_blocks, block);
 }
@@ -633,6 +635,7 @@ void convert_xml(struct xml_level *xml_level, struct design *design)
 	set_area(&design->goal_area, &xml_level->end, 0.0);
 
 	design->level_id = xml_level->level_id;
+	design->neighbour_buf = NULL;
 }
 
 static void free_attach_list(struct attach_list *list)
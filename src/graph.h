@@ -4,6 +4,9 @@ struct b2Body;
 typedef struct b2World b2World;
 struct b2World;
 
+typedef struct b2Snapshot b2Snapshot;
+struct b2Snapshot;
+
 struct attach_node {
 	struct attach_node *prev;
 	struct attach_node *next;
@@ -20,6 +23,13 @@ struct attach_list {
 void append_attach_node(struct attach_list *list, struct attach_node *node);
 void remove_attach_node(struct attach_list *list, struct attach_node *node);
 
+/* Where a joint or block is filed in the editor's hit test grid, see grid.h. */
+struct grid_cells {
+	int x0, y0;
+	int x1, y1;
+	unsigned int seq;
+};
+
 struct joint {
 	struct joint *prev;
 	struct joint *next;
@@ -27,6 +37,7 @@ struct joint {
 	double x, y;
 	struct attach_list att;
 	bool visited;
+	struct grid_cells cells;
 };
 
 struct joint *new_joint(struct block *gen, double x, double y);
@@ -153,6 +164,11 @@ struct block {
 	float g;
 	float b;
 	b2Body *body;
+	struct grid_cells cells;
+	/* Sorted indices of the blocks sharing a joint, see list_neighbours(). */
+	int index;
+	int *neighbours;
+	int neighbour_cnt;
 };
 
 struct block_list {
@@ -175,6 +191,7 @@ struct design {
 	struct area build_area;
 	struct area goal_area;
 	int level_id;
+	int *neighbour_buf;
 };
 
 enum shell_type {
@@ -207,7 +224,13 @@ void free_design(struct design *design);
 
 b2World *gen_world(struct design *design);
 void free_world(b2World *world, struct design *design);
+void save_world(b2World *world, struct design *design, b2Snapshot *snapshot);
+b2World *restore_world(struct design *design, const char *data, int len);
 
-void step(struct b2World *world);
+void step(struct b2World *world, uint64_t *hash);
+uint64_t hash_world(struct b2World *world);
+uint64_t fnv1a(uint64_t hash, const void *data, size_t len);
 void get_shell(struct shell *shell, struct shape *shape);
 int get_block_joints(struct block *block, struct joint **res);
+int block_inside_area(struct block *block, struct area *area);
+bool goal_blocks_inside_goal_area(struct design *design);
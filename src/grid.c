@@ -0,0 +1,312 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "graph.h"
+#include "grid.h"
+
+/* Covers the float rounding of rect_is_hit() and circ_is_hit(). */
+#define GRID_SLACK 1.0
+
+static int cell_of(double v)
+{
+	double c = v / GRID_CELL_SIZE;
+	int i = (int)c;
+
+	if (i > c)
+		i--;
+
+	return i;
+}
+
+static struct grid_bucket *get_bucket(struct grid_bucket *table, int x, int y)
+{
+	uint32_t h = (uint32_t)x * 73856093u ^ (uint32_t)y * 19349663u;
+
+	return &table[h & (GRID_BUCKETS - 1)];
+}
+
+static void bucket_add(struct grid_bucket *bucket, void *item)
+{
+	void **items;
+
+	if (bucket->cnt == bucket->cap) {
+		bucket->cap = bucket->cap ? bucket->cap * 2 : 8;
+		items = malloc(bucket->cap * sizeof(*items));
+		memcpy(items, bucket->items, bucket->cnt * sizeof(*items));
+		free(bucket->items);
+		bucket->items = items;
+	}
+
+	bucket->items[bucket->cnt++] = item;
+}
+
+static void bucket_del(struct grid_bucket *bucket, void *item)
+{
+	int i;
+
+	for (i = 0; i < bucket->cnt; i++) {
+		if (bucket->items[i] == item) {
+			bucket->items[i] = bucket->items[--bucket->cnt];
+			return;
+		}
+	}
+}
+
+/* A block covering several cells is in their buckets once per cell. */
+static void add_cells(struct grid_bucket *table, struct grid_cells *cells, void *item)
+{
+	int x, y;
+
+	for (x = cells->x0; x <= cells->x1; x++) {
+		for (y = cells->y0; y <= cells->y1; y++)
+			bucket_add(get_bucket(table, x, y), item);
+	}
+}
+
+static void del_cells(struct grid_bucket *table, struct grid_cells *cells, void *item)
+{
+	int x, y;
+
+	for (x = cells->x0; x <= cells->x1; x++) {
+		for (y = cells->y0; y <= cells->y1; y++)
+			bucket_del(get_bucket(table, x, y), item);
+	}
+}
+
+static bool same_cells(struct grid_cells *a, struct grid_cells *b)
+{
+	return a->x0 == b->x0 && a->y0 == b->y0 &&
+	       a->x1 == b->x1 && a->y1 == b->y1;
+}
+
+static void get_joint_cells(struct joint *joint, struct grid_cells *cells)
+{
+	cells->x0 = cells->x1 = cell_of(joint->x);
+	cells->y0 = cells->y1 = cell_of(joint->y);
+}
+
+static void get_block_cells(struct block *block, struct grid_cells *cells)
+{
+	struct shell shell;
+	double w_half;
+	double h_half;
+	double hx, hy;
+	double s, c;
+
+	get_shell(&shell, &block->shape);
+
+	if (shell.type == SHELL_CIRC) {
+		hx = shell.circ.radius + GRID_HIT_MARGIN;
+		hy = hx;
+	} else {
+		w_half = shell.rect.w / 2 + GRID_HIT_MARGIN;
+		h_half = shell.rect.h / 2 + GRID_HIT_MARGIN;
+		s = fabs(sin(shell.angle));
+		c = fabs(cos(shell.angle));
+		hx = c * w_half + s * h_half;
+		hy = s * w_half + c * h_half;
+	}
+
+	hx += GRID_SLACK;
+	hy += GRID_SLACK;
+
+	cells->x0 = cell_of(shell.x - hx);
+	cells->y0 = cell_of(shell.y - hy);
+	cells->x1 = cell_of(shell.x + hx);
+	cells->y1 = cell_of(shell.y + hy);
+}
+
+void grid_init(struct grid *grid)
+{
+	memset(grid, 0, sizeof(*grid));
+}
+
+void grid_build(struct grid *grid, struct design *design)
+{
+	struct joint *joint;
+	struct block *block;
+
+	for (joint = design->joints.head; joint; joint = joint->next)
+		grid_insert_joint(grid, joint);
+
+	for (block = design->player_blocks.head; block; block = block->next)
+		grid_insert_block(grid, block);
+}
+
+/*
+ * Joints and blocks are inserted when they are appended to their list,
+ * so the insertion number gives the list order.
+ */
+void grid_insert_joint(struct grid *grid, struct joint *joint)
+{
+	get_joint_cells(joint, &joint->cells);
+	joint->cells.seq = ++grid->seq;
+	add_cells(grid->joints, &joint->cells, joint);
+}
+
+void grid_remove_joint(struct grid *grid, struct joint *joint)
+{
+	del_cells(grid->joints, &joint->cells, joint);
+}
+
+static void update_joint(struct grid *grid, struct joint *joint)
+{
+	struct grid_cells cells;
+
+	get_joint_cells(joint, &cells);
+	if (same_cells(&cells, &joint->cells))
+		return;
+
+	del_cells(grid->joints, &joint->cells, joint);
+	cells.seq = joint->cells.seq;
+	joint->cells = cells;
+	add_cells(grid->joints, &joint->cells, joint);
+}
+
+static void update_block_joints(struct grid *grid, struct block *block)
+{
+	struct joint *joints[5];
+	int n;
+	int i;
+
+	n = get_block_joints(block, joints);
+	for (i = 0; i < n; i++)
+		update_joint(grid, joints[i]);
+}
+
+/* Also re-files the block's joints, which may have moved since they were added. */
+void grid_insert_block(struct grid *grid, struct block *block)
+{
+	update_block_joints(grid, block);
+
+	get_block_cells(block, &block->cells);
+	block->cells.seq = ++grid->seq;
+	add_cells(grid->blocks, &block->cells, block);
+}
+
+void grid_remove_block(struct grid *grid, struct block *block)
+{
+	del_cells(grid->blocks, &block->cells, block);
+}
+
+/* Re-files the block and its joints after they moved. */
+void grid_update_block(struct grid *grid, struct block *block)
+{
+	struct grid_cells cells;
+
+	update_block_joints(grid, block);
+
+	get_block_cells(block, &cells);
+	if (same_cells(&cells, &block->cells))
+		return;
+
+	del_cells(grid->blocks, &block->cells, block);
+	cells.seq = block->cells.seq;
+	block->cells = cells;
+	add_cells(grid->blocks, &block->cells, block);
+}
+
+/* Sorts by insertion number and drops the duplicates of multi-cell items. */
+static int sort_found(void **items, int cnt, unsigned int (*seq)(void *))
+{
+	void *item;
+	int n;
+	int i;
+	int j;
+
+	for (i = 1; i < cnt; i++) {
+		item = items[i];
+		for (j = i; j > 0 && seq(items[j - 1]) > seq(item); j--)
+			items[j] = items[j - 1];
+		items[j] = item;
+	}
+
+	n = 0;
+	for (i = 0; i < cnt; i++) {
+		if (n == 0 || items[n - 1] != items[i])
+			items[n++] = items[i];
+	}
+
+	return n;
+}
+
+static unsigned int joint_seq(void *joint)
+{
+	return ((struct joint *)joint)->cells.seq;
+}
+
+static unsigned int block_seq(void *block)
+{
+	return ((struct block *)block)->cells.seq;
+}
+
+static void **grow_found(void **found, int *cap, int need)
+{
+	if (need <= *cap)
+		return found;
+
+	while (*cap < need)
+		*cap = *cap ? *cap * 2 : 32;
+	free(found);
+
+	return malloc(*cap * sizeof(void *));
+}
+
+static int collect(struct grid_bucket *table, int x0, int y0, int x1, int y1,
+		   void ***found, int *cap, unsigned int (*seq)(void *))
+{
+	struct grid_bucket *bucket;
+	int cnt = 0;
+	int x, y;
+
+	for (x = x0; x <= x1; x++) {
+		for (y = y0; y <= y1; y++)
+			cnt += get_bucket(table, x, y)->cnt;
+	}
+
+	*found = grow_found(*found, cap, cnt);
+
+	cnt = 0;
+	for (x = x0; x <= x1; x++) {
+		for (y = y0; y <= y1; y++) {
+			bucket = get_bucket(table, x, y);
+			memcpy(*found + cnt, bucket->items, bucket->cnt * sizeof(void *));
+			cnt += bucket->cnt;
+		}
+	}
+
+	return sort_found(*found, cnt, seq);
+}
+
+/*
+ * Joints closer than r to (x, y), and others from the same buckets.
+ * The result is valid until the next query.
+ */
+int grid_joints_near(struct grid *grid, double x, double y, double r,
+		     void ***res)
+{
+	int cnt;
+
+	r += GRID_SLACK;
+	cnt = collect(grid->joints,
+		      cell_of(x - r), cell_of(y - r),
+		      cell_of(x + r), cell_of(y + r),
+		      &grid->found_joints, &grid->found_joint_cap, joint_seq);
+	*res = grid->found_joints;
+
+	return cnt;
+}
+
+/* Player blocks that may be hit at (x, y). Valid until the next query. */
+int grid_blocks_at(struct grid *grid, double x, double y, void ***res)
+{
+	int cnt;
+
+	cnt = collect(grid->blocks, cell_of(x), cell_of(y), cell_of(x), cell_of(y),
+		      &grid->found_blocks, &grid->found_block_cap, block_seq);
+	*res = grid->found_blocks;
+
+	return cnt;
+}
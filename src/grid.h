@@ -0,0 +1,44 @@
+/*
+ * Spatial hash of the design's joints and player blocks for the editor's
+ * hit tests. Joints are filed by position, blocks by the bounding box of
+ * their hit area, which is the shell grown by GRID_HIT_MARGIN. The arena
+ * re-files a block and its joints whenever it regenerates the block's
+ * body, which every edit that moves something does.
+ *
+ * Queries return candidates in design list order, so a scan over them
+ * picks the same joint or block as a scan over the whole list would.
+ */
+
+#define GRID_CELL_SIZE 32.0
+#define GRID_HIT_MARGIN 8.0
+#define GRID_BUCKETS 1024
+
+struct grid_bucket {
+	void **items;
+	int cnt;
+	int cap;
+};
+
+struct grid {
+	struct grid_bucket joints[GRID_BUCKETS];
+	struct grid_bucket blocks[GRID_BUCKETS];
+	unsigned int seq;
+
+	void **found_joints;
+	int found_joint_cap;
+	void **found_blocks;
+	int found_block_cap;
+};
+
+void grid_init(struct grid *grid);
+void grid_build(struct grid *grid, struct design *design);
+
+void grid_insert_joint(struct grid *grid, struct joint *joint);
+void grid_remove_joint(struct grid *grid, struct joint *joint);
+void grid_insert_block(struct grid *grid, struct block *block);
+void grid_remove_block(struct grid *grid, struct block *block);
+void grid_update_block(struct grid *grid, struct block *block);
+
+int grid_joints_near(struct grid *grid, double x, double y, double r,
+		     void ***res);
+int grid_blocks_at(struct grid *grid, double x, double y, void ***res);
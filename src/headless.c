@@ -0,0 +1,82 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <box2d/b2World.h>
+#include "xml.h"
+#include "graph.h"
+
+/*
+ * Entry points of fcsim-headless.wasm, the simulation without any
+ * drawing, for running verifications under a JS runtime. See
+ * headless/fcsim.mjs. The ticks match verify_design() exactly: a tick
+ * is a step followed by the goal check, and stepping stops once the
+ * design is solved.
+ */
+
+struct sim {
+	struct xml_level level;
+	struct design design;
+	b2World *world;
+	uint64_t tick;
+	bool solved;
+};
+
+/* Returns NULL if the level does not parse. */
+struct sim *sim_load(char *xml, int len)
+{
+	struct sim *sim;
+
+	sim = malloc(sizeof(*sim));
+	if (!sim)
+		return NULL;
+
+	if (xml_parse(xml, len, &sim->level)) {
+		free(sim);
+		return NULL;
+	}
+
+	convert_xml(&sim->level, &sim->design);
+	sim->world = gen_world(&sim->design);
+	sim->tick = 0;
+	sim->solved = false;
+
+	return sim;
+}
+
+void sim_free(struct sim *sim)
+{
+	free_world(sim->world, &sim->design);
+	free_design(&sim->design);
+	xml_free(&sim->level);
+	free(sim);
+}
+
+/* Runs up to ticks ticks and returns how many ran. */
+int sim_step(struct sim *sim, int ticks)
+{
+	int i;
+
+	for (i = 0; i < ticks && !sim->solved; i++) {
+		step(sim->world, NULL);
+		sim->tick++;
+		if (goal_blocks_inside_goal_area(&sim->design))
+			sim->solved = true;
+	}
+
+	return i;
+}
+
+bool sim_solved(struct sim *sim)
+{
+	return sim->solved;
+}
+
+uint64_t sim_tick(struct sim *sim)
+{
+	return sim->tick;
+}
+
+uint64_t sim_hash(struct sim *sim)
+{
+	return hash_world(sim->world);
+}
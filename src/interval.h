@@ -1,3 +1,11 @@
 int set_interval(void (*func)(void *arg), int delay, void *arg);
 
 void clear_interval(int id);
+
+/*
+ * Called by an interval callback between units of work, lets whoever
+ * waits for the lock the callback runs under go first. Returns false
+ * if that cleared the interval, the callback must then return without
+ * touching anything else.
+ */
+bool yield_interval(void);
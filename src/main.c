@@ -1,9 +1,15 @@
+#include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
 #include <X11/X.h>
 #include <X11/Xlib.h>
 #include <GL/glx.h>
 #include <pthread.h>
 #include "poocs.h"
+#include "timers.h"
+#include "trace.h"
 
 void key_down(int key);
 void key_up(int key);
@@ -15,10 +21,45 @@ void resize(int w, int h);
 void init(char *xml, int len);
 void draw(void);
 
+static PFNGLVERTEXATTRIBDIVISORARBPROC vertex_attrib_divisor;
+static PFNGLDRAWELEMENTSINSTANCEDARBPROC draw_elements_instanced;
+
+static void load_instanced_arrays(void)
+{
+	const char *ext = (const char *)glGetString(GL_EXTENSIONS);
+
+	if (!ext || !strstr(ext, "GL_ARB_instanced_arrays"))
+		return;
+
+	vertex_attrib_divisor = (PFNGLVERTEXATTRIBDIVISORARBPROC)
+		glXGetProcAddress((const GLubyte *)"glVertexAttribDivisorARB");
+	draw_elements_instanced = (PFNGLDRAWELEMENTSINSTANCEDARBPROC)
+		glXGetProcAddress((const GLubyte *)"glDrawElementsInstancedARB");
+}
+
+GLboolean gl_instanced_arrays(void)
+{
+	return vertex_attrib_divisor && draw_elements_instanced;
+}
+
+void glVertexAttribDivisorANGLE(GLuint index, GLuint divisor)
+{
+	vertex_attrib_divisor(index, divisor);
+}
+
+void glDrawElementsInstancedANGLE(GLenum mode, GLsizei count, GLenum type,
+				  const void *indices, GLsizei primcount)
+{
+	draw_elements_instanced(mode, count, type, indices, primcount);
+}
+
 void process_events(Display *dpy, Window win)
 {
+	struct trace_scope scope;
 	XEvent xev;
 
+	trace_begin(&scope, "process_events");
+
 	while (XPending(dpy) > 0) {
 		XNextEvent(dpy, &xev);
 
@@ -49,91 +90,31 @@ void process_events(Display *dpy, Window win)
 			break;
 		}
 	}
-}
-
-struct slot {
-	void (*func)(void *arg);
-	void *arg;
-	int delay;
-	uint64_t next_ts;
-};
 
-struct slot slots[4];
-pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
-pthread_cond_t cond = PTHREAD_COND_INITIALIZER;
-
-void ts_to_time(uint64_t ts, struct timespec *spec)
-{
-	spec->tv_sec = ts / 1000;
-	spec->tv_nsec = (ts % 1000) * 1000000;
+	trace_end(&scope);
 }
 
-void time_to_ts(struct timespec *spec, uint64_t *ts)
-{
-	*ts = (uint64_t)spec->tv_sec * 1000 + spec->tv_nsec / 1000000;
-}
+pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
 
-void *func(void *arg)
+static void lock_traced(const char *name)
 {
-	struct timespec this_time;
-	struct timespec next_time;
-	uint64_t this_ts;
-	uint64_t next_ts = (uint64_t)-1;
-	int i;
+	struct trace_scope scope;
 
+	trace_begin(&scope, name);
 	pthread_mutex_lock(&mutex);
-	while (1) {
-		if (next_ts == (uint64_t)-1) {
-			pthread_cond_wait(&cond, &mutex);
-		} else {
-			ts_to_time(next_ts, &next_time);
-			pthread_cond_timedwait(&cond, &mutex, &next_time);
-		}
-		clock_gettime(CLOCK_REALTIME, &this_time);
-		time_to_ts(&this_time, &this_ts);
-		for (i = 0; i < 4; i++) {
-			if (slots[i].func && slots[i].next_ts <= this_ts) {
-				slots[i].func(slots[i].arg);
-				slots[i].next_ts += slots[i].delay;
-			}
-		}
-		next_ts = (uint64_t)-1;
-		for (i = 0; i < 4; i++) {
-			if (slots[i].func && slots[i].next_ts < next_ts)
-				next_ts = slots[i].next_ts;
-		}
-	}
+	trace_end(&scope);
 }
 
-int set_interval(void (*func)(void *arg), int delay, void *arg)
+static void write_trace(FILE *fp)
 {
-	struct timespec this_time;
-	uint64_t this_ts;
-	int i;
+	char *json;
 
-	for (i = 0; i < 4; i++) {
-		if (!slots[i].func)
-			break;
+	json = trace_take_json();
+	if (json) {
+		fputs(json, fp);
+		fflush(fp);
+		free(json);
 	}
-	if (i == 4)
-		return -1;
-
-	clock_gettime(CLOCK_REALTIME, &this_time);
-	time_to_ts(&this_time, &this_ts);
-
-	slots[i].func = func;
-	slots[i].arg = arg;
-	slots[i].delay = delay;
-	slots[i].next_ts = this_ts + delay;
-
-	pthread_cond_signal(&cond);
-
-	return i;
-}
-
-void clear_interval(int i)
-{
-	slots[i].func = NULL;
 }
 
 int main(void)
@@ -146,10 +127,34 @@ int main(void)
 	XSetWindowAttributes swa;
 	Window win;
 	GLXContext glc;
-	pthread_t thread;
+	struct trace_scope scope;
+	const char *trace_path;
+	FILE *trace_fp = NULL;
+
+	/*
+	 * FCSIM_TRACE=file records a Chrome trace (chrome://tracing,
+	 * ui.perfetto.dev) of the main and timer threads into file.
+	 */
+	trace_path = getenv("FCSIM_TRACE");
+	if (trace_path) {
+		trace_fp = fopen(trace_path, "w");
+		if (!trace_fp) {
+			fprintf(stderr, "cannot open %s\n", trace_path);
+			return 1;
+		}
+		trace_start();
+		trace_thread("main");
+	}
 
-	pthread_create(&thread, NULL, func, NULL);
-	pthread_detach(thread);
+	/*
+	 * FCSIM_CATCHUP=n lets a late timer replay up to n missed ticks
+	 * (-1 for all), FCSIM_SCHED_STATS prints timer lateness on stop.
+	 */
+	if (getenv("FCSIM_CATCHUP"))
+		sched_set_default_catchup(atoi(getenv("FCSIM_CATCHUP")));
+	if (getenv("FCSIM_SCHED_STATS"))
+		sched_report_to(stderr);
+	sched_start(&mutex);
 
 	dpy = XOpenDisplay(NULL);
 	if (!dpy)
@@ -184,19 +189,23 @@ int main(void)
 
 	glc = glXCreateContext(dpy, vi, NULL, GL_TRUE);
 	glXMakeCurrent(dpy, win, glc);
+	load_instanced_arrays();
 
 	init(poocs_xml, sizeof(poocs_xml));
 
 	while (1) {
-		pthread_mutex_lock(&mutex);
-		draw(); 
-		pthread_mutex_unlock(&mutex);
+		draw();
 
+		trace_begin(&scope, "swap");
 		glFinish();
 		glXSwapBuffers(dpy, win);
+		trace_end(&scope);
 
-		pthread_mutex_lock(&mutex);
+		lock_traced("wait for event lock");
 		process_events(dpy, win);
 		pthread_mutex_unlock(&mutex);
+
+		if (trace_fp)
+			write_trace(trace_fp);
 	}
 }
\ No newline at end of file
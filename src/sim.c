@@ -0,0 +1,155 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <box2d/b2World.h>
+#include "verify.h"
+
+#define DEFAULT_MAX_TICKS 100000
+
+static double elapsed(struct timespec *start, struct timespec *end)
+{
+	return (end->tv_sec - start->tv_sec) +
+	       (end->tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static void print_phase(const char *name, double ms, const b2Profile *p)
+{
+	printf("  %-20s %10.3f ms %8.3f us/step\n", name, ms,
+	       p->stepCount ? ms * 1000.0 / p->stepCount : 0.0);
+}
+
+static void print_profile(const b2Profile *p)
+{
+	double steps = p->stepCount ? p->stepCount : 1;
+
+	printf("profile over %u steps\n", p->stepCount);
+	print_phase("step", p->step, p);
+	print_phase("clean contact list", p->cleanContactList, p);
+	print_phase("clean body list", p->cleanBodyList, p);
+	print_phase("collide", p->collide, p);
+	print_phase("island search", p->islandSearch, p);
+	print_phase("pre-solve", p->preSolve, p);
+	print_phase("velocity iterations", p->solveVelocity, p);
+	print_phase("integrate positions", p->integratePositions, p);
+	print_phase("position iterations", p->solvePosition, p);
+	print_phase("parallel solve", p->parallelSolve, p);
+	print_phase("synchronize", p->synchronize, p);
+	print_phase("broad-phase commit", p->broadPhaseCommit, p);
+	printf("  contacts evaluated   %10.1f /step\n", p->contactsEvaluated / steps);
+	printf("  islands              %10.1f /step\n", p->islandCount / steps);
+	printf("  bodies per island    %10.1f (max %u)\n",
+	       p->islandCount ? (double)p->islandBodyCount / p->islandCount : 0.0,
+	       p->maxIslandBodyCount);
+	printf("  position iterations  %10.1f /island\n",
+	       p->islandCount ? (double)p->positionIterations / p->islandCount : 0.0);
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s [-c tick:checkpoint] [-r checkpoint] [-H hash_file] [-P] [-j threads] <level.xml> [max_ticks]\n", prog);
+}
+
+int main(int argc, char **argv)
+{
+	struct verify_opts opts = { 0 };
+	b2Profile profile;
+	struct verify_result res;
+	struct timespec start, end;
+	uint64_t max_ticks = DEFAULT_MAX_TICKS;
+	const char *hash_path = NULL;
+	const char *path;
+	double secs;
+	char *sep;
+	char *xml;
+	int len;
+	int opt;
+	int err;
+
+	while ((opt = getopt(argc, argv, "c:r:H:Pj:")) != -1) {
+		switch (opt) {
+		case 'c':
+			sep = strchr(optarg, ':');
+			if (!sep) {
+				usage(argv[0]);
+				return 2;
+			}
+			opts.save_tick = strtoull(optarg, NULL, 10);
+			opts.save_path = sep + 1;
+			break;
+		case 'r':
+			opts.resume_path = optarg;
+			break;
+		case 'H':
+			hash_path = optarg;
+			break;
+		case 'P':
+			opts.profile = &profile;
+			break;
+		case 'j':
+			opts.threads = atoi(optarg);
+			break;
+		default:
+			usage(argv[0]);
+			return 2;
+		}
+	}
+
+	if (argc - optind < 1 || argc - optind > 2) {
+		usage(argv[0]);
+		return 2;
+	}
+
+	path = argv[optind];
+	if (argc - optind == 2)
+		max_ticks = strtoull(argv[optind + 1], NULL, 10);
+
+	xml = read_file(path, &len);
+	if (!xml) {
+		fprintf(stderr, "%s: cannot read %s\n", argv[0], path);
+		return 2;
+	}
+
+	if (hash_path) {
+		opts.hash_stream = fopen(hash_path, "w");
+		if (!opts.hash_stream) {
+			fprintf(stderr, "%s: cannot open %s\n", argv[0], hash_path);
+			return 2;
+		}
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	err = verify_design_opts(xml, len, max_ticks, &opts, &res);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	if (opts.hash_stream)
+		fclose(opts.hash_stream);
+
+	if (err == -1) {
+		fprintf(stderr, "%s: cannot parse %s\n", argv[0], path);
+		return 2;
+	}
+	if (err) {
+		fprintf(stderr, "%s: cannot %s checkpoint\n", argv[0],
+			opts.resume_path ? "restore" : "write");
+		return 2;
+	}
+
+	secs = elapsed(&start, &end);
+
+	if (res.solved)
+		printf("solved at tick %llu\n", (unsigned long long)res.solve_tick);
+	else
+		printf("not solved after %llu ticks\n", (unsigned long long)res.ticks);
+	printf("%.0f ticks/s\n", secs > 0.0 ? res.ticks / secs : 0.0);
+	printf("state hash %016llx\n", (unsigned long long)res.hash);
+	if (opts.profile)
+		print_profile(opts.profile);
+
+	free(xml);
+
+	return res.solved ? 0 : 1;
+}
@@ -0,0 +1,312 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+#include <pthread.h>
+#include <sched.h>
+#include "interval.h"
+#include "timers.h"
+#include "trace.h"
+
+#define DEFAULT_MAX_BURST 4
+
+struct timer {
+	void (*func)(void *arg);
+	void *arg;
+	uint64_t period;
+	uint64_t deadline;
+	int max_burst;
+	int burst;
+	int heap_index;
+	unsigned int gen;
+	struct sched_stats stats;
+};
+
+static pthread_mutex_t *sched_lock;
+static pthread_cond_t sched_cond;
+
+static struct timer *timers;
+static int timer_cap;
+
+/* Min-heap of timer ids ordered by deadline. */
+static int *heap;
+static int heap_cnt;
+static int heap_cap;
+
+/* The timer whose callback is running, for yield_interval(). */
+static int cur_id;
+static unsigned int cur_gen;
+
+static int default_max_burst = DEFAULT_MAX_BURST;
+static FILE *report_fp;
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static bool earlier(int a, int b)
+{
+	return timers[heap[a]].deadline < timers[heap[b]].deadline;
+}
+
+static void heap_swap(int a, int b)
+{
+	int tmp = heap[a];
+
+	heap[a] = heap[b];
+	heap[b] = tmp;
+	timers[heap[a]].heap_index = a;
+	timers[heap[b]].heap_index = b;
+}
+
+static void sift_up(int i)
+{
+	while (i > 0 && earlier(i, (i - 1) / 2)) {
+		heap_swap(i, (i - 1) / 2);
+		i = (i - 1) / 2;
+	}
+}
+
+static void sift_down(int i)
+{
+	int min;
+
+	while (1) {
+		min = i;
+		if (2 * i + 1 < heap_cnt && earlier(2 * i + 1, min))
+			min = 2 * i + 1;
+		if (2 * i + 2 < heap_cnt && earlier(2 * i + 2, min))
+			min = 2 * i + 2;
+		if (min == i)
+			break;
+		heap_swap(i, min);
+		i = min;
+	}
+}
+
+static void heap_push(int id)
+{
+	if (heap_cnt == heap_cap) {
+		heap_cap = heap_cap ? heap_cap * 2 : 16;
+		heap = realloc(heap, heap_cap * sizeof(*heap));
+	}
+
+	heap[heap_cnt] = id;
+	timers[id].heap_index = heap_cnt;
+	heap_cnt++;
+	sift_up(heap_cnt - 1);
+}
+
+static void heap_remove(int i)
+{
+	int id;
+
+	timers[heap[i]].heap_index = -1;
+	heap_cnt--;
+	if (i == heap_cnt)
+		return;
+
+	id = heap[heap_cnt];
+	heap[i] = id;
+	timers[id].heap_index = i;
+	sift_up(i);
+	sift_down(timers[id].heap_index);
+}
+
+static void print_stats(FILE *fp, int id, struct sched_stats *stats)
+{
+	fprintf(fp, "timer %d: %llu fired, %llu skipped, lateness avg %.3f ms max %.3f ms\n",
+		id,
+		(unsigned long long)stats->fires,
+		(unsigned long long)stats->skipped,
+		stats->fires ? stats->late_total_ns / 1e6 / stats->fires : 0.0,
+		stats->late_max_ns / 1e6);
+}
+
+/*
+ * Fire the earliest timer and move its deadline on by one period. If it
+ * has fallen more than a period behind and used up its burst, the missed
+ * firings are skipped instead.
+ */
+static void fire(int id, uint64_t now)
+{
+	struct timer *timer = &timers[id];
+	uint64_t late = now - timer->deadline;
+	uint64_t missed;
+	unsigned int gen = timer->gen;
+
+	heap_remove(0);
+
+	timer->stats.fires++;
+	timer->stats.late_total_ns += late;
+	if (late > timer->stats.late_max_ns)
+		timer->stats.late_max_ns = late;
+
+	cur_id = id;
+	cur_gen = gen;
+	timer->func(timer->arg);
+
+	/* The callback may have cleared or replaced this timer. */
+	timer = &timers[id];
+	if (timer->gen != gen || !timer->func)
+		return;
+
+	timer->deadline += timer->period;
+	if (timer->deadline > now) {
+		timer->burst = 0;
+	} else if (timer->max_burst >= 0 && timer->burst >= timer->max_burst) {
+		missed = (now - timer->deadline) / timer->period + 1;
+		timer->deadline += missed * timer->period;
+		timer->stats.skipped += missed;
+		timer->burst = 0;
+	} else {
+		timer->burst++;
+	}
+
+	heap_push(id);
+}
+
+static void *sched_thread(void *arg)
+{
+	struct timespec ts;
+	uint64_t deadline;
+	uint64_t now;
+
+	(void)arg;
+
+	trace_thread("timer");
+
+	pthread_mutex_lock(sched_lock);
+	while (1) {
+		if (heap_cnt == 0) {
+			pthread_cond_wait(&sched_cond, sched_lock);
+			continue;
+		}
+
+		deadline = timers[heap[0]].deadline;
+		now = now_ns();
+		if (now < deadline) {
+			ts.tv_sec = deadline / 1000000000;
+			ts.tv_nsec = deadline % 1000000000;
+			pthread_cond_timedwait(&sched_cond, sched_lock, &ts);
+			continue;
+		}
+
+		fire(heap[0], now);
+
+		/* Don't starve the event loop while catching up. */
+		pthread_mutex_unlock(sched_lock);
+		sched_yield();
+		pthread_mutex_lock(sched_lock);
+	}
+
+	return NULL;
+}
+
+void sched_start(pthread_mutex_t *lock)
+{
+	pthread_condattr_t attr;
+	pthread_t thread;
+
+	sched_lock = lock;
+
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&sched_cond, &attr);
+	pthread_condattr_destroy(&attr);
+
+	pthread_create(&thread, NULL, sched_thread, NULL);
+	pthread_detach(thread);
+}
+
+int set_interval(void (*func)(void *arg), int delay, void *arg)
+{
+	struct timer *timer;
+	int old_cap;
+	int id;
+
+	for (id = 0; id < timer_cap; id++) {
+		if (!timers[id].func)
+			break;
+	}
+
+	if (id == timer_cap) {
+		old_cap = timer_cap;
+		timer_cap = timer_cap ? timer_cap * 2 : 8;
+		timers = realloc(timers, timer_cap * sizeof(*timers));
+		for (; old_cap < timer_cap; old_cap++) {
+			timers[old_cap].func = NULL;
+			timers[old_cap].gen = 0;
+		}
+	}
+
+	timer = &timers[id];
+	timer->func = func;
+	timer->arg = arg;
+	timer->period = (uint64_t)(delay > 0 ? delay : 1) * 1000000;
+	timer->deadline = now_ns() + timer->period;
+	timer->max_burst = default_max_burst;
+	timer->burst = 0;
+	timer->gen++;
+	timer->stats = (struct sched_stats){ 0 };
+
+	heap_push(id);
+	pthread_cond_signal(&sched_cond);
+
+	return id;
+}
+
+void clear_interval(int id)
+{
+	struct timer *timer = &timers[id];
+
+	if (!timer->func)
+		return;
+
+	if (report_fp)
+		print_stats(report_fp, id, &timer->stats);
+
+	if (timer->heap_index >= 0)
+		heap_remove(timer->heap_index);
+	timer->func = NULL;
+}
+
+bool yield_interval(void)
+{
+	pthread_mutex_unlock(sched_lock);
+	sched_yield();
+	pthread_mutex_lock(sched_lock);
+
+	return timers[cur_id].gen == cur_gen && timers[cur_id].func;
+}
+
+void sched_set_catchup(int id, int max_burst)
+{
+	timers[id].max_burst = max_burst;
+}
+
+void sched_set_default_catchup(int max_burst)
+{
+	default_max_burst = max_burst;
+}
+
+bool sched_get_stats(int id, struct sched_stats *stats)
+{
+	if (id < 0 || id >= timer_cap || !timers[id].func)
+		return false;
+
+	*stats = timers[id].stats;
+
+	return true;
+}
+
+void sched_report_to(FILE *fp)
+{
+	report_fp = fp;
+}
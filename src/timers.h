@@ -0,0 +1,31 @@
+/*
+ * Interval timers for the native build, behind set_interval() and
+ * clear_interval() from interval.h. Deadlines are CLOCK_MONOTONIC
+ * nanoseconds and advance by exactly one period per firing, so timers
+ * do not drift. Callbacks run on the scheduler thread with the lock
+ * given to sched_start() held, and all other calls must hold it too.
+ */
+
+/* Catch-up policy: replay every missed firing. */
+#define SCHED_CATCHUP_ALL -1
+
+struct sched_stats {
+	uint64_t fires;
+	uint64_t skipped;
+	uint64_t late_total_ns;
+	uint64_t late_max_ns;
+};
+
+void sched_start(pthread_mutex_t *lock);
+
+/*
+ * A timer that fell behind replays at most max_burst missed firings back
+ * to back and skips the rest, keeping its phase. 0 never replays.
+ */
+void sched_set_catchup(int id, int max_burst);
+void sched_set_default_catchup(int max_burst);
+
+bool sched_get_stats(int id, struct sched_stats *stats);
+
+/* Print the stats of every timer to fp when it is cleared, NULL stops. */
+void sched_report_to(FILE *fp);
@@ -0,0 +1,267 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <box2d/b2World.h>
+#include "str.h"
+#include "trace.h"
+
+#ifdef __wasm__
+
+double performance_now(void);
+
+/*
+ * There is no thread-local storage in the wasm builds, so each instance
+ * keeps the id of the thread it runs on in its imports (main.js and
+ * worker.js). The instances share memory but not imports.
+ */
+int trace_tid(void);
+void trace_set_tid(int tid);
+
+/* fcsim-mt.wasm also records from the simulation worker. */
+static int trace_mutex;
+
+static void trace_lock(void)
+{
+	while (__atomic_exchange_n(&trace_mutex, 1, __ATOMIC_ACQUIRE))
+		;
+}
+
+static void trace_unlock(void)
+{
+	__atomic_store_n(&trace_mutex, 0, __ATOMIC_RELEASE);
+}
+
+uint64_t trace_now(void)
+{
+	return (uint64_t)(performance_now() * 1e6);
+}
+
+#else
+
+#include <time.h>
+#include <pthread.h>
+
+static __thread int cur_tid;
+
+static int trace_tid(void)
+{
+	return cur_tid;
+}
+
+static void trace_set_tid(int tid)
+{
+	cur_tid = tid;
+}
+
+static pthread_mutex_t trace_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void trace_lock(void)
+{
+	pthread_mutex_lock(&trace_mutex);
+}
+
+static void trace_unlock(void)
+{
+	pthread_mutex_unlock(&trace_mutex);
+}
+
+uint64_t trace_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+#endif
+
+struct trace_event {
+	const char *name;
+	int tid;
+	uint64_t start;
+	uint64_t dur;
+};
+
+bool trace_on;
+
+static uint64_t epoch;
+static struct trace_event *events;
+static int event_cnt;
+static int event_cap;
+static int thread_cnt;
+static bool started_json;
+
+void trace_start(void)
+{
+	epoch = trace_now();
+	trace_on = true;
+}
+
+static void push_event(const char *name, int tid, uint64_t start, uint64_t dur)
+{
+	struct trace_event *new_events;
+
+	if (event_cnt == event_cap) {
+		event_cap = event_cap ? event_cap * 2 : 1024;
+		new_events = malloc(event_cap * sizeof(*events));
+		memcpy(new_events, events, event_cnt * sizeof(*events));
+		free(events);
+		events = new_events;
+	}
+
+	events[event_cnt].name = name;
+	events[event_cnt].tid = tid;
+	events[event_cnt].start = start;
+	events[event_cnt].dur = dur;
+	event_cnt++;
+}
+
+/* Thread names are stored as events without a duration. */
+#define THREAD_NAME ((uint64_t)-1)
+
+void trace_thread(const char *name)
+{
+	if (!trace_on)
+		return;
+
+	trace_lock();
+	trace_set_tid(++thread_cnt);
+	push_event(name, thread_cnt, 0, THREAD_NAME);
+	trace_unlock();
+}
+
+void trace_span(const char *name, uint64_t start, uint64_t end)
+{
+	if (!trace_on)
+		return;
+
+	trace_lock();
+	push_event(name, trace_tid(), start - epoch, end - start);
+	trace_unlock();
+}
+
+void trace_begin(struct trace_scope *scope, const char *name)
+{
+	scope->name = name;
+	scope->start = trace_on ? trace_now() : 0;
+}
+
+void trace_end(struct trace_scope *scope)
+{
+	if (trace_on)
+		trace_span(scope->name, scope->start, trace_now());
+}
+
+void trace_step(const struct b2Profile *profile, uint64_t start)
+{
+	static const struct {
+		const char *name;
+		size_t offset;
+	} phases[] = {
+		{ "b2ContactManager_CleanContactList", offsetof(b2Profile, cleanContactList) },
+		{ "b2World_CleanBodyList", offsetof(b2Profile, cleanBodyList) },
+		{ "b2ContactManager_Collide", offsetof(b2Profile, collide) },
+		{ "island search", offsetof(b2Profile, islandSearch) },
+		{ "pre-solve", offsetof(b2Profile, preSolve) },
+		{ "velocity iterations", offsetof(b2Profile, solveVelocity) },
+		{ "integrate positions", offsetof(b2Profile, integratePositions) },
+		{ "position iterations", offsetof(b2Profile, solvePosition) },
+		{ "parallel solve", offsetof(b2Profile, parallelSolve) },
+		{ "synchronize", offsetof(b2Profile, synchronize) },
+		{ "b2BroadPhase_Commit", offsetof(b2Profile, broadPhaseCommit) },
+	};
+	uint64_t t = start;
+	uint64_t dur;
+	size_t i;
+
+	if (!trace_on)
+		return;
+
+	trace_span("b2World_Step", start, start + (uint64_t)(profile->step * 1e6));
+
+	for (i = 0; i < sizeof(phases) / sizeof(phases[0]); i++) {
+		dur = *(const double *)((const char *)profile + phases[i].offset) * 1e6;
+		if (dur)
+			trace_span(phases[i].name, t, t + dur);
+		t += dur;
+	}
+}
+
+static void append_u64(struct str *str, uint64_t val)
+{
+	char buf[21];
+	int i = sizeof(buf) - 1;
+
+	buf[i] = 0;
+	do {
+		buf[--i] = '0' + val % 10;
+		val /= 10;
+	} while (val);
+
+	append_str(str, buf + i);
+}
+
+/* Trace timestamps are microseconds, we keep nanosecond precision. */
+static void append_us(struct str *str, uint64_t ns)
+{
+	char frac[5];
+
+	append_u64(str, ns / 1000);
+	frac[0] = '.';
+	frac[1] = '0' + ns / 100 % 10;
+	frac[2] = '0' + ns / 10 % 10;
+	frac[3] = '0' + ns % 10;
+	frac[4] = 0;
+	append_str(str, frac);
+}
+
+static void append_event(struct str *str, struct trace_event *ev)
+{
+	append_str(str, "{\"name\":\"");
+	append_str(str, (char *)ev->name);
+	if (ev->dur == THREAD_NAME) {
+		append_str(str, "\",\"ph\":\"M\",\"pid\":1,\"tid\":");
+		append_u64(str, ev->tid);
+		append_str(str, ",\"args\":{\"name\":\"");
+		append_str(str, (char *)ev->name);
+		append_str(str, "\"}},\n");
+		return;
+	}
+	append_str(str, "\",\"ph\":\"X\",\"pid\":1,\"tid\":");
+	append_u64(str, ev->tid);
+	append_str(str, ",\"ts\":");
+	append_us(str, ev->start);
+	append_str(str, ",\"dur\":");
+	append_us(str, ev->dur);
+	append_str(str, "},\n");
+}
+
+char *trace_take_json(void)
+{
+	struct str str;
+	int i;
+
+	trace_lock();
+
+	if (event_cnt == 0) {
+		trace_unlock();
+		return NULL;
+	}
+
+	make_str(&str, 4096);
+	if (!started_json) {
+		append_str(&str, "[\n");
+		started_json = true;
+	}
+
+	for (i = 0; i < event_cnt; i++)
+		append_event(&str, &events[i]);
+	event_cnt = 0;
+
+	trace_unlock();
+
+	return str.mem;
+}
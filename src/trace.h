@@ -0,0 +1,42 @@
+/*
+ * Chrome trace-event recorder. Spans are buffered in memory and turned
+ * into trace-event JSON by trace_take_json(), which the native build
+ * appends to a file and the wasm build hands to JavaScript. Nothing is
+ * recorded until trace_start() is called.
+ */
+
+struct b2Profile;
+
+struct trace_scope {
+	const char *name;
+	uint64_t start;
+};
+
+extern bool trace_on;
+
+void trace_start(void);
+
+/* Name the calling thread. Each thread gets its own timeline. */
+void trace_thread(const char *name);
+
+/* Monotonic time in nanoseconds. */
+uint64_t trace_now(void);
+
+void trace_span(const char *name, uint64_t start, uint64_t end);
+
+void trace_begin(struct trace_scope *scope, const char *name);
+void trace_end(struct trace_scope *scope);
+
+/*
+ * Record b2World_Step and its phases for a step that started at start.
+ * The phases are laid out back to back from the step profile; the island
+ * phases are summed over all islands of the step.
+ */
+void trace_step(const struct b2Profile *profile, uint64_t start);
+
+/*
+ * Return the events recorded since the last call as a piece of a JSON
+ * array (the first piece opens the array) and forget them. Returns NULL
+ * if there is nothing new. The caller frees the string.
+ */
+char *trace_take_json(void);
@@ -0,0 +1,228 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <box2d/b2World.h>
+#include <box2d/b2Snapshot.h>
+#include "xml.h"
+#include "graph.h"
+#include "verify.h"
+#include "workers.h"
+
+char *read_file(const char *path, int *len)
+{
+	FILE *fp;
+	char *buf;
+	long size;
+
+	fp = fopen(path, "rb");
+	if (!fp)
+		return NULL;
+
+	if (fseek(fp, 0, SEEK_END) || (size = ftell(fp)) < 0 ||
+	    fseek(fp, 0, SEEK_SET)) {
+		fclose(fp);
+		return NULL;
+	}
+
+	buf = malloc(size);
+	if (!buf || fread(buf, 1, size, fp) != (size_t)size) {
+		free(buf);
+		fclose(fp);
+		return NULL;
+	}
+
+	fclose(fp);
+	*len = size;
+
+	return buf;
+}
+
+/*
+ * A checkpoint file is this header followed by the snapshot. The
+ * header identifies the design, so that a checkpoint is never resumed
+ * against another one.
+ */
+struct checkpoint_header {
+	uint64_t tick;
+	uint64_t xml_hash;
+	int32_t level_id;
+	int32_t block_cnt;
+	int32_t joint_cnt;
+};
+
+static int32_t count_list(struct block_list *list)
+{
+	struct block *block;
+	int32_t cnt = 0;
+
+	for (block = list->head; block; block = block->next)
+		cnt++;
+
+	return cnt;
+}
+
+static void fill_header(struct checkpoint_header *header,
+			struct design *design, uint64_t xml_hash,
+			uint64_t tick)
+{
+	struct joint *joint;
+
+	memset(header, 0, sizeof(*header));
+	header->tick = tick;
+	header->xml_hash = xml_hash;
+	header->level_id = design->level_id;
+	header->block_cnt = count_list(&design->player_blocks) +
+			    count_list(&design->level_blocks);
+	for (joint = design->joints.head; joint; joint = joint->next)
+		header->joint_cnt++;
+}
+
+static int save_checkpoint(const char *path, b2World *world,
+			   struct design *design, uint64_t xml_hash,
+			   uint64_t tick)
+{
+	struct checkpoint_header header;
+	b2Snapshot snapshot;
+	FILE *fp;
+	int res = -1;
+
+	fp = fopen(path, "wb");
+	if (!fp)
+		return -1;
+
+	fill_header(&header, design, xml_hash, tick);
+	b2Snapshot_ctor(&snapshot);
+	save_world(world, design, &snapshot);
+
+	if (fwrite(&header, sizeof(header), 1, fp) == 1 &&
+	    fwrite(snapshot.data, 1, snapshot.size, fp) == (size_t)snapshot.size)
+		res = 0;
+
+	b2Snapshot_dtor(&snapshot);
+	if (fclose(fp))
+		res = -1;
+
+	return res;
+}
+
+static b2World *load_checkpoint(const char *path, struct design *design,
+				uint64_t xml_hash, uint64_t *tick)
+{
+	struct checkpoint_header header;
+	struct checkpoint_header expect;
+	b2World *world = NULL;
+	char *buf;
+	int len;
+
+	buf = read_file(path, &len);
+	if (!buf)
+		return NULL;
+
+	if (len < (int)sizeof(header)) {
+		free(buf);
+		return NULL;
+	}
+
+	memcpy(&header, buf, sizeof(header));
+	fill_header(&expect, design, xml_hash, header.tick);
+	if (header.xml_hash == expect.xml_hash &&
+	    header.level_id == expect.level_id &&
+	    header.block_cnt == expect.block_cnt &&
+	    header.joint_cnt == expect.joint_cnt) {
+		*tick = header.tick;
+		world = restore_world(design, buf + sizeof(header),
+				      len - sizeof(header));
+	}
+	free(buf);
+
+	return world;
+}
+
+int verify_design_opts(char *xml, int len, uint64_t max_ticks,
+		       const struct verify_opts *opts,
+		       struct verify_result *res)
+{
+	struct xml_level level;
+	struct design design;
+	struct workers *workers = NULL;
+	b2World *world;
+	uint64_t xml_hash;
+	uint64_t hash;
+	int err = 0;
+
+	/* Before parsing, which may modify the buffer. */
+	xml_hash = fnv1a(0xcbf29ce484222325, xml, len);
+
+	if (xml_parse(xml, len, &level))
+		return -1;
+
+	convert_xml(&level, &design);
+
+	res->solved = false;
+	res->solve_tick = 0;
+	res->ticks = 0;
+
+	if (opts && opts->resume_path)
+		world = load_checkpoint(opts->resume_path, &design, xml_hash,
+					&res->ticks);
+	else
+		world = gen_world(&design);
+
+	if (!world) {
+		free_design(&design);
+		xml_free(&level);
+		return -2;
+	}
+
+	if (opts && opts->profile)
+		b2World_SetProfiling(world, true);
+
+	if (opts && opts->threads > 1) {
+		workers = workers_new(opts->threads);
+		b2World_SetParallel(world, workers_for, workers, opts->threads);
+	}
+
+	while (res->ticks < max_ticks) {
+		if (opts && opts->hash_stream) {
+			step(world, &hash);
+			res->ticks++;
+			fprintf(opts->hash_stream, "%llu %016llx\n",
+				(unsigned long long)res->ticks,
+				(unsigned long long)hash);
+		} else {
+			step(world, NULL);
+			res->ticks++;
+		}
+		if (opts && opts->save_path && res->ticks == opts->save_tick) {
+			if (save_checkpoint(opts->save_path, world, &design,
+					    xml_hash, res->ticks))
+				err = -2;
+		}
+		if (goal_blocks_inside_goal_area(&design)) {
+			res->solved = true;
+			res->solve_tick = res->ticks;
+			break;
+		}
+	}
+
+	res->hash = hash_world(world);
+
+	if (opts && opts->profile)
+		*opts->profile = *b2World_GetProfileTotal(world);
+
+	free_world(world, &design);
+	if (workers)
+		workers_free(workers);
+	free_design(&design);
+	xml_free(&level);
+
+	return err;
+}
+
+int verify_design(char *xml, int len, uint64_t max_ticks,
+		  struct verify_result *res)
+{
+	return verify_design_opts(xml, len, max_ticks, NULL, res);
+}
@@ -0,0 +1,35 @@
+struct verify_result {
+	bool solved;
+	uint64_t solve_tick;
+	uint64_t ticks;
+	uint64_t hash;
+};
+
+char *read_file(const char *path, int *len);
+
+struct b2Profile;
+
+/*
+ * Optionally write a checkpoint of the world after save_tick ticks, or
+ * start from a checkpoint instead of tick 0. A resumed run gives the
+ * same result as an uninterrupted one. If hash_stream is set, a
+ * "tick hash" line is written to it after every tick. If profile is
+ * set, step profiling is enabled and the totals are stored there. With
+ * threads above 1, each step's islands are solved on that many threads,
+ * which gives the same result as solving them on one.
+ */
+struct verify_opts {
+	uint64_t save_tick;
+	const char *save_path;
+	const char *resume_path;
+	FILE *hash_stream;
+	struct b2Profile *profile;
+	int threads;
+};
+
+int verify_design(char *xml, int len, uint64_t max_ticks,
+		  struct verify_result *res);
+
+int verify_design_opts(char *xml, int len, uint64_t max_ticks,
+		       const struct verify_opts *opts,
+		       struct verify_result *res);
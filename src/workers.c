@@ -0,0 +1,142 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <box2d/b2World.h>
+#include "workers.h"
+
+/*
+ * Steps are short, so the threads stay up between calls and wait for
+ * the next generation. Tasks are handed out one index at a time, which
+ * worker runs which task does not matter for the result.
+ */
+struct workers {
+	pthread_mutex_t lock;
+	pthread_cond_t start;
+	pthread_cond_t done;
+	pthread_t *threads;
+	int cnt;
+
+	unsigned int gen;
+	int running;
+	bool stop;
+
+	b2ParallelTask task;
+	void *data;
+	int32 count;
+	int32 next;
+};
+
+struct thread_arg {
+	struct workers *workers;
+	int id;
+};
+
+static void run_tasks(struct workers *workers, int id)
+{
+	int32 i;
+
+	while ((i = __atomic_fetch_add(&workers->next, 1, __ATOMIC_RELAXED)) < workers->count)
+		workers->task(workers->data, i, id);
+}
+
+static void *thread_func(void *arg)
+{
+	struct thread_arg *ta = arg;
+	struct workers *workers = ta->workers;
+	int id = ta->id;
+	unsigned int seen = 0;
+
+	free(ta);
+
+	pthread_mutex_lock(&workers->lock);
+	for (;;) {
+		while (!workers->stop && workers->gen == seen)
+			pthread_cond_wait(&workers->start, &workers->lock);
+		if (workers->stop)
+			break;
+		seen = workers->gen;
+		pthread_mutex_unlock(&workers->lock);
+
+		run_tasks(workers, id);
+
+		pthread_mutex_lock(&workers->lock);
+		if (--workers->running == 0)
+			pthread_cond_signal(&workers->done);
+	}
+	pthread_mutex_unlock(&workers->lock);
+
+	return NULL;
+}
+
+struct workers *workers_new(int cnt)
+{
+	struct workers *workers;
+	struct thread_arg *ta;
+	int i;
+
+	workers = calloc(1, sizeof(*workers));
+	pthread_mutex_init(&workers->lock, NULL);
+	pthread_cond_init(&workers->start, NULL);
+	pthread_cond_init(&workers->done, NULL);
+	workers->cnt = cnt;
+	workers->threads = calloc(cnt, sizeof(pthread_t));
+
+	for (i = 1; i < cnt; i++) {
+		ta = malloc(sizeof(*ta));
+		ta->workers = workers;
+		ta->id = i;
+		pthread_create(&workers->threads[i], NULL, thread_func, ta);
+	}
+
+	return workers;
+}
+
+void workers_free(struct workers *workers)
+{
+	int i;
+
+	pthread_mutex_lock(&workers->lock);
+	workers->stop = true;
+	pthread_cond_broadcast(&workers->start);
+	pthread_mutex_unlock(&workers->lock);
+
+	for (i = 1; i < workers->cnt; i++)
+		pthread_join(workers->threads[i], NULL);
+
+	pthread_cond_destroy(&workers->done);
+	pthread_cond_destroy(&workers->start);
+	pthread_mutex_destroy(&workers->lock);
+	free(workers->threads);
+	free(workers);
+}
+
+void workers_for(void *arg, b2ParallelTask task, void *data, int32 count)
+{
+	struct workers *workers = arg;
+	int32 i;
+
+	/* Not worth waking anyone. */
+	if (count < 2 || workers->cnt < 2) {
+		for (i = 0; i < count; i++)
+			task(data, i, 0);
+		return;
+	}
+
+	pthread_mutex_lock(&workers->lock);
+	workers->task = task;
+	workers->data = data;
+	workers->count = count;
+	workers->next = 0;
+	workers->running = workers->cnt - 1;
+	workers->gen++;
+	pthread_cond_broadcast(&workers->start);
+	pthread_mutex_unlock(&workers->lock);
+
+	run_tasks(workers, 0);
+
+	pthread_mutex_lock(&workers->lock);
+	while (workers->running > 0)
+		pthread_cond_wait(&workers->done, &workers->lock);
+	pthread_mutex_unlock(&workers->lock);
+}
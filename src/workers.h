@@ -0,0 +1,13 @@
+/*
+ * A fixed set of threads for b2World_SetParallel(). workers_for() has
+ * the signature of b2ParallelFor, with the workers as its context. The
+ * calling thread takes part as worker 0, so workers_new(n) starts n - 1
+ * threads and worker ids are below n.
+ */
+
+struct workers;
+
+struct workers *workers_new(int cnt);
+void workers_free(struct workers *workers);
+
+void workers_for(void *workers, b2ParallelTask task, void *data, int32 count);